@@ -0,0 +1,122 @@
+// asn1bench compares the ASN.1 time parsers with OpenSSL's.
+//
+//	asn1bench [n]
+//
+// It builds n (default 1000000) DER UTCTime and GeneralizedTime values
+// such as certificate validity dates and reports the nanoseconds per
+// value for
+//
+//	nanotime    nt_ParseASN1UTCTime and nt_ParseASN1GeneralizedTime
+//	            on the content bytes
+//	to_tm       ASN1_TIME_to_tm on ASN1_TIMEs decoded beforehand
+//	d2i+to_tm   d2i_ASN1_TIME and ASN1_TIME_to_tm on the DER bytes
+//
+// OpenSSL is only needed to build this tool, not the library.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/asn1.h>
+
+#include "src/time.h"
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    if (n == 0) {
+        fprintf(stderr, "usage: asn1bench [n]\n");
+        return 2;
+    }
+
+    nt_init();
+
+    // Alternate UTCTime (tag 0x17, 13 bytes) and GeneralizedTime (tag
+    // 0x18, 15 bytes) over 1970 to 2100.
+    uint8_t (*der)[17] = malloc(n * sizeof(*der));
+    ASN1_TIME **asn1 = malloc(n * sizeof(*asn1));
+    if (der == NULL || asn1 == NULL) {
+        fprintf(stderr, "asn1bench: out of memory\n");
+        return 1;
+    }
+    uint64_t r = 1;
+    for (size_t i = 0; i < n; i++) {
+        r = r*6364136223846793005ULL + 1442695040888963407ULL;
+        nt_Time t = nt_Unix((r >> 33) % INT64_C(4102444800), 0);
+        bool utc = i%2 == 0 && nt_TimeYear(t) >= 1950 && nt_TimeYear(t) < 2050;
+        struct nt_Date d = nt_TimeDate(t);
+        struct nt_Clock c = nt_TimeClock(t);
+        char s[16];
+        if (utc) {
+            snprintf(s, sizeof(s), "%02d%02d%02d%02d%02d%02dZ", d.year%100, d.month, d.day, c.hour, c.min, c.sec);
+        } else {
+            snprintf(s, sizeof(s), "%04d%02d%02d%02d%02d%02dZ", d.year, d.month, d.day, c.hour, c.min, c.sec);
+        }
+        der[i][0] = utc ? 0x17 : 0x18;
+        der[i][1] = strlen(s);
+        memcpy(&der[i][2], s, der[i][1]);
+        const unsigned char *p = der[i];
+        asn1[i] = d2i_ASN1_TIME(NULL, &p, 2 + der[i][1]);
+        if (asn1[i] == NULL) {
+            fprintf(stderr, "asn1bench: OpenSSL rejected %s\n", s);
+            return 1;
+        }
+    }
+
+    int64_t sum = 0;
+    double start = seconds();
+    for (size_t i = 0; i < n; i++) {
+        nt_Time t;
+        char *err = der[i][0] == 0x17 ?
+            nt_ParseASN1UTCTime(&t, &der[i][2], der[i][1]) :
+            nt_ParseASN1GeneralizedTime(&t, &der[i][2], der[i][1]);
+        if (err != NULL) {
+            fprintf(stderr, "asn1bench: %s\n", err);
+            return 1;
+        }
+        sum += nt_TimeUnix(t);
+    }
+    double ours = seconds() - start;
+
+    int64_t check = 0;
+    start = seconds();
+    for (size_t i = 0; i < n; i++) {
+        struct tm tm;
+        ASN1_TIME_to_tm(asn1[i], &tm);
+        check += tm.tm_sec;
+    }
+    double toTm = seconds() - start;
+
+    start = seconds();
+    for (size_t i = 0; i < n; i++) {
+        const unsigned char *p = der[i];
+        ASN1_TIME *a = d2i_ASN1_TIME(NULL, &p, 2 + der[i][1]);
+        struct tm tm;
+        ASN1_TIME_to_tm(a, &tm);
+        check += tm.tm_sec;
+        ASN1_TIME_free(a);
+    }
+    double d2i = seconds() - start;
+
+    printf("nanotime   %7.1f ns/op\n", ours / n * 1e9);
+    printf("to_tm      %7.1f ns/op\n", toTm / n * 1e9);
+    printf("d2i+to_tm  %7.1f ns/op\n", d2i / n * 1e9);
+    fprintf(stderr, "(%lld %lld)\n", (long long)sum, (long long)check);
+
+    for (size_t i = 0; i < n; i++) {
+        ASN1_TIME_free(asn1[i]);
+    }
+    free(asn1);
+    free(der);
+    return 0;
+}
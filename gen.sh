@@ -22,7 +22,8 @@ cat << EOF
 
 EOF
 
-cat src/time.c
+cat src/std.h
+grep -v '^#include "std.h"' src/time.c
 
 cat << EOF
 #endif
@@ -0,0 +1,436 @@
+// retime rewrites the RFC 3339 timestamps at the start of log lines into
+// another zone, in parallel.
+//
+//	retime [-j threads] [-z zone] [-b] input [output]
+//
+// The input is mapped into memory and cut into line aligned chunks.
+// Worker threads convert the chunks independently and the main thread
+// writes them out in order as they complete, holding at most a small
+// window of finished chunks in memory. Lines that do not start with a
+// timestamp, or whose converted year would not fit in four digits, are
+// copied unchanged.
+//
+// zone is UTC (the default), a fixed offset such as +05:30, or an IANA
+// name such as America/New_York.
+// With -b, the input is processed with 1 to threads workers, the output
+// is discarded, and the throughput of each run is reported.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/time.h"
+
+#define CHUNK_SIZE (4 << 20)
+
+typedef struct {
+    const char *begin, *end;
+    char *out;
+    size_t outLen, outCap;
+    bool done;
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;
+    size_t nchunks;
+    size_t next;    // next chunk to hand to a worker
+    size_t written; // chunks already written out
+    size_t window;  // finished chunks allowed ahead of the writer
+    nt_Location *loc;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+} Job;
+
+static void fatalf(const char *format, const char *arg)
+{
+    fprintf(stderr, "retime: ");
+    fprintf(stderr, format, arg);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static int digits(const char *p, int n)
+{
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return -1;
+        }
+        v = v*10 + (p[i] - '0');
+    }
+    return v;
+}
+
+// daysIn returns the number of days in month of year.
+static int daysIn(int month, int year)
+{
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && year%4 == 0 && (year%100 != 0 || year%400 == 0)) {
+        return 29;
+    }
+    return days[month-1];
+}
+
+// parseRFC3339 parses a timestamp such as 2006-01-02T15:04:05.999Z or
+// 2006-01-02 15:04:05+07:00 at the start of p. It returns the number of
+// bytes used, or 0 if p does not start with a timestamp, and the number
+// of fraction digits in *prec so the output keeps the same precision.
+static size_t parseRFC3339(const char *p, size_t len, nt_Time *t, int *prec)
+{
+    if (len < 20 || p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != ' ') ||
+        p[13] != ':' || p[16] != ':') {
+        return 0;
+    }
+    int year = digits(p, 4), month = digits(p+5, 2), day = digits(p+8, 2);
+    int hour = digits(p+11, 2), min = digits(p+14, 2), sec = digits(p+17, 2);
+    if (year < 0 || month < 1 || month > 12 || day < 1 || day > daysIn(month, year) ||
+        hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 59) {
+        return 0;
+    }
+    size_t i = 19;
+    int nsec = 0;
+    *prec = 0;
+    if (p[i] == '.') {
+        int scale = 1000000000;
+        for (i++; i < len && p[i] >= '0' && p[i] <= '9'; i++) {
+            if (*prec < 9) {
+                scale /= 10;
+                nsec += (p[i] - '0') * scale;
+                (*prec)++;
+            }
+        }
+        if (*prec == 0) {
+            return 0;
+        }
+    }
+    int offset;
+    if (i < len && p[i] == 'Z') {
+        offset = 0;
+        i++;
+    } else if (i + 6 <= len && (p[i] == '+' || p[i] == '-') && p[i+3] == ':') {
+        int hh = digits(p+i+1, 2), mm = digits(p+i+4, 2);
+        if (hh < 0 || mm < 0 || mm > 59) {
+            return 0;
+        }
+        offset = (hh*60 + mm) * 60;
+        if (p[i] == '-') {
+            offset = -offset;
+        }
+        i += 6;
+    } else {
+        return 0;
+    }
+    *t = nt_Date(year, month, day, hour, min, sec, nsec, nt_UTC);
+    *t = nt_TimeAdd(*t, -offset * nt_SECOND);
+    return i;
+}
+
+static char *put2(char *b, int v)
+{
+    b[0] = '0' + v/10;
+    b[1] = '0' + v%10;
+    return b + 2;
+}
+
+// formatRFC3339 writes t in its Location with prec fraction digits and
+// returns the end of the output. It writes at most 35 bytes. It returns
+// NULL, writing nothing, if the year does not fit in four digits.
+static char *formatRFC3339(char *b, nt_Time t, int prec)
+{
+    struct nt_Date d = nt_TimeDate(t);
+    if (d.year < 0 || d.year > 9999) {
+        return NULL;
+    }
+    struct nt_Clock c = nt_TimeClock(t);
+    int offset = nt_TimeZone(t).offset;
+    b = put2(b, d.year / 100 % 100);
+    b = put2(b, d.year % 100);
+    *b++ = '-';
+    b = put2(b, d.month);
+    *b++ = '-';
+    b = put2(b, d.day);
+    *b++ = 'T';
+    b = put2(b, c.hour);
+    *b++ = ':';
+    b = put2(b, c.min);
+    *b++ = ':';
+    b = put2(b, c.sec);
+    if (prec > 0) {
+        int nsec = nt_TimeNanosecond(t);
+        for (int i = prec; i < 9; i++) {
+            nsec /= 10;
+        }
+        *b++ = '.';
+        for (int i = prec-1; i >= 0; i--) {
+            b[i] = '0' + nsec%10;
+            nsec /= 10;
+        }
+        b += prec;
+    }
+    if (offset == 0) {
+        *b++ = 'Z';
+        return b;
+    }
+    *b++ = offset < 0 ? '-' : '+';
+    if (offset < 0) {
+        offset = -offset;
+    }
+    b = put2(b, offset / 3600);
+    *b++ = ':';
+    b = put2(b, offset / 60 % 60);
+    return b;
+}
+
+static void reserve(Chunk *c, size_t n)
+{
+    if (c->outLen + n <= c->outCap) {
+        return;
+    }
+    size_t cap = c->outCap * 2;
+    if (cap < c->outLen + n) {
+        cap = c->outLen + n;
+    }
+    c->out = realloc(c->out, cap);
+    if (c->out == NULL) {
+        fatalf("%s", strerror(ENOMEM));
+    }
+    c->outCap = cap;
+}
+
+static void convertChunk(Chunk *c, nt_Location *loc)
+{
+    // Converted timestamps grow by at most the width of an offset.
+    c->outCap = (c->end - c->begin) + (c->end - c->begin) / 8 + 64;
+    c->out = malloc(c->outCap);
+    if (c->out == NULL) {
+        fatalf("%s", strerror(ENOMEM));
+    }
+    c->outLen = 0;
+    const char *p = c->begin;
+    while (p < c->end) {
+        const char *nl = memchr(p, '\n', c->end - p);
+        const char *eol = nl != NULL ? nl + 1 : c->end;
+        nt_Time t;
+        int prec;
+        size_t n = parseRFC3339(p, eol - p, &t, &prec);
+        if (n > 0) {
+            reserve(c, 35);
+            char *end = formatRFC3339(c->out + c->outLen, nt_TimeIn(t, loc), prec);
+            if (end != NULL) {
+                c->outLen = end - c->out;
+                p += n;
+            }
+        }
+        reserve(c, eol - p);
+        memcpy(c->out + c->outLen, p, eol - p);
+        c->outLen += eol - p;
+        p = eol;
+    }
+}
+
+static void *worker(void *arg)
+{
+    Job *job = arg;
+    for (;;) {
+        pthread_mutex_lock(&job->mu);
+        while (job->next < job->nchunks && job->next >= job->written + job->window) {
+            pthread_cond_wait(&job->cond, &job->mu);
+        }
+        if (job->next >= job->nchunks) {
+            pthread_mutex_unlock(&job->mu);
+            return NULL;
+        }
+        Chunk *c = &job->chunks[job->next++];
+        pthread_mutex_unlock(&job->mu);
+
+        convertChunk(c, job->loc);
+
+        pthread_mutex_lock(&job->mu);
+        c->done = true;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->mu);
+    }
+}
+
+// split cuts data into chunks of about CHUNK_SIZE bytes that end on a
+// line boundary.
+static Chunk *split(const char *data, size_t len, size_t *nchunks)
+{
+    size_t cap = len / CHUNK_SIZE + 1;
+    Chunk *chunks = calloc(cap, sizeof(Chunk));
+    if (chunks == NULL) {
+        fatalf("%s", strerror(ENOMEM));
+    }
+    size_t n = 0;
+    const char *p = data, *end = data + len;
+    while (p < end) {
+        const char *cut = p + CHUNK_SIZE < end ? p + CHUNK_SIZE : end;
+        if (cut < end) {
+            const char *nl = memchr(cut, '\n', end - cut);
+            cut = nl != NULL ? nl + 1 : end;
+        }
+        if (n == cap) {
+            cap *= 2;
+            chunks = realloc(chunks, cap * sizeof(Chunk));
+            if (chunks == NULL) {
+                fatalf("%s", strerror(ENOMEM));
+            }
+        }
+        chunks[n++] = (Chunk){.begin = p, .end = cut};
+        p = cut;
+    }
+    *nchunks = n;
+    return chunks;
+}
+
+// run converts data with nthreads workers and writes the result to fd,
+// or discards it if fd < 0.
+static void run(const char *data, size_t len, int nthreads, nt_Location *loc, int fd)
+{
+    Job job = {.loc = loc, .window = 4 * nthreads};
+    job.chunks = split(data, len, &job.nchunks);
+    pthread_mutex_init(&job.mu, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    for (int i = 0; i < nthreads; i++) {
+        pthread_create(&threads[i], NULL, worker, &job);
+    }
+
+    for (size_t i = 0; i < job.nchunks; i++) {
+        Chunk *c = &job.chunks[i];
+        pthread_mutex_lock(&job.mu);
+        while (!c->done) {
+            pthread_cond_wait(&job.cond, &job.mu);
+        }
+        pthread_mutex_unlock(&job.mu);
+
+        for (size_t off = 0; fd >= 0 && off < c->outLen;) {
+            ssize_t n = write(fd, c->out + off, c->outLen - off);
+            if (n < 0) {
+                fatalf("write: %s", strerror(errno));
+            }
+            off += n;
+        }
+        free(c->out);
+
+        pthread_mutex_lock(&job.mu);
+        job.written++;
+        pthread_cond_broadcast(&job.cond);
+        pthread_mutex_unlock(&job.mu);
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(job.chunks);
+    pthread_mutex_destroy(&job.mu);
+    pthread_cond_destroy(&job.cond);
+}
+
+static nt_Location *parseZone(const char *s)
+{
+    if (strcmp(s, "UTC") == 0 || strcmp(s, "Z") == 0) {
+        return nt_UTC;
+    }
+    if (strlen(s) == 6 && (s[0] == '+' || s[0] == '-') && s[3] == ':') {
+        int hh = digits(s+1, 2), mm = digits(s+4, 2);
+        if (hh >= 0 && hh <= 23 && mm >= 0 && mm <= 59) {
+            int offset = (hh*60 + mm) * 60;
+            return nt_FixedZone("", s[0] == '-' ? -offset : offset);
+        }
+    }
+    struct nt_LoadLocation ll = nt_LoadLocation(s);
+    if (ll.err != NULL) {
+        fatalf("unknown zone %s (want UTC, +hh:mm or an IANA name)", s);
+    }
+    return ll.loc;
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    nt_Location *loc = nt_UTC;
+    bool bench = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:z:b")) != -1) {
+        switch (opt) {
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'z':
+            loc = parseZone(optarg);
+            break;
+        case 'b':
+            bench = true;
+            break;
+        default:
+            fprintf(stderr, "usage: retime [-j threads] [-z zone] [-b] input [output]\n");
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: retime [-j threads] [-z zone] [-b] input [output]\n");
+        return 2;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    nt_init();
+
+    int in = open(argv[optind], O_RDONLY);
+    if (in < 0) {
+        fatalf("%s", strerror(errno));
+    }
+    struct stat st;
+    fstat(in, &st);
+    size_t len = st.st_size;
+    const char *data = "";
+    if (len > 0) {
+        data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, in, 0);
+        if (data == MAP_FAILED) {
+            fatalf("mmap: %s", strerror(errno));
+        }
+        posix_madvise((void *)data, len, POSIX_MADV_SEQUENTIAL);
+    }
+
+    if (bench) {
+        for (int n = 1; n <= nthreads; n++) {
+            double start = seconds();
+            run(data, len, n, loc, -1);
+            double elapsed = seconds() - start;
+            printf("threads=%-3d %8.3f s %8.2f GB/s\n", n, elapsed, len / elapsed / 1e9);
+        }
+        nt_LocationFree(loc);
+        return 0;
+    }
+
+    int out = STDOUT_FILENO;
+    if (optind + 1 < argc) {
+        out = open(argv[optind+1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out < 0) {
+            fatalf("%s", strerror(errno));
+        }
+    }
+    run(data, len, nthreads, loc, out);
+    nt_LocationFree(loc);
+    return 0;
+}
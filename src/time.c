@@ -2,6 +2,25 @@
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#endif
 
 #include "time.h"
 #include "std.h"
@@ -125,7 +144,10 @@ static const int64_t	nt_absoluteZeroYear = -292277022399;
 static const int64_t	nt_internalYear = 1;
 
 // Offsets to convert between internal and absolute or Unix times.
-static const int64_t	nt_absoluteToInternal = (nt_absoluteZeroYear - nt_internalYear) * 365.2425 * nt_secondsPerDay;
+// Go evaluates (absoluteZeroYear - internalYear) * 365.2425 * secondsPerDay
+// exactly; in C the 365.2425 makes it a double and loses 512 seconds.
+// The year count is a multiple of 400, so use whole 400-year cycles.
+static const int64_t	nt_absoluteToInternal = (nt_absoluteZeroYear - nt_internalYear) / 400 * nt_daysPer400Years * nt_secondsPerDay;
 static const int64_t	nt_internalToAbsolute       = -nt_absoluteToInternal;
 
 static const int64_t	nt_unixToInternal = (1969*365 + 1969/4 - 1969/100 + 1969/400) * nt_secondsPerDay;
@@ -226,6 +248,85 @@ const int64_t nt_omega = ((int64_t)1<<63) - 1; // math.MaxInt64
 
 #define nt_EMPTY_STR(s) ((s) == NULL || (s)[0] == '\0')
 
+// STAT adds n to the calling thread's copy of the nt_Stats counter
+// field. It compiles to nothing unless NANOTIME_STATS is defined.
+#ifdef NANOTIME_STATS
+#define nt_STAT(field, n) nt_statsAdd(offsetof(nt_Stats, field) / sizeof(uint64_t), (n))
+typedef struct {
+	_Atomic uint64_t v[sizeof(nt_Stats) / sizeof(uint64_t)];
+} nt_statsCounters;
+static _Thread_local nt_statsCounters *nt_statsMine;
+static nt_statsCounters *nt_statsRegister(void);
+// statsAdd is a relaxed load and store rather than an atomic add: only
+// the owning thread writes its counters, so this is a plain increment
+// that StatsRead can still read without a data race.
+static inline void nt_statsAdd(size_t i, uint64_t n)
+{
+	nt_statsCounters *c = nt_statsMine;
+	if (c == NULL) {
+		c = nt_statsRegister();
+	}
+	uint64_t v = atomic_load_explicit(&c->v[i], memory_order_relaxed);
+	atomic_store_explicit(&c->v[i], v + n, memory_order_relaxed);
+}
+#else
+#define nt_STAT(field, n) ((void)0)
+#endif
+
+// PROBEn places a USDT probe nanotime:name with n arguments, for bpftrace
+// and perf; see nanotime.bt. A probe is a single nop until a tracer
+// attaches, and arguments are only materialized into registers the
+// compiler already had. sys/sdt.h is used when present; otherwise, on
+// ELF x86-64 and arm64, the same .note.stapsdt entry is emitted directly.
+// Define NANOTIME_NO_PROBES to compile them out; the arguments are then
+// only named in sizeof, so they are neither evaluated nor unused.
+#if defined(NANOTIME_NO_PROBES)
+#define nt_PROBE1(name, a) ((void)sizeof(a))
+#define nt_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define nt_PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#elif defined(__has_include) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define nt_PROBE1(name, a) STAP_PROBE1(nanotime, name, a)
+#define nt_PROBE2(name, a, b) STAP_PROBE2(nanotime, name, a, b)
+#define nt_PROBE3(name, a, b, c) STAP_PROBE3(nanotime, name, a, b, c)
+#elif defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+// Every argument is passed as a signed 8-byte value, the probe's argument
+// string naming wherever the compiler put it.
+#define nt_SDT(name, args, ...) \
+	__asm__ __volatile__ ( \
+		"990: nop\n" \
+		".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+		".balign 4\n" \
+		".4byte 992f-991f, 994f-993f, 3\n" \
+		"991: .asciz \"stapsdt\"\n" \
+		"992: .balign 4\n" \
+		"993: .8byte 990b\n" \
+		".8byte _.stapsdt.base\n" \
+		".8byte 0\n" \
+		".asciz \"nanotime\"\n" \
+		".asciz \"" #name "\"\n" \
+		".asciz \"" args "\"\n" \
+		"994: .balign 4\n" \
+		".popsection\n" \
+		".ifndef _.stapsdt.base\n" \
+		".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+		".weak _.stapsdt.base\n" \
+		".hidden _.stapsdt.base\n" \
+		"_.stapsdt.base: .space 1\n" \
+		".size _.stapsdt.base, 1\n" \
+		".popsection\n" \
+		".endif\n" \
+		:: __VA_ARGS__)
+#define nt_SDTARG(x) "nor"((int64_t)(x))
+#define nt_PROBE1(name, a) nt_SDT(name, "-8@%0", nt_SDTARG(a))
+#define nt_PROBE2(name, a, b) nt_SDT(name, "-8@%0 -8@%1", nt_SDTARG(a), nt_SDTARG(b))
+#define nt_PROBE3(name, a, b, c) nt_SDT(name, "-8@%0 -8@%1 -8@%2", nt_SDTARG(a), nt_SDTARG(b), nt_SDTARG(c))
+#else
+#define nt_PROBE1(name, a) ((void)sizeof(a))
+#define nt_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define nt_PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#endif
+
 
 // Private function definitions
 // time.go
@@ -265,11 +366,16 @@ struct nt_div {
 struct nt_div nt_div(nt_Time t, nt_Duration d);
 
 // zoneinfo.go
-nt_Location *nt_Location_get(nt_Location *l);
+nt_Location *nt_fixedZone(char *name, int offset);
+static nt_Location *nt_sharedFixedZone(int offset);
+nt_Location *nt_newLocation(const char *name, size_t zoneLen, size_t txLen, const char *extend);
+
+// pool
+static size_t nt_poolGrain(size_t bytesPerElem);
 struct nt_Location_lookup {
     char *name;
     int offset;
-    int start;
+    int64_t start;
     int64_t end;
     bool isDST;
 };
@@ -278,15 +384,29 @@ int nt_Location_lookupFirstZone(nt_Location *l);
 bool nt_Location_firstZoneUsed(nt_Location *l);
 struct nt_tzset {
     char *name;
+    size_t nameLen;
     int offset;
-    int start;
+    int64_t start;
     int64_t end;
     bool isDST;
     bool ok;
 };
 struct nt_tzset nt_tzset(char *s, int64_t lastTxSec, int64_t sec);
+struct nt_tzsetZones {
+    char *stdName;
+    size_t stdLen;
+    int stdOffset;
+    char *dstName;
+    size_t dstLen;
+    int dstOffset;
+    bool hasDST;
+    char *rest;
+    bool ok;
+};
+struct nt_tzsetZones nt_tzsetZones(char *s);
 struct nt_tzsetName {
     char *tzName;
+    size_t tzNameLen;
     char *remainder;
     bool ok;
 };
@@ -303,6 +423,30 @@ struct nt_tzsetNum {
     bool ok;
 };
 struct nt_tzsetNum nt_tzsetNum(char *s, int min, int max);
+// ruleKind is the kind of a rule read from a tzset string.
+enum {
+    nt_ruleJulian,
+    nt_ruleDOY,
+    nt_ruleMonthWeekDay,
+};
+// rule is a rule read from a tzset string.
+typedef struct {
+    int kind;
+    int day;
+    int week;
+    int mon;
+    int time; // transition time
+} nt_rule;
+struct nt_tzsetRule {
+    nt_rule r;
+    char *rest;
+    bool ok;
+};
+struct nt_tzsetRule nt_tzsetRule(char *s);
+int nt_tzruleTime(int year, nt_rule r, int off);
+nt_zone *nt_findZone(nt_Location *l, char *name, size_t nameLen, int offset, bool isDST);
+void nt_Location_fillCache(nt_Location *l, int64_t sec);
+static void nt_initLocal(void);
 //
 
 
@@ -368,7 +512,7 @@ void nt_Time_addSec(nt_Time *t, int64_t d)
 // setLoc sets the location associated with the time.
 void nt_Time_setLoc(nt_Time *t, nt_Location *loc)
 {
-	if (strcmp(loc->name, nt_utcLoc.name) == 0) {
+	if (loc == &nt_utcLoc) {
 		loc = NULL;
 	}
 	nt_Time_stripMono(t);
@@ -477,6 +621,7 @@ char *nt_MonthString(nt_Month m)
 {
     char *str;
 	if (nt_JANUARY <= m && m <= nt_DECEMBER) {
+        nt_STAT(stringAllocs, 1);
         str = malloc(strlen(nt_longMonthNames[m-1]) + 1);
         strcpy(str, nt_longMonthNames[m-1]);
 		return str;
@@ -485,6 +630,7 @@ char *nt_MonthString(nt_Month m)
     char buf[bufLen];
 	int n = nt_fmtInt(buf, bufLen, m);
 
+    nt_STAT(stringAllocs, 1);
     str = malloc(8 + bufLen + 1 + 1);
     str[0] = '\0';
     strncat(str, "%!Month(", 8);
@@ -499,6 +645,7 @@ char *nt_WeekdayString(nt_Weekday d)
 {
     char *str;
 	if (nt_SUNDAY <= d && d <= nt_SATURDAY) {
+        nt_STAT(stringAllocs, 1);
         str = malloc(strlen(nt_longDayNames[d]) + 1);
         strcpy(str, nt_longDayNames[d]);
 		return str;
@@ -507,6 +654,7 @@ char *nt_WeekdayString(nt_Weekday d)
     char buf[bufLen];
 	int n = nt_fmtInt(buf, bufLen, d);
 
+    nt_STAT(stringAllocs, 1);
     str = malloc(10 + bufLen + 1 + 1);
     str[0] = '\0';
     strncat(str, "%!Weekday(", 10);
@@ -535,10 +683,13 @@ uint64_t nt_Time_abs(nt_Time t)
 	int64_t sec = nt_Time_unixSec(&t);
 	if (l != &nt_utcLoc) {
 		if (l->cacheZone != NULL && l->cacheStart <= sec && sec < l->cacheEnd) {
+			nt_STAT(cacheHits, 1);
+			nt_PROBE3(zone_cache, l, sec, 1);
 			sec += l->cacheZone->offset;
 		} else {
-			/* _, offset, _, _, _ := l.lookup(sec); */
-			/* sec += offset; */
+			nt_STAT(cacheMisses, 1);
+			nt_PROBE3(zone_cache, l, sec, 0);
+			sec += nt_Location_lookup(l, sec).offset;
 		}
 	}
 	return sec + (nt_unixToInternal + nt_internalToAbsolute);
@@ -563,16 +714,22 @@ struct nt_Timelocabs{
     struct nt_Timelocabs ret = {0};
 	nt_Location *l = t.loc;
 	if (l == NULL || l == &nt_localLoc) {
-		/* l = l.get(); */
+		l = nt_Location_get(l);
 	}
 	// Avoid function call if we hit the local time cache.
 	int64_t sec = nt_Time_unixSec(&t);
 	if (l != &nt_utcLoc) {
 		if (l->cacheZone != NULL && l->cacheStart <= sec && sec < l->cacheEnd) {
+			nt_STAT(cacheHits, 1);
+			nt_PROBE3(zone_cache, l, sec, 1);
 			ret.name = l->cacheZone->name;
 			ret.offset = l->cacheZone->offset;
 		} else {
-			/* name, offset, _, _, _ = l.lookup(sec) */
+			nt_STAT(cacheMisses, 1);
+			nt_PROBE3(zone_cache, l, sec, 0);
+			struct nt_Location_lookup lookup = nt_Location_lookup(l, sec);
+			ret.name = lookup.name;
+			ret.offset = lookup.offset;
 		}
 		sec += ret.offset;
 	} else {
@@ -726,8 +883,10 @@ char *nt_DurationString(nt_Duration d)
 	// Thus, the caller can decide whether a string must be heap allocated.
 	char arr[32];
 	int n = nt_Duration_format(d, arr);
+    nt_STAT(stringAllocs, 1);
     char *str = malloc(32 - n + 1);
-    strncpy(str, &arr[n], 32-n);
+    memcpy(str, &arr[n], 32-n);
+    str[32-n] = '\0';
     return str;
 }
 
@@ -1195,12 +1354,14 @@ struct nt_now {
 struct nt_now nt_now()
 {
     struct timespec ts;
+    nt_STAT(realtimeReads, 1);
     clock_gettime(CLOCK_REALTIME, &ts);
+    nt_PROBE2(clock_read, CLOCK_REALTIME, ts.tv_sec*(int64_t)1e9 + ts.tv_nsec);
 
     return (struct nt_now){
         .sec = ts.tv_sec,
         .nsec = ts.tv_nsec,
-        .mono = 0,
+        .mono = nt_runtimeNano(),
     };
 }
 
@@ -1209,8 +1370,11 @@ struct nt_now nt_now()
 //go:linkname runtimeNano runtime.nanotime
 int64_t nt_runtimeNano() 
 {
-    struct nt_now now = nt_now();
-    return now.nsec;
+    struct timespec ts;
+    nt_STAT(monotonicReads, 1);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    nt_PROBE2(clock_read, CLOCK_MONOTONIC, ts.tv_sec*(int64_t)1e9 + ts.tv_nsec);
+    return ts.tv_sec*(int64_t)1e9 + ts.tv_nsec;
 }
 
 // Now returns the current local time.
@@ -1296,8 +1460,8 @@ struct nt_TimeZoneBounds nt_TimeZoneBounds(nt_Time t)
 	/* _, _, startSec, endSec, _ := t.loc.lookup(t.unixSec()) */
     struct nt_TimeZoneBounds ret = {0};
 	struct nt_Location_lookup lookup = nt_Location_lookup(t.loc, nt_Time_unixSec(&t));
-    int startSec = lookup.start;
-    int endSec = lookup.end;
+    int64_t startSec = lookup.start;
+    int64_t endSec = lookup.end;
 	if (startSec != nt_alpha) {
 		ret.start = nt_unixTime(startSec, 0);
 		nt_Time_setLoc(&ret.start, t.loc);
@@ -1332,9 +1496,7 @@ int64_t nt_TimeUnixNano(nt_Time t)
 	return nt_Time_unixSec(&t)*1e9 + nt_Time_nsec(&t);
 }
 
-// Encoding methods are not implemented
-// MarshalBinary
-// UnmarshalBinary
+// Encoding methods not yet implemented
 // GobEncode
 // GobDecode
 // MarshalJSON
@@ -1342,716 +1504,6451 @@ int64_t nt_TimeUnixNano(nt_Time t)
 // MarshalText
 // UnmarshalText
 
-// Unix returns the local Time corresponding to the given Unix time,
-// sec seconds and nsec nanoseconds since January 1, 1970 UTC.
-// It is valid to pass nsec outside the range [0, 999999999].
-// Not all sec values have a corresponding time value. One such
-// value is 1<<63-1 (the largest int64 value).
-nt_Time nt_Unix(int64_t sec, int64_t nsec)
+enum {
+	nt_timeBinaryVersionV1 = 1, // For general situation
+	nt_timeBinaryVersionV2,     // For LMT only
+};
+
+// Big-endian helpers for the binary encodings. Written as plain shifts
+// so the compiler can fold them into a single load/store and bswap.
+static inline void nt_be16put(uint8_t *b, uint16_t v)
 {
-	if (nsec < 0 || nsec >= 1e9) {
-		int64_t n = nsec / 1e9;
-		sec += n;
-		nsec -= n * 1e9;
-		if (nsec < 0) {
-			nsec += 1e9;
-			sec--;
-		}
-	}
-	return nt_unixTime(sec, nsec);
+	b[0] = v >> 8;
+	b[1] = v;
 }
 
-// UnixMilli returns t as a Unix time, the number of milliseconds elapsed since
-// January 1, 1970 UTC. The result is undefined if the Unix time in
-// milliseconds cannot be represented by an int64 (a date more than 292 million
-// years before or after 1970). The result does not depend on the
-// location associated with t.
-int64_t nt_TimeUnixMilli(nt_Time t)
+static inline void nt_be32put(uint8_t *b, uint32_t v)
 {
-	return nt_Time_unixSec(&t)*1e3 + nt_Time_nsec(&t)/1e6;
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >> 8;
+	b[3] = v;
 }
 
-// UnixMicro returns t as a Unix time, the number of microseconds elapsed since
-// January 1, 1970 UTC. The result is undefined if the Unix time in
-// microseconds cannot be represented by an int64 (a date before year -290307 or
-// after year 294246). The result does not depend on the location associated
-// with t.
-int64_t nt_TimeUnixMicro(nt_Time t)
+static inline void nt_be64put(uint8_t *b, uint64_t v)
 {
-	return nt_Time_unixSec(&t)*1e6 + nt_Time_nsec(&t)/1e3;
+	nt_be32put(b, v >> 32);
+	nt_be32put(b + 4, v);
 }
 
-// IsDST reports whether the time in the configured location is in Daylight Savings Time.
-bool nt_TimeIsDST(nt_Time t)
+static inline uint16_t nt_be16(const uint8_t *b)
 {
-    struct nt_Location_lookup lookup = nt_Location_lookup(t.loc, nt_TimeUnix(t));
-	return lookup.isDST;
+	return (uint16_t)b[0]<<8 | b[1];
 }
 
-bool nt_isLeap(int year)
+static inline uint32_t nt_be32(const uint8_t *b)
 {
-	return year%4 == 0 && (year%100 != 0 || year%400 == 0);
+	return (uint32_t)b[0]<<24 | (uint32_t)b[1]<<16 | (uint32_t)b[2]<<8 | b[3];
 }
 
-struct nt_norm {
-    int nhi, nlo;
-};
-// norm returns nhi, nlo such that
-//
-//	hi * base + lo == nhi * base + nlo
-//	0 <= nlo < base
-struct nt_norm nt_norm(int hi, int lo, int base) 
+static inline uint64_t nt_be64(const uint8_t *b)
 {
-	if (lo < 0) {
-		int n = (-lo-1)/base + 1;
-		hi -= n;
-		lo += n * base;
+	return (uint64_t)nt_be32(b)<<32 | nt_be32(b + 4);
+}
+
+// MarshalBinary writes the Go encoding.BinaryMarshaler form of t into buf,
+// which must hold at least nt_TIME_BINARY_MAXLEN bytes.
+// The encoding is byte-for-byte compatible with Go's Time.MarshalBinary,
+// so values can be exchanged with Go services.
+// It returns the number of bytes written, or an error.
+struct nt_TimeMarshalBinary nt_TimeMarshalBinary(nt_Time t, uint8_t buf[nt_TIME_BINARY_MAXLEN])
+{
+	int16_t offsetMin; // minutes east of UTC. -1 is UTC.
+	int8_t offsetSec = 0;
+	uint8_t version = nt_timeBinaryVersionV1;
+
+	if (nt_TimeLocation(t) == nt_UTC) {
+		offsetMin = -1;
+	} else {
+		int offset = nt_TimeZone(t).offset;
+		if (offset%60 != 0) {
+			version = nt_timeBinaryVersionV2;
+			offsetSec = offset % 60;
+		}
+
+		offset /= 60;
+		if (offset < -32768 || offset == -1 || offset > 32767) {
+			return (struct nt_TimeMarshalBinary){0, "Time.MarshalBinary: unexpected zone offset"};
+		}
+		offsetMin = offset;
 	}
-	if (lo >= base) {
-		int n = lo / base;
-		hi += n;
-		lo -= n * base;
+
+	buf[0] = version;                    // byte 0 : version
+	nt_be64put(&buf[1], nt_Time_sec(&t));  // bytes 1-8: seconds
+	nt_be32put(&buf[9], nt_Time_nsec(&t)); // bytes 9-12: nanoseconds
+	nt_be16put(&buf[13], offsetMin);     // bytes 13-14: zone offset in minutes
+	if (version == nt_timeBinaryVersionV2) {
+		buf[15] = offsetSec;
+		return (struct nt_TimeMarshalBinary){16, NULL};
 	}
-	return (struct nt_norm){.nhi = hi, .nlo = lo};
+	return (struct nt_TimeMarshalBinary){15, NULL};
 }
 
-// Date returns the Time corresponding to
-//
-//	yyyy-mm-dd hh:mm:ss + nsec nanoseconds
-//
-// in the appropriate zone for that time in the given location.
-//
-// The month, day, hour, min, sec, and nsec values may be outside
-// their usual ranges and will be normalized during the conversion.
-// For example, October 32 converts to November 1.
-//
-// A daylight savings time transition skips or repeats times.
-// For example, in the United States, March 13, 2011 2:15am never occurred,
-// while November 6, 2011 1:15am occurred twice. In such cases, the
-// choice of time zone, and therefore the time, is not well-defined.
-// Date returns a time that is correct in one of the two zones involved
-// in the transition, but it does not guarantee which.
+// UnmarshalBinary decodes the form produced by MarshalBinary into t.
+// It returns NULL on success or an error message.
 //
-// Date panics if loc is nil.
-nt_Time nt_Date(int year, nt_Month month, int day, int hour, int min, int sec, int nsec, nt_Location *loc)
+// The Location is set to UTC, Local, or a FixedZone for the stored offset.
+// Offsets that are a whole number of hours share a static Location, so
+// decoding does not allocate in the common case.
+char *nt_TimeUnmarshalBinary(nt_Time *t, const uint8_t *data, size_t len)
 {
-	if (loc == NULL) {
-        nt_panic("time: missing Location in call to Date\n");
+	const uint8_t *buf = data;
+	if (len == 0) {
+		return "Time.UnmarshalBinary: no data";
 	}
 
-	// Normalize month, overflowing into year.
-	int m = month - 1;
-    struct nt_norm norm;
-	norm = nt_norm(year, m, 12);
-    year = norm.nhi;
-    m = norm.nlo;
-	month = m + 1;
+	uint8_t version = buf[0];
+	if (version != nt_timeBinaryVersionV1 && version != nt_timeBinaryVersionV2) {
+		return "Time.UnmarshalBinary: unsupported version";
+	}
 
-	// Normalize nsec, sec, min, hour, overflowing into day.
-	norm = nt_norm(sec, nsec, 1e9);
-    sec = norm.nhi;
-    nsec = norm.nlo;
-	norm = nt_norm(min, sec, 60);
-    min = norm.nhi;
-    sec = norm.nlo;
-	norm = nt_norm(hour, min, 60);
-    hour = norm.nhi;
-    min = norm.nlo;
-	norm = nt_norm(day, hour, 24);
-    day = norm.nhi;
-    hour = norm.nlo;
+	size_t wantLen = /*version*/ 1 + /*sec*/ 8 + /*nsec*/ 4 + /*zone offset*/ 2;
+	if (version == nt_timeBinaryVersionV2) {
+		wantLen++;
+	}
+	if (len != wantLen) {
+		return "Time.UnmarshalBinary: invalid length";
+	}
 
-	// Compute days since the absolute epoch.
-	uint64_t d = nt_daysSinceEpoch(year);
+	buf++;
+	int64_t sec = nt_be64(buf);
 
-	// Add in days before this month.
-	d += nt_daysBefore[month-1];
-	if (nt_isLeap(year) && month >= nt_MARCH) {
-		d++; // February 29
+	buf += 8;
+	int32_t nsec = nt_be32(buf);
+
+	buf += 4;
+	int offset = (int16_t)nt_be16(buf) * 60;
+	if (version == nt_timeBinaryVersionV2) {
+		offset += buf[2];
 	}
 
-	// Add in days before today.
-	d += day - 1;
+	*t = (nt_Time){0};
+	t->wall = nsec;
+	t->ext = sec;
 
-	// Add in time elapsed today.
-	uint64_t abs = d * nt_secondsPerDay;
-    abs += hour*nt_secondsPerHour + min*nt_secondsPerMinute + sec;
+	if (offset == -1*60) {
+		nt_Time_setLoc(t, &nt_utcLoc);
+	} else if (nt_Location_lookup(nt_Local, nt_Time_unixSec(t)).offset == offset) {
+		nt_Time_setLoc(t, nt_Local);
+	} else {
+		nt_Time_setLoc(t, nt_sharedFixedZone(offset));
+	}
 
-	int64_t unix = abs + (nt_absoluteToInternal + nt_internalToUnix);
+	return NULL;
+}
 
-	// Look for zone offset for expected time, so we can adjust to UTC.
-	// The lookup function expects UTC, so first we pass unix in the
-	// hope that it will not be too close to a zone transition,
-	// and then adjust if it is.
-	struct nt_Location_lookup lookup = nt_Location_lookup(loc, unix);
-    int offset = lookup.offset;
-    int start = lookup.start;
-    int64_t end = lookup.end;
-	if (offset != 0) {
-		int64_t utc = unix - offset;
-		// If utc is valid for the time zone we found, then we have the right offset.
-		// If not, we get the correct offset by looking up utc in the location.
-		if (utc < start || utc >= end) {
-            nt_Location_lookup(loc, utc);
-            offset = lookup.offset;
+// MarshalCompact writes t as a fixed-width 12-byte value: the Unix
+// seconds as a big-endian int64 followed by the nanoseconds as a
+// big-endian uint32. The Location and monotonic clock reading are
+// dropped, so the value always decodes as UTC.
+void nt_TimeMarshalCompact(nt_Time t, uint8_t buf[nt_TIME_COMPACT_LEN])
+{
+	nt_be64put(&buf[0], nt_Time_unixSec(&t));
+	nt_be32put(&buf[8], nt_Time_nsec(&t));
+}
+
+// UnmarshalCompact decodes a value written by MarshalCompact.
+// It reports false if the nanoseconds field is out of range.
+bool nt_TimeUnmarshalCompact(nt_Time *t, const uint8_t buf[nt_TIME_COMPACT_LEN])
+{
+	int64_t sec = nt_be64(&buf[0]);
+	uint32_t nsec = nt_be32(&buf[8]);
+	if (nsec >= 1e9) {
+		return false;
+	}
+	*t = (nt_Time){nsec, sec + nt_unixToInternal, NULL};
+	return true;
+}
+
+// Chunk dispatch for the batch kernels. When a kernel is given a Pool it
+// packs its arguments into one of these and runs itself on each chunk
+// with a NULL pool, so the serial loops are the only implementation.
+
+enum {
+	nt_chunkMarshalCompact,
+	nt_chunkUnmarshalCompact,
+	nt_chunkEncodeKey,
+	nt_chunkEncodeKey64,
+	nt_chunkParseASN1,
+	nt_chunkArrowField,
+	nt_chunkArrowToLocal,
+	nt_chunkArrowTruncate,
+	nt_chunkArrowToTimes,
+	nt_chunkInt96ToUnixNano,
+	nt_chunkInt96FromUnixNano,
+	nt_chunkInt96ToTimes,
+	nt_chunkInt96FromTimes,
+	nt_chunkDateTimeToUnixNano,
+	nt_chunkDateTimeFromUnixNano,
+	nt_chunkCivilDateFormat,
+	nt_chunkCivilDateParse,
+	nt_chunkCivilTimeFormat,
+	nt_chunkCivilTimeParse,
+};
+
+struct nt_timeChunk {
+	int kind;
+	nt_Time *ts;
+	uint8_t *buf;
+	const uint8_t *const *der;
+	bool desc;
+	atomic_size_t failed;
+};
+
+static void nt_timeChunk(void *ctx, size_t lo, size_t hi)
+{
+	struct nt_timeChunk *c = ctx;
+	size_t n = hi - lo;
+	switch (c->kind) {
+	case nt_chunkMarshalCompact:
+		nt_TimeMarshalCompactBatch(c->ts + lo, n, c->buf + lo*nt_TIME_COMPACT_LEN, NULL);
+		break;
+	case nt_chunkUnmarshalCompact:
+		if (!nt_TimeUnmarshalCompactBatch(c->buf + lo*nt_TIME_COMPACT_LEN, n, c->ts + lo, NULL)) {
+			atomic_fetch_add(&c->failed, 1);
 		}
-		unix -= offset;
+		break;
+	case nt_chunkEncodeKey:
+		nt_TimeEncodeKeyBatch(c->ts + lo, n, c->desc, c->buf + lo*nt_TIME_KEY_LEN, NULL);
+		break;
+	case nt_chunkEncodeKey64:
+		nt_TimeEncodeKey64Batch(c->ts + lo, n, c->desc, c->buf + lo*nt_TIME_KEY64_LEN, NULL);
+		break;
+	case nt_chunkParseASN1:
+		atomic_fetch_add(&c->failed, nt_ParseASN1TimeBatch(c->der + lo, n, c->ts + lo, NULL));
+		break;
 	}
+}
 
-	nt_Time t = nt_unixTime(unix, nsec);
-    nt_Time_setLoc(&t, loc);
-	return t;
+struct nt_arrowChunk {
+	int kind;
+	const struct ArrowSchema *schema;
+	const struct ArrowArray *array;
+	nt_Location *loc;
+	nt_Field field;
+	nt_Duration d;
+	void *out;
+};
+
+static void nt_arrowChunk(void *ctx, size_t lo, size_t hi)
+{
+	struct nt_arrowChunk *c = ctx;
+	struct ArrowArray sub = *c->array;
+	sub.offset += lo;
+	sub.length = hi - lo;
+	switch (c->kind) {
+	case nt_chunkArrowField:
+		nt_ArrowField(c->schema, &sub, c->loc, c->field, (int32_t *)c->out + lo, NULL);
+		break;
+	case nt_chunkArrowToLocal:
+		nt_ArrowToLocal(c->schema, &sub, c->loc, (int64_t *)c->out + lo, NULL);
+		break;
+	case nt_chunkArrowTruncate:
+		nt_ArrowTruncate(c->schema, &sub, c->d, (int64_t *)c->out + lo, NULL);
+		break;
+	case nt_chunkArrowToTimes:
+		nt_ArrowToTimes(c->schema, &sub, c->loc, (nt_Time *)c->out + lo, NULL);
+		break;
+	}
 }
 
-// Truncate returns the result of rounding t down to a multiple of d (since the zero time).
-// If d <= 0, Truncate returns t stripped of any monotonic clock reading but otherwise unchanged.
+struct nt_parquetChunk {
+	int kind;
+	const void *src, *src2;
+	void *dst, *dst2;
+	nt_Duration unit;
+};
+
+static void nt_parquetChunk(void *ctx, size_t lo, size_t hi)
+{
+	struct nt_parquetChunk *c = ctx;
+	size_t n = hi - lo;
+	switch (c->kind) {
+	case nt_chunkInt96ToUnixNano:
+		nt_ParquetInt96ToUnixNano((const uint8_t *)c->src + lo*nt_PARQUET_INT96_LEN, n, (int64_t *)c->dst + lo, NULL);
+		break;
+	case nt_chunkInt96FromUnixNano:
+		nt_ParquetInt96FromUnixNano((const int64_t *)c->src + lo, n, (uint8_t *)c->dst + lo*nt_PARQUET_INT96_LEN, NULL);
+		break;
+	case nt_chunkInt96ToTimes:
+		nt_ParquetInt96ToTimes((const uint8_t *)c->src + lo*nt_PARQUET_INT96_LEN, n, (nt_Time *)c->dst + lo, NULL);
+		break;
+	case nt_chunkInt96FromTimes:
+		nt_ParquetInt96FromTimes((const nt_Time *)c->src + lo, n, (uint8_t *)c->dst + lo*nt_PARQUET_INT96_LEN, NULL);
+		break;
+	case nt_chunkDateTimeToUnixNano:
+		nt_ParquetDateTimeToUnixNano((const int32_t *)c->src + lo, c->src2 ? (const int64_t *)c->src2 + lo : NULL,
+			c->unit, n, (int64_t *)c->dst + lo, NULL);
+		break;
+	case nt_chunkDateTimeFromUnixNano:
+		nt_ParquetDateTimeFromUnixNano((const int64_t *)c->src + lo, n, c->unit,
+			c->dst ? (int32_t *)c->dst + lo : NULL, c->dst2 ? (int64_t *)c->dst2 + lo : NULL, NULL);
+		break;
+	}
+}
+
+struct nt_civilChunk {
+	int kind;
+	const void *src;
+	void *dst;
+	atomic_size_t failed;
+};
+
+static void nt_civilChunk(void *ctx, size_t lo, size_t hi)
+{
+	struct nt_civilChunk *c = ctx;
+	size_t n = hi - lo;
+	switch (c->kind) {
+	case nt_chunkCivilDateFormat:
+		nt_CivilDateFormatBatch((const nt_CivilDate *)c->src + lo, n, (char *)c->dst + lo*nt_CIVIL_DATE_LEN, NULL);
+		break;
+	case nt_chunkCivilDateParse:
+		atomic_fetch_add(&c->failed, nt_CivilDateParseBatch((const char *)c->src + lo*nt_CIVIL_DATE_LEN, n,
+			(nt_CivilDate *)c->dst + lo, NULL));
+		break;
+	case nt_chunkCivilTimeFormat:
+		nt_CivilTimeFormatBatch((const nt_CivilTime *)c->src + lo, n, (char *)c->dst + lo*nt_CIVIL_TIME_LEN, NULL);
+		break;
+	case nt_chunkCivilTimeParse:
+		atomic_fetch_add(&c->failed, nt_CivilTimeParseBatch((const char *)c->src + lo*nt_CIVIL_TIME_LEN, n,
+			(nt_CivilTime *)c->dst + lo, NULL));
+		break;
+	}
+}
+
+// MarshalCompactBatch writes n times as consecutive 12-byte compact values
+// into buf, which must hold n*nt_TIME_COMPACT_LEN bytes.
 //
-// Truncate operates on the time as an absolute duration since the
-// zero time; it does not operate on the presentation form of the
-// time. Thus, Truncate(Hour) may return a time with a non-zero
-// minute, depending on the time's Location.
-nt_Time nt_TimeTruncate(nt_Time t, nt_Duration d)
+// The loop is branch free: the hasMonotonic bit is turned into a mask that
+// selects between the packed and the ext seconds, so it vectorizes and
+// does not mispredict on mixed input.
+void nt_TimeMarshalCompactBatch(const nt_Time *ts, size_t n, uint8_t *buf, nt_Pool *pool)
 {
-	nt_Time_stripMono(&t);
-	if (d <= 0) {
-		return t;
+	if (pool != NULL) {
+		struct nt_timeChunk c = {.kind = nt_chunkMarshalCompact, .ts = (nt_Time *)ts, .buf = buf};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_Time) + nt_TIME_COMPACT_LEN), nt_timeChunk, &c);
+		return;
+	}
+	for (size_t i = 0; i < n; i++) {
+		uint64_t wall = ts[i].wall;
+		uint64_t mono = -(wall >> 63);
+		int64_t packed = nt_wallToInternal + (int64_t)(wall<<1>>(nt_nsecShift+1));
+		int64_t sec = (packed & mono) | (ts[i].ext & ~mono);
+		nt_be64put(&buf[i*nt_TIME_COMPACT_LEN], sec + nt_internalToUnix);
+		nt_be32put(&buf[i*nt_TIME_COMPACT_LEN + 8], wall & nt_nsecMask);
 	}
-    struct nt_div div = nt_div(t, d);
-    nt_Duration r = div.r;
-	return nt_TimeAdd(t, -r);
 }
 
-// Round returns the result of rounding t to the nearest multiple of d (since the zero time).
-// The rounding behavior for halfway values is to round up.
-// If d <= 0, Round returns t stripped of any monotonic clock reading but otherwise unchanged.
+// UnmarshalCompactBatch decodes n consecutive 12-byte compact values from
+// buf into ts. All results are in UTC.
+// Validation is accumulated without branching and reported once at the
+// end: it returns false if any nanoseconds field was out of range, in
+// which case the contents of ts are unspecified.
+bool nt_TimeUnmarshalCompactBatch(const uint8_t *buf, size_t n, nt_Time *ts, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_timeChunk c = {.kind = nt_chunkUnmarshalCompact, .ts = ts, .buf = (uint8_t *)buf};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_Time) + nt_TIME_COMPACT_LEN), nt_timeChunk, &c);
+		return atomic_load(&c.failed) == 0;
+	}
+	uint32_t bad = 0;
+	for (size_t i = 0; i < n; i++) {
+		int64_t sec = nt_be64(&buf[i*nt_TIME_COMPACT_LEN]);
+		uint32_t nsec = nt_be32(&buf[i*nt_TIME_COMPACT_LEN + 8]);
+		bad |= nsec >= 1000000000;
+		ts[i] = (nt_Time){nsec, sec + nt_unixToInternal, NULL};
+	}
+	return bad == 0;
+}
+
+// RPC wire formats.
 //
-// Round operates on the time as an absolute duration since the
-// zero time; it does not operate on the presentation form of the
-// time. Thus, Round(Hour) may return a time with a non-zero
-// minute, depending on the time's Location.
-nt_Time nt_TimeRound(nt_Time t, nt_Duration d)
+// The encoders below write into caller supplied buffers sized by the
+// nt_*_MAXLEN constants and never allocate. Decoders return the time in
+// UTC. Like UnmarshalBinary they report errors as a message, NULL on
+// success; the streaming decoders also report the number of bytes used.
+
+// Valid range of google.protobuf.Timestamp: 0001-01-01 to 9999-12-31.
+static const int64_t nt_protoMinTimestamp = -62135596800;
+static const int64_t nt_protoMaxTimestamp = 253402300799;
+// Valid range of google.protobuf.Duration: about +-10000 years.
+static const int64_t nt_protoMaxDuration = 315576000000;
+
+// putUvarint encodes v as a protobuf base 128 varint and returns the
+// number of bytes written (at most 10).
+static inline size_t nt_putUvarint(uint8_t *buf, uint64_t v)
 {
-	nt_Time_stripMono(&t);
-	if (d <= 0) {
-		return t;
+	size_t i = 0;
+	while (v >= 0x80) {
+		buf[i++] = (uint8_t)v | 0x80;
+		v >>= 7;
 	}
-	struct nt_div div = nt_div(t, d);
-    nt_Duration r = div.r;
-	if (nt_lessThanHalf(r, d)) {
-		return nt_TimeAdd(t, -r);
+	buf[i++] = v;
+	return i;
+}
+
+// uvarint decodes a varint from buf into *v and returns the number of
+// bytes read, or 0 if buf is truncated or the value overflows 64 bits.
+static inline size_t nt_uvarint(const uint8_t *buf, size_t len, uint64_t *v)
+{
+	// Fast path: most fields (nanos, small seconds, tags, lengths) fit in one byte.
+	if (len > 0 && buf[0] < 0x80) {
+		*v = buf[0];
+		return 1;
 	}
-	return nt_TimeAdd(t, d - r);
+	uint64_t x = 0;
+	if (len > 10) {
+		len = 10;
+	}
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = buf[i];
+		if (i == 9 && b > 1) {
+			return 0; // overflow
+		}
+		x |= (uint64_t)(b & 0x7f) << (7 * i);
+		if (b < 0x80) {
+			*v = x;
+			return i + 1;
+		}
+	}
+	return 0;
 }
 
-// div divides t by d and returns the quotient parity and remainder.
-// We don't use the quotient parity anymore (round half up instead of round to even)
-// but it's still here in case we change our minds.
-struct nt_div nt_div(nt_Time t, nt_Duration d)
+// protoSkip returns the size of the value of a field with the given wire
+// type at the start of buf, or 0 if it is malformed.
+static size_t nt_protoSkip(const uint8_t *buf, size_t len, int wireType)
 {
-    struct nt_div ret = {0};
-	bool neg = false;
-	int32_t nsec = nt_Time_nsec(&t);
-	int64_t sec = nt_Time_sec(&t);
-	if (sec < 0) {
-		// Operate on absolute value.
-		neg = true;
-		sec = -sec;
-		nsec = -nsec;
-		if (nsec < 0) {
-			nsec += 1e9;
-			sec--; // sec >= 1 before the -- so safe
+	uint64_t v;
+	size_t n;
+	switch (wireType) {
+	case 0: // varint
+		return nt_uvarint(buf, len, &v);
+	case 1: // fixed64
+		return len >= 8 ? 8 : 0;
+	case 2: // length-delimited
+		n = nt_uvarint(buf, len, &v);
+		if (n == 0 || v > len - n) {
+			return 0;
 		}
+		return n + v;
+	case 5: // fixed32
+		return len >= 4 ? 4 : 0;
 	}
+	return 0;
+}
 
-	// Special case: 2d divides 1 second.
-	if (d < nt_SECOND && nt_SECOND%(d+d) == 0) {
-		ret.qmod2 = (nsec/d) & 1;
-		ret.r = nsec % d;
+struct nt_protoSecNanos {
+	int64_t seconds;
+	int32_t nanos;
+	char *err;
+};
 
-	// Special case: d is a multiple of 1 second.
-    } else if (d%nt_SECOND == 0) {
-		int64_t d1 = d / nt_SECOND;
-		ret.qmod2 = (sec/d1) & 1;
-		ret.r = (sec%d1)*nt_SECOND + nsec;
-
-	// General case.
-	// This could be faster if more cleverness were applied,
-	// but it's really only here to avoid special case restrictions in the API.
-	// No one will care about these cases.
-    } else {
-		// Compute nanoseconds as 128-bit number.
-		uint64_t sec1 = (uint64_t)sec;
-		uint64_t tmp = (sec1 >> 32) * 1e9;
-		uint64_t u1 = tmp >> 32;
-		uint64_t u0 = tmp << 32;
-		tmp = (sec1 & 0xFFFFFFFF) * 1e9;
-        uint64_t u0x = u0;
-        u0 = u0+tmp;
-		if (u0 < u0x) {
-			u1++;
+// protoSecNanos decodes the shared layout of Timestamp and Duration:
+// field 1 int64 seconds, field 2 int32 nanos. Unknown fields are skipped.
+static struct nt_protoSecNanos nt_protoSecNanos(const uint8_t *buf, size_t len)
+{
+	struct nt_protoSecNanos ret = {0};
+	while (len > 0) {
+		uint64_t tag, v;
+		size_t n = nt_uvarint(buf, len, &tag);
+		if (n == 0) {
+			ret.err = "proto: malformed tag";
+			return ret;
 		}
-        u0x = u0;
-        u0 = u0+nsec;
-		if (u0 < u0x) {
-			u1++;
+		buf += n;
+		len -= n;
+		if (tag == (1<<3 | 0) || tag == (2<<3 | 0)) {
+			n = nt_uvarint(buf, len, &v);
+			if (n == 0) {
+				ret.err = "proto: malformed varint";
+				return ret;
+			}
+			if (tag == (1<<3 | 0)) {
+				ret.seconds = v;
+			} else {
+				ret.nanos = (int32_t)v;
+			}
+		} else {
+			n = nt_protoSkip(buf, len, tag & 7);
+			if (n == 0) {
+				ret.err = "proto: malformed field";
+				return ret;
+			}
 		}
+		buf += n;
+		len -= n;
+	}
+	return ret;
+}
 
-		// Compute remainder by subtracting r<<k for decreasing k.
-		// Quotient parity is whether we subtract on last round.
-		uint64_t d1 = d;
-		while ((d1>>63) != 1) {
-			d1 <<= 1;
+// putProtoSecNanos writes the Timestamp/Duration body, omitting zero
+// fields as proto3 does.
+static inline size_t nt_putProtoSecNanos(uint8_t *buf, int64_t seconds, int32_t nanos)
+{
+	size_t n = 0;
+	if (seconds != 0) {
+		buf[n++] = 1<<3 | 0;
+		n += nt_putUvarint(&buf[n], seconds);
+	}
+	if (nanos != 0) {
+		buf[n++] = 2<<3 | 0;
+		n += nt_putUvarint(&buf[n], (int64_t)nanos);
+	}
+	return n;
+}
+
+// MarshalProto writes t as the body of a google.protobuf.Timestamp message
+// and returns its length. The monotonic clock reading and Location are
+// not part of the message.
+size_t nt_TimeMarshalProto(nt_Time t, uint8_t buf[nt_PROTO_TIMESTAMP_MAXLEN])
+{
+	return nt_putProtoSecNanos(buf, nt_Time_unixSec(&t), nt_Time_nsec(&t));
+}
+
+// UnmarshalProto decodes the body of a google.protobuf.Timestamp message.
+// Values outside the range the message type defines are rejected.
+char *nt_TimeUnmarshalProto(nt_Time *t, const uint8_t *data, size_t len)
+{
+	struct nt_protoSecNanos sn = nt_protoSecNanos(data, len);
+	if (sn.err != NULL) {
+		return sn.err;
+	}
+	if (sn.seconds < nt_protoMinTimestamp || sn.seconds > nt_protoMaxTimestamp) {
+		return "proto: Timestamp seconds out of range";
+	}
+	if (sn.nanos < 0 || sn.nanos >= 1e9) {
+		return "proto: Timestamp nanos out of range";
+	}
+	*t = (nt_Time){sn.nanos, sn.seconds + nt_unixToInternal, NULL};
+	return NULL;
+}
+
+// MarshalProto writes d as the body of a google.protobuf.Duration message
+// and returns its length. Seconds and nanos carry the same sign, as the
+// message type requires.
+size_t nt_DurationMarshalProto(nt_Duration d, uint8_t buf[nt_PROTO_DURATION_MAXLEN])
+{
+	return nt_putProtoSecNanos(buf, d / nt_SECOND, d % nt_SECOND);
+}
+
+// UnmarshalProto decodes the body of a google.protobuf.Duration message.
+// Durations that do not fit in a Duration (about 292 years) are rejected.
+char *nt_DurationUnmarshalProto(nt_Duration *d, const uint8_t *data, size_t len)
+{
+	struct nt_protoSecNanos sn = nt_protoSecNanos(data, len);
+	if (sn.err != NULL) {
+		return sn.err;
+	}
+	if (sn.seconds < -nt_protoMaxDuration || sn.seconds > nt_protoMaxDuration ||
+		sn.nanos <= -1e9 || sn.nanos >= 1e9 ||
+		(sn.seconds < 0 && sn.nanos > 0) || (sn.seconds > 0 && sn.nanos < 0)) {
+		return "proto: invalid Duration";
+	}
+	if (sn.seconds > maxDuration/nt_SECOND || sn.seconds < minDuration/nt_SECOND) {
+		return "proto: Duration out of range";
+	}
+	nt_Duration r = (uint64_t)sn.seconds*nt_SECOND + sn.nanos;
+	if ((sn.seconds > 0 && r < 0) || (sn.seconds < 0 && r > 0)) {
+		return "proto: Duration out of range";
+	}
+	*d = r;
+	return NULL;
+}
+
+// MarshalProtoBatch writes ts as the repeated Timestamp field number field:
+// a tag, a length and a message body for each element. buf must hold
+// n*nt_PROTO_TIMESTAMP_FIELD_MAXLEN bytes. It returns the bytes written.
+size_t nt_TimeMarshalProtoBatch(const nt_Time *ts, size_t n, uint32_t field, uint8_t *buf)
+{
+	uint8_t tag[5];
+	size_t tagLen = nt_putUvarint(tag, (uint64_t)field<<3 | 2);
+	size_t w = 0;
+	for (size_t i = 0; i < n; i++) {
+		memcpy(&buf[w], tag, tagLen);
+		w += tagLen;
+		// The body is at most 17 bytes, so its length is a single byte.
+		size_t body = nt_TimeMarshalProto(ts[i], &buf[w+1]);
+		buf[w] = body;
+		w += 1 + body;
+	}
+	return w;
+}
+
+// UnmarshalProtoBatch scans the message body in data for occurrences of the
+// repeated Timestamp field number field and decodes up to cap of them
+// into ts. Other fields are skipped.
+struct nt_TimeUnmarshalProtoBatch nt_TimeUnmarshalProtoBatch(const uint8_t *data, size_t len, uint32_t field, nt_Time *ts, size_t cap)
+{
+	struct nt_TimeUnmarshalProtoBatch ret = {0};
+	uint64_t want = (uint64_t)field<<3 | 2;
+	while (len > 0) {
+		uint64_t tag;
+		size_t n = nt_uvarint(data, len, &tag);
+		if (n == 0) {
+			ret.err = "proto: malformed tag";
+			return ret;
 		}
-		uint64_t d0 = 0;
-		while(1) {
-			ret.qmod2 = 0;
-			if (u1 > d1 || (u1 == d1 && u0 >= d0)) {
-				// subtract
-				ret.qmod2 = 1;
-                u0x = u0;
-                u0 = u0-d0;
-				if (u0 > u0x) {
-					u1--;
-				}
-				u1 -= d1;
+		data += n;
+		len -= n;
+		n = nt_protoSkip(data, len, tag & 7);
+		if (n == 0) {
+			ret.err = "proto: malformed field";
+			return ret;
+		}
+		if (tag == want) {
+			if (ret.n == cap) {
+				ret.err = "proto: too many Timestamps for buffer";
+				return ret;
 			}
-			if (d1 == 0 && d0 == d) {
-				break;
+			uint64_t body = 0;
+			size_t hdr = nt_uvarint(data, len, &body);
+			ret.err = nt_TimeUnmarshalProto(&ts[ret.n], data + hdr, body);
+			if (ret.err != NULL) {
+				return ret;
 			}
-			d0 >>= 1;
-			d0 |= (d1 & 1) << 63;
-			d1 >>= 1;
+			ret.n++;
 		}
-		ret.r = u0;
+		data += n;
+		len -= n;
 	}
+	return ret;
+}
 
-	if (neg && ret.r != 0) {
-		// If input was negative and not an exact multiple of d, we computed q, r such that
-		//	q*d + r = -t
-		// But the right answers are given by -(q-1), d-r:
-		//	q*d + r = -t
-		//	-q*d - r = t
-		//	-(q-1)*d + (d - r) = t
-		ret.qmod2 ^= 1;
-		ret.r = d - ret.r;
+// MarshalMsgpack writes t as a MessagePack timestamp extension (type -1)
+// using the smallest of the 32, 64 and 96-bit forms that holds it.
+// It returns the number of bytes written.
+size_t nt_TimeMarshalMsgpack(nt_Time t, uint8_t buf[nt_MSGPACK_TIME_MAXLEN])
+{
+	int64_t sec = nt_Time_unixSec(&t);
+	uint32_t nsec = nt_Time_nsec(&t);
+	if ((sec >> 34) == 0) {
+		uint64_t data64 = (uint64_t)nsec<<34 | sec;
+		if ((data64 & 0xffffffff00000000) == 0) {
+			// timestamp 32: fixext 4
+			buf[0] = 0xd6;
+			buf[1] = 0xff;
+			nt_be32put(&buf[2], data64);
+			return 6;
+		}
+		// timestamp 64: fixext 8
+		buf[0] = 0xd7;
+		buf[1] = 0xff;
+		nt_be64put(&buf[2], data64);
+		return 10;
 	}
-	return ret;
+	// timestamp 96: ext 8
+	buf[0] = 0xc7;
+	buf[1] = 12;
+	buf[2] = 0xff;
+	nt_be32put(&buf[3], nsec);
+	nt_be64put(&buf[7], sec);
+	return 15;
 }
 
-// end time.go
+// UnmarshalMsgpack decodes a MessagePack timestamp extension from the start
+// of data.
+struct nt_TimeUnmarshalMsgpack nt_TimeUnmarshalMsgpack(nt_Time *t, const uint8_t *data, size_t len)
+{
+	int64_t sec;
+	uint32_t nsec;
+	size_t n;
+	if (len >= 6 && data[0] == 0xd6 && data[1] == 0xff) {
+		sec = nt_be32(&data[2]);
+		nsec = 0;
+		n = 6;
+	} else if (len >= 10 && data[0] == 0xd7 && data[1] == 0xff) {
+		uint64_t data64 = nt_be64(&data[2]);
+		sec = data64 & 0x00000003ffffffff;
+		nsec = data64 >> 34;
+		n = 10;
+	} else if (len >= 15 && data[0] == 0xc7 && data[1] == 12 && data[2] == 0xff) {
+		nsec = nt_be32(&data[3]);
+		sec = nt_be64(&data[7]);
+		n = 15;
+	} else {
+		return (struct nt_TimeUnmarshalMsgpack){0, "msgpack: not a timestamp extension"};
+	}
+	if (nsec >= 1e9) {
+		return (struct nt_TimeUnmarshalMsgpack){0, "msgpack: timestamp nanoseconds out of range"};
+	}
+	if (sec > nt_omega - nt_unixToInternal) {
+		return (struct nt_TimeUnmarshalMsgpack){0, "msgpack: timestamp seconds out of range"};
+	}
+	*t = (nt_Time){nsec, sec + nt_unixToInternal, NULL};
+	return (struct nt_TimeUnmarshalMsgpack){n, NULL};
+}
 
-/*** zoneinfo.go Implementation ***/
+// MarshalMsgpackBatch writes ts as consecutive MessagePack timestamps,
+// for example as the elements of an array whose header the caller has
+// already written. buf must hold n*nt_MSGPACK_TIME_MAXLEN bytes.
+size_t nt_TimeMarshalMsgpackBatch(const nt_Time *ts, size_t n, uint8_t *buf)
+{
+	size_t w = 0;
+	for (size_t i = 0; i < n; i++) {
+		w += nt_TimeMarshalMsgpack(ts[i], &buf[w]);
+	}
+	return w;
+}
 
-nt_Location *nt_Location_get(nt_Location *l)
+// UnmarshalMsgpackBatch decodes n consecutive MessagePack timestamps.
+// The returned n is the number of bytes consumed.
+struct nt_TimeUnmarshalMsgpack nt_TimeUnmarshalMsgpackBatch(nt_Time *ts, size_t n, const uint8_t *data, size_t len)
 {
-	if (l == NULL) {
-		return &nt_utcLoc;
+	size_t r = 0;
+	for (size_t i = 0; i < n; i++) {
+		struct nt_TimeUnmarshalMsgpack m = nt_TimeUnmarshalMsgpack(&ts[i], data + r, len - r);
+		if (m.err != NULL) {
+			return (struct nt_TimeUnmarshalMsgpack){r, m.err};
+		}
+		r += m.n;
 	}
-	if (l == &nt_localLoc) {
-		/* localOnce.Do(initLocal) */
+	return (struct nt_TimeUnmarshalMsgpack){r, NULL};
+}
+
+// cborHead writes a CBOR initial byte and argument for the given major
+// type using the shortest form, and returns the number of bytes written.
+static inline size_t nt_cborHead(uint8_t *buf, uint8_t major, uint64_t v)
+{
+	major <<= 5;
+	if (v < 24) {
+		buf[0] = major | v;
+		return 1;
+	} else if (v <= 0xff) {
+		buf[0] = major | 24;
+		buf[1] = v;
+		return 2;
+	} else if (v <= 0xffff) {
+		buf[0] = major | 25;
+		nt_be16put(&buf[1], v);
+		return 3;
+	} else if (v <= 0xffffffff) {
+		buf[0] = major | 26;
+		nt_be32put(&buf[1], v);
+		return 5;
 	}
-	return l;
+	buf[0] = major | 27;
+	nt_be64put(&buf[1], v);
+	return 9;
 }
 
-// String returns a descriptive name for the time zone information,
-// corresponding to the name argument to LoadLocation or FixedZone.
-char *nt_LocationString(nt_Location *l) 
+// MarshalCBOR writes t as a CBOR epoch-based date/time (tag 1).
+// Whole seconds are written as an integer; times with a fractional second
+// are written as a float64, which keeps microsecond precision for
+// present-day dates. It returns the number of bytes written.
+size_t nt_TimeMarshalCBOR(nt_Time t, uint8_t buf[nt_CBOR_TIME_MAXLEN])
 {
-	return nt_Location_get(l)->name;
+	int64_t sec = nt_Time_unixSec(&t);
+	int32_t nsec = nt_Time_nsec(&t);
+	buf[0] = 0xc1; // tag 1
+	if (nsec == 0) {
+		if (sec >= 0) {
+			return 1 + nt_cborHead(&buf[1], 0, sec);
+		}
+		return 1 + nt_cborHead(&buf[1], 1, -1 - sec);
+	}
+	double f = (double)sec + (double)nsec/1e9;
+	uint64_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	buf[1] = 0xfb;
+	nt_be64put(&buf[2], bits);
+	return 10;
 }
 
-// lookup returns information about the time zone in use at an
-// instant in time expressed as seconds since January 1, 1970 00:00:00 UTC.
+// UnmarshalCBOR decodes a CBOR tag 1 date/time from the start of data.
+// The content may be an integer or a half, single or double precision
+// float; fractional seconds are rounded to the nearest nanosecond.
+struct nt_TimeUnmarshalCBOR nt_TimeUnmarshalCBOR(nt_Time *t, const uint8_t *data, size_t len)
+{
+	if (len < 2 || data[0] != 0xc1) {
+		return (struct nt_TimeUnmarshalCBOR){0, "cbor: not a tag 1 date/time"};
+	}
+	uint8_t major = data[1] >> 5;
+	uint8_t info = data[1] & 0x1f;
+	size_t n;
+	uint64_t arg;
+	switch (info) {
+	case 24: n = 1; break;
+	case 25: n = 2; break;
+	case 26: n = 4; break;
+	case 27: n = 8; break;
+	default:
+		if (info >= 24) {
+			return (struct nt_TimeUnmarshalCBOR){0, "cbor: invalid date/time content"};
+		}
+		n = 0;
+	}
+	if (len < 2 + n) {
+		return (struct nt_TimeUnmarshalCBOR){0, "cbor: truncated date/time"};
+	}
+	const uint8_t *p = &data[2];
+	switch (n) {
+	case 0: arg = info; break;
+	case 1: arg = p[0]; break;
+	case 2: arg = nt_be16(p); break;
+	case 4: arg = nt_be32(p); break;
+	default: arg = nt_be64(p); break;
+	}
+
+	int64_t sec;
+	int64_t nsec = 0;
+	if (major == 0 || major == 1) {
+		if (arg > (uint64_t)nt_omega - nt_unixToInternal) {
+			return (struct nt_TimeUnmarshalCBOR){0, "cbor: date/time out of range"};
+		}
+		sec = major == 0 ? (int64_t)arg : -1 - (int64_t)arg;
+	} else if (major == 7 && n >= 2) {
+		double f;
+		if (n == 2) {
+			// IEEE 754 half precision, per RFC 8949 Appendix D.
+			int exp = (arg >> 10) & 0x1f;
+			int mant = arg & 0x3ff;
+			if (exp == 0) {
+				f = mant / 16777216.0; // mant * 2^-24
+			} else if (exp != 31) {
+				f = (double)(mant + 1024) * (1 << exp) / 33554432.0; // * 2^(exp-25)
+			} else {
+				f = mant == 0 ? INFINITY : NAN;
+			}
+			if (arg & 0x8000) {
+				f = -f;
+			}
+		} else if (n == 4) {
+			uint32_t bits = arg;
+			float f32;
+			memcpy(&f32, &bits, sizeof(f32));
+			f = f32;
+		} else {
+			memcpy(&f, &arg, sizeof(f));
+		}
+		if (!(f > -9.2e18 && f < 9.2e18)) {
+			return (struct nt_TimeUnmarshalCBOR){0, "cbor: date/time out of range"};
+		}
+		sec = f;
+		if (sec > f) {
+			sec--; // round toward negative infinity
+		}
+		nsec = (f - sec) * 1e9 + 0.5;
+		if (nsec >= 1e9) {
+			sec++;
+			nsec -= 1e9;
+		}
+	} else {
+		return (struct nt_TimeUnmarshalCBOR){0, "cbor: invalid date/time content"};
+	}
+	*t = (nt_Time){nsec, sec + nt_unixToInternal, NULL};
+	return (struct nt_TimeUnmarshalCBOR){2 + n, NULL};
+}
+
+// MarshalCBORBatch writes ts as consecutive tagged CBOR date/times, for
+// example as the items of an array. buf must hold n*nt_CBOR_TIME_MAXLEN
+// bytes.
+size_t nt_TimeMarshalCBORBatch(const nt_Time *ts, size_t n, uint8_t *buf)
+{
+	size_t w = 0;
+	for (size_t i = 0; i < n; i++) {
+		w += nt_TimeMarshalCBOR(ts[i], &buf[w]);
+	}
+	return w;
+}
+
+// UnmarshalCBORBatch decodes n consecutive tagged CBOR date/times.
+// The returned n is the number of bytes consumed.
+struct nt_TimeUnmarshalCBOR nt_TimeUnmarshalCBORBatch(nt_Time *ts, size_t n, const uint8_t *data, size_t len)
+{
+	size_t r = 0;
+	for (size_t i = 0; i < n; i++) {
+		struct nt_TimeUnmarshalCBOR c = nt_TimeUnmarshalCBOR(&ts[i], data + r, len - r);
+		if (c.err != NULL) {
+			return (struct nt_TimeUnmarshalCBOR){r, c.err};
+		}
+		r += c.n;
+	}
+	return (struct nt_TimeUnmarshalCBOR){r, NULL};
+}
+
+// Key encodings.
 //
-// The returned information gives the name of the zone (such as "CET"),
-// the start and end times bracketing sec when that zone is in effect,
-// the offset in seconds east of UTC (such as -5*60*60), and whether
-// the daylight savings is being observed at that time.
-struct nt_Location_lookup nt_Location_lookup(nt_Location *l, int64_t sec) {
-	l = nt_Location_get(l);
+// EncodeKey produces byte strings whose memcmp order is the time order,
+// for use as key prefixes in sorted stores. The 96-bit form holds any
+// Time: the Unix seconds as a big-endian int64 with the sign bit flipped,
+// followed by the big-endian nanoseconds. The 64-bit form holds the Unix
+// nanoseconds the same way and covers the years 1678 to 2262.
+// The Desc variants complement every byte, so ascending byte order is
+// newest first. Location and monotonic clock reading are not encoded;
+// keys always decode as UTC.
+
+static const uint64_t nt_keySignBit = (uint64_t)1 << 63;
+
+static inline void nt_putKey(uint8_t *buf, int64_t sec, uint32_t nsec, uint64_t mask)
+{
+	nt_be64put(&buf[0], ((uint64_t)sec ^ nt_keySignBit) ^ mask);
+	nt_be32put(&buf[8], nsec ^ (uint32_t)mask);
+}
 
-    struct nt_Location_lookup ret = {0};
+static inline bool nt_getKey(nt_Time *t, const uint8_t *buf, uint64_t mask)
+{
+	int64_t sec = (nt_be64(&buf[0]) ^ mask) ^ nt_keySignBit;
+	uint32_t nsec = nt_be32(&buf[8]) ^ (uint32_t)mask;
+	if (nsec >= 1e9 || sec > nt_omega - nt_unixToInternal) {
+		return false;
+	}
+	*t = (nt_Time){nsec, sec + nt_unixToInternal, NULL};
+	return true;
+}
 
-	if (l->zoneLen == 0) {
-		ret.name = "UTC";
-		ret.offset = 0;
-		ret.start = nt_alpha;
-		ret.end = nt_omega;
-		ret.isDST = false;
-		return ret;
+// EncodeKey writes the 12-byte ascending key for t.
+void nt_TimeEncodeKey(nt_Time t, uint8_t buf[nt_TIME_KEY_LEN])
+{
+	nt_putKey(buf, nt_Time_unixSec(&t), nt_Time_nsec(&t), 0);
+}
+
+// DecodeKey decodes a key written by EncodeKey.
+// It reports false if buf is not a valid key.
+bool nt_TimeDecodeKey(nt_Time *t, const uint8_t buf[nt_TIME_KEY_LEN])
+{
+	return nt_getKey(t, buf, 0);
+}
+
+// EncodeKeyDesc writes the 12-byte descending (newest first) key for t.
+void nt_TimeEncodeKeyDesc(nt_Time t, uint8_t buf[nt_TIME_KEY_LEN])
+{
+	nt_putKey(buf, nt_Time_unixSec(&t), nt_Time_nsec(&t), ~(uint64_t)0);
+}
+
+// DecodeKeyDesc decodes a key written by EncodeKeyDesc.
+bool nt_TimeDecodeKeyDesc(nt_Time *t, const uint8_t buf[nt_TIME_KEY_LEN])
+{
+	return nt_getKey(t, buf, ~(uint64_t)0);
+}
+
+// EncodeKey64 writes the 8-byte key for t, descending if desc is set.
+// The result is undefined if t is outside the UnixNano range.
+void nt_TimeEncodeKey64(nt_Time t, bool desc, uint8_t buf[nt_TIME_KEY64_LEN])
+{
+	uint64_t mask = -(uint64_t)desc;
+	nt_be64put(buf, ((uint64_t)nt_TimeUnixNano(t) ^ nt_keySignBit) ^ mask);
+}
+
+// DecodeKey64 decodes a key written by EncodeKey64 with the same desc.
+nt_Time nt_TimeDecodeKey64(const uint8_t buf[nt_TIME_KEY64_LEN], bool desc)
+{
+	uint64_t mask = -(uint64_t)desc;
+	int64_t nsec = (nt_be64(buf) ^ mask) ^ nt_keySignBit;
+	nt_Time t = nt_Unix(0, nsec);
+	t.loc = NULL;
+	return t;
+}
+
+// EncodeKeyBatch writes n consecutive 12-byte keys into buf, which must
+// hold n*nt_TIME_KEY_LEN bytes. The direction is applied as a mask and
+// the seconds are extracted without branching, so the loop is a
+// straight run of loads, xors and byte swaps the compiler can vectorize.
+void nt_TimeEncodeKeyBatch(const nt_Time *ts, size_t n, bool desc, uint8_t *buf, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_timeChunk c = {.kind = nt_chunkEncodeKey, .ts = (nt_Time *)ts, .buf = buf, .desc = desc};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_Time) + nt_TIME_KEY_LEN), nt_timeChunk, &c);
+		return;
 	}
-    nt_zone *zone = l->cacheZone; 
-	if (zone != NULL && l->cacheStart <= sec && sec < l->cacheEnd) {
-		ret.name = zone->name;
-		ret.offset = zone->offset;
-		ret.start = l->cacheStart;
-		ret.end = l->cacheEnd;
-		ret.isDST = zone->isDST;
-		return ret;
+	uint64_t mask = -(uint64_t)desc;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t wall = ts[i].wall;
+		uint64_t mono = -(wall >> 63);
+		int64_t packed = nt_wallToInternal + (int64_t)(wall<<1>>(nt_nsecShift+1));
+		int64_t sec = (packed & mono) | (ts[i].ext & ~mono);
+		nt_putKey(&buf[i*nt_TIME_KEY_LEN], sec + nt_internalToUnix, wall & nt_nsecMask, mask);
 	}
+}
 
-	if (l->txLen == 0 || sec < l->tx[0].when) {
-		/* nt_zone *zone = &l.zone[l.lookupFirstZone()]; */
-		ret.name = zone->name;
-		ret.offset = zone->offset;
-		ret.start = nt_alpha;
-		if (l->txLen > 0) {
-			ret.end = l->tx[0].when;
-		} else {
-			ret.end = nt_omega;
+// EncodeKey64Batch writes n consecutive 8-byte keys into buf, which must
+// hold n*nt_TIME_KEY64_LEN bytes.
+void nt_TimeEncodeKey64Batch(const nt_Time *ts, size_t n, bool desc, uint8_t *buf, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_timeChunk c = {.kind = nt_chunkEncodeKey64, .ts = (nt_Time *)ts, .buf = buf, .desc = desc};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_Time) + nt_TIME_KEY64_LEN), nt_timeChunk, &c);
+		return;
+	}
+	uint64_t mask = -(uint64_t)desc;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t wall = ts[i].wall;
+		uint64_t mono = -(wall >> 63);
+		int64_t packed = nt_wallToInternal + (int64_t)(wall<<1>>(nt_nsecShift+1));
+		int64_t sec = (packed & mono) | (ts[i].ext & ~mono);
+		uint64_t nsec = (uint64_t)(sec + nt_internalToUnix)*1000000000 + (wall & nt_nsecMask);
+		nt_be64put(&buf[i*nt_TIME_KEY64_LEN], (nsec ^ nt_keySignBit) ^ mask);
+	}
+}
+
+// Unix returns the local Time corresponding to the given Unix time,
+// sec seconds and nsec nanoseconds since January 1, 1970 UTC.
+// It is valid to pass nsec outside the range [0, 999999999].
+// Not all sec values have a corresponding time value. One such
+// value is 1<<63-1 (the largest int64 value).
+nt_Time nt_Unix(int64_t sec, int64_t nsec)
+{
+	if (nsec < 0 || nsec >= 1e9) {
+		int64_t n = nsec / 1e9;
+		sec += n;
+		nsec -= n * 1e9;
+		if (nsec < 0) {
+			nsec += 1e9;
+			sec--;
 		}
-		ret.isDST = zone->isDST;
-		return ret;
 	}
+	return nt_unixTime(sec, nsec);
+}
 
-	// Binary search for entry with largest time <= sec.
-	// Not using sort.Search to avoid dependencies.
-	nt_zoneTrans *tx = l->tx;
-    size_t txLen = l->txLen;
-	ret.end = nt_omega;
-	size_t lo = 0;
-	size_t hi = txLen;
-	while (hi-lo > 1) {
-		int m = (lo+hi) >> 1;
-		int64_t lim = tx[m].when;
-		if (sec < lim) {
-			ret.end = lim;
-			hi = m;
-		} else {
-			lo = m;
+// UnixMilli returns t as a Unix time, the number of milliseconds elapsed since
+// January 1, 1970 UTC. The result is undefined if the Unix time in
+// milliseconds cannot be represented by an int64 (a date more than 292 million
+// years before or after 1970). The result does not depend on the
+// location associated with t.
+int64_t nt_TimeUnixMilli(nt_Time t)
+{
+	return nt_Time_unixSec(&t)*1e3 + nt_Time_nsec(&t)/1e6;
+}
+
+// UnixMicro returns t as a Unix time, the number of microseconds elapsed since
+// January 1, 1970 UTC. The result is undefined if the Unix time in
+// microseconds cannot be represented by an int64 (a date before year -290307 or
+// after year 294246). The result does not depend on the location associated
+// with t.
+int64_t nt_TimeUnixMicro(nt_Time t)
+{
+	return nt_Time_unixSec(&t)*1e6 + nt_Time_nsec(&t)/1e3;
+}
+
+// IsDST reports whether the time in the configured location is in Daylight Savings Time.
+bool nt_TimeIsDST(nt_Time t)
+{
+    struct nt_Location_lookup lookup = nt_Location_lookup(t.loc, nt_TimeUnix(t));
+	return lookup.isDST;
+}
+
+bool nt_isLeap(int year)
+{
+	return year%4 == 0 && (year%100 != 0 || year%400 == 0);
+}
+
+struct nt_norm {
+    int nhi, nlo;
+};
+// norm returns nhi, nlo such that
+//
+//	hi * base + lo == nhi * base + nlo
+//	0 <= nlo < base
+struct nt_norm nt_norm(int hi, int lo, int base) 
+{
+	if (lo < 0) {
+		int n = (-lo-1)/base + 1;
+		hi -= n;
+		lo += n * base;
+	}
+	if (lo >= base) {
+		int n = lo / base;
+		hi += n;
+		lo -= n * base;
+	}
+	return (struct nt_norm){.nhi = hi, .nlo = lo};
+}
+
+// Date returns the Time corresponding to
+//
+//	yyyy-mm-dd hh:mm:ss + nsec nanoseconds
+//
+// in the appropriate zone for that time in the given location.
+//
+// The month, day, hour, min, sec, and nsec values may be outside
+// their usual ranges and will be normalized during the conversion.
+// For example, October 32 converts to November 1.
+//
+// A daylight savings time transition skips or repeats times.
+// For example, in the United States, March 13, 2011 2:15am never occurred,
+// while November 6, 2011 1:15am occurred twice. In such cases, the
+// choice of time zone, and therefore the time, is not well-defined.
+// Date returns a time that is correct in one of the two zones involved
+// in the transition, but it does not guarantee which.
+//
+// Date panics if loc is nil.
+nt_Time nt_Date(int year, nt_Month month, int day, int hour, int min, int sec, int nsec, nt_Location *loc)
+{
+	if (loc == NULL) {
+        nt_panic("time: missing Location in call to Date\n");
+	}
+
+	// Normalize month, overflowing into year.
+	int m = month - 1;
+    struct nt_norm norm;
+	norm = nt_norm(year, m, 12);
+    year = norm.nhi;
+    m = norm.nlo;
+	month = m + 1;
+
+	// Normalize nsec, sec, min, hour, overflowing into day.
+	norm = nt_norm(sec, nsec, 1e9);
+    sec = norm.nhi;
+    nsec = norm.nlo;
+	norm = nt_norm(min, sec, 60);
+    min = norm.nhi;
+    sec = norm.nlo;
+	norm = nt_norm(hour, min, 60);
+    hour = norm.nhi;
+    min = norm.nlo;
+	norm = nt_norm(day, hour, 24);
+    day = norm.nhi;
+    hour = norm.nlo;
+
+	// Compute days since the absolute epoch.
+	uint64_t d = nt_daysSinceEpoch(year);
+
+	// Add in days before this month.
+	d += nt_daysBefore[month-1];
+	if (nt_isLeap(year) && month >= nt_MARCH) {
+		d++; // February 29
+	}
+
+	// Add in days before today.
+	d += day - 1;
+
+	// Add in time elapsed today.
+	uint64_t abs = d * nt_secondsPerDay;
+    abs += hour*nt_secondsPerHour + min*nt_secondsPerMinute + sec;
+
+	int64_t unix = abs + (nt_absoluteToInternal + nt_internalToUnix);
+
+	// Look for zone offset for expected time, so we can adjust to UTC.
+	// The lookup function expects UTC, so first we pass unix in the
+	// hope that it will not be too close to a zone transition,
+	// and then adjust if it is.
+	struct nt_Location_lookup lookup = nt_Location_lookup(loc, unix);
+    int offset = lookup.offset;
+    int64_t start = lookup.start;
+    int64_t end = lookup.end;
+	if (offset != 0) {
+		int64_t utc = unix - offset;
+		// If utc is valid for the time zone we found, then we have the right offset.
+		// If not, we get the correct offset by looking up utc in the location.
+		if (utc < start || utc >= end) {
+            offset = nt_Location_lookup(loc, utc).offset;
+		}
+		unix -= offset;
+	}
+
+	nt_Time t = nt_unixTime(unix, nsec);
+    nt_Time_setLoc(&t, loc);
+	return t;
+}
+
+// Truncate returns the result of rounding t down to a multiple of d (since the zero time).
+// If d <= 0, Truncate returns t stripped of any monotonic clock reading but otherwise unchanged.
+//
+// Truncate operates on the time as an absolute duration since the
+// zero time; it does not operate on the presentation form of the
+// time. Thus, Truncate(Hour) may return a time with a non-zero
+// minute, depending on the time's Location.
+nt_Time nt_TimeTruncate(nt_Time t, nt_Duration d)
+{
+	nt_Time_stripMono(&t);
+	if (d <= 0) {
+		return t;
+	}
+    struct nt_div div = nt_div(t, d);
+    nt_Duration r = div.r;
+	return nt_TimeAdd(t, -r);
+}
+
+// Round returns the result of rounding t to the nearest multiple of d (since the zero time).
+// The rounding behavior for halfway values is to round up.
+// If d <= 0, Round returns t stripped of any monotonic clock reading but otherwise unchanged.
+//
+// Round operates on the time as an absolute duration since the
+// zero time; it does not operate on the presentation form of the
+// time. Thus, Round(Hour) may return a time with a non-zero
+// minute, depending on the time's Location.
+nt_Time nt_TimeRound(nt_Time t, nt_Duration d)
+{
+	nt_Time_stripMono(&t);
+	if (d <= 0) {
+		return t;
+	}
+	struct nt_div div = nt_div(t, d);
+    nt_Duration r = div.r;
+	if (nt_lessThanHalf(r, d)) {
+		return nt_TimeAdd(t, -r);
+	}
+	return nt_TimeAdd(t, d - r);
+}
+
+// div divides t by d and returns the quotient parity and remainder.
+// We don't use the quotient parity anymore (round half up instead of round to even)
+// but it's still here in case we change our minds.
+struct nt_div nt_div(nt_Time t, nt_Duration d)
+{
+    struct nt_div ret = {0};
+	bool neg = false;
+	int32_t nsec = nt_Time_nsec(&t);
+	int64_t sec = nt_Time_sec(&t);
+	if (sec < 0) {
+		// Operate on absolute value.
+		neg = true;
+		sec = -sec;
+		nsec = -nsec;
+		if (nsec < 0) {
+			nsec += 1e9;
+			sec--; // sec >= 1 before the -- so safe
+		}
+	}
+
+	// Special case: 2d divides 1 second.
+	if (d < nt_SECOND && nt_SECOND%(d+d) == 0) {
+		ret.qmod2 = (nsec/d) & 1;
+		ret.r = nsec % d;
+
+	// Special case: d is a multiple of 1 second.
+    } else if (d%nt_SECOND == 0) {
+		int64_t d1 = d / nt_SECOND;
+		ret.qmod2 = (sec/d1) & 1;
+		ret.r = (sec%d1)*nt_SECOND + nsec;
+
+	// General case.
+	// This could be faster if more cleverness were applied,
+	// but it's really only here to avoid special case restrictions in the API.
+	// No one will care about these cases.
+    } else {
+		// Compute nanoseconds as 128-bit number.
+		uint64_t sec1 = (uint64_t)sec;
+		uint64_t tmp = (sec1 >> 32) * 1e9;
+		uint64_t u1 = tmp >> 32;
+		uint64_t u0 = tmp << 32;
+		tmp = (sec1 & 0xFFFFFFFF) * 1e9;
+        uint64_t u0x = u0;
+        u0 = u0+tmp;
+		if (u0 < u0x) {
+			u1++;
+		}
+        u0x = u0;
+        u0 = u0+nsec;
+		if (u0 < u0x) {
+			u1++;
+		}
+
+		// Compute remainder by subtracting r<<k for decreasing k.
+		// Quotient parity is whether we subtract on last round.
+		uint64_t d1 = d;
+		while ((d1>>63) != 1) {
+			d1 <<= 1;
+		}
+		uint64_t d0 = 0;
+		while(1) {
+			ret.qmod2 = 0;
+			if (u1 > d1 || (u1 == d1 && u0 >= d0)) {
+				// subtract
+				ret.qmod2 = 1;
+                u0x = u0;
+                u0 = u0-d0;
+				if (u0 > u0x) {
+					u1--;
+				}
+				u1 -= d1;
+			}
+			if (d1 == 0 && d0 == d) {
+				break;
+			}
+			d0 >>= 1;
+			d0 |= (d1 & 1) << 63;
+			d1 >>= 1;
+		}
+		ret.r = u0;
+	}
+
+	if (neg && ret.r != 0) {
+		// If input was negative and not an exact multiple of d, we computed q, r such that
+		//	q*d + r = -t
+		// But the right answers are given by -(q-1), d-r:
+		//	q*d + r = -t
+		//	-q*d - r = t
+		//	-(q-1)*d + (d - r) = t
+		ret.qmod2 ^= 1;
+		ret.r = d - ret.r;
+	}
+	return ret;
+}
+
+// end time.go
+
+/*** zoneinfo.go Implementation ***/
+
+nt_Location *nt_Location_get(nt_Location *l)
+{
+	if (l == NULL) {
+		return &nt_utcLoc;
+	}
+	if (l == &nt_localLoc) {
+		static pthread_once_t localOnce = PTHREAD_ONCE_INIT;
+		pthread_once(&localOnce, nt_initLocal);
+	}
+	return l;
+}
+
+// Most calls to FixedZone have an unnamed zone with an offset by the hour.
+// Optimize for that case by returning the same *Location for a given hour.
+enum { nt_hoursBeforeUTC = 12, nt_hoursAfterUTC = 14 };
+static nt_Location nt_unnamedFixedZones[nt_hoursBeforeUTC+1+nt_hoursAfterUTC];
+static nt_zone nt_unnamedFixedZonesZone[nt_hoursBeforeUTC+1+nt_hoursAfterUTC];
+static nt_zoneTrans nt_unnamedFixedZonesTx = {nt_alpha, 0, false, false};
+
+static void nt_initUnnamedFixedZones(void)
+{
+	for (int hr = -nt_hoursBeforeUTC; hr <= +nt_hoursAfterUTC; hr++) {
+		nt_Location *l = &nt_unnamedFixedZones[hr+nt_hoursBeforeUTC];
+		nt_zone *z = &nt_unnamedFixedZonesZone[hr+nt_hoursBeforeUTC];
+		*z = (nt_zone){"", hr*60*60, false};
+		*l = (nt_Location){
+			.name = "",
+			.zone = z,
+			.zoneLen = 1,
+			.tx = &nt_unnamedFixedZonesTx,
+			.txLen = 1,
+			.cacheStart = nt_alpha,
+			.cacheEnd = nt_omega,
+			.cacheZone = z,
+		};
+	}
+}
+
+// FixedZone returns a Location that always uses
+// the given zone name and offset (seconds east of UTC).
+//
+// Only the first seven bytes of name are kept, to match the zone
+// abbreviation storage. Unnamed zones with a whole-hour offset are
+// served from a static table; other zones are heap allocated. Either
+// may be passed to LocationFree, which leaves the static ones alone.
+nt_Location *nt_FixedZone(char *name, int offset)
+{
+	int hour = offset / 60 / 60;
+	if (nt_EMPTY_STR(name) && -nt_hoursBeforeUTC <= hour && hour <= +nt_hoursAfterUTC && hour*60*60 == offset) {
+		static pthread_once_t once = PTHREAD_ONCE_INIT;
+		pthread_once(&once, nt_initUnnamedFixedZones);
+		return &nt_unnamedFixedZones[hour+nt_hoursBeforeUTC];
+	}
+	return nt_fixedZone(name, offset);
+}
+
+// The shared unnamed FixedZones for other offsets, which decoders hand
+// out without the caller owning them: an open-addressed table from
+// offset to Location, filled on first use and kept for the life of the
+// process, so each distinct offset costs one allocation.
+static struct {
+	pthread_mutex_t mu;
+	size_t len, cap;
+	nt_Location **loc;
+} nt_sharedFixedZones = {.mu = PTHREAD_MUTEX_INITIALIZER};
+
+static size_t nt_sharedFixedZoneSlot(nt_Location **tab, size_t cap, int offset)
+{
+	size_t i = ((uint32_t)offset * 0x9E3779B9u) & (cap - 1);
+	while (tab[i] != NULL && tab[i]->zone[0].offset != offset) {
+		i = (i + 1) & (cap - 1);
+	}
+	return i;
+}
+
+// sharedFixedZone returns the unnamed FixedZone for offset. It is never
+// freed; LocationFree ignores it.
+static nt_Location *nt_sharedFixedZone(int offset)
+{
+	int hour = offset / 60 / 60;
+	if (-nt_hoursBeforeUTC <= hour && hour <= +nt_hoursAfterUTC && hour*60*60 == offset) {
+		return nt_FixedZone("", offset);
+	}
+	pthread_mutex_lock(&nt_sharedFixedZones.mu);
+	nt_Location *l = NULL;
+	if (nt_sharedFixedZones.cap > 0) {
+		l = nt_sharedFixedZones.loc[nt_sharedFixedZoneSlot(nt_sharedFixedZones.loc, nt_sharedFixedZones.cap, offset)];
+	}
+	if (l == NULL) {
+		if (2*(nt_sharedFixedZones.len+1) > nt_sharedFixedZones.cap) {
+			size_t cap = nt_sharedFixedZones.cap ? 2*nt_sharedFixedZones.cap : 16;
+			nt_Location **tab = calloc(cap, sizeof(*tab));
+			if (tab == NULL) {
+				nt_panic("time: out of memory in call to FixedZone\n");
+			}
+			for (size_t i = 0; i < nt_sharedFixedZones.cap; i++) {
+				nt_Location *e = nt_sharedFixedZones.loc[i];
+				if (e != NULL) {
+					tab[nt_sharedFixedZoneSlot(tab, cap, e->zone[0].offset)] = e;
+				}
+			}
+			free(nt_sharedFixedZones.loc);
+			nt_sharedFixedZones.loc = tab;
+			nt_sharedFixedZones.cap = cap;
+		}
+		l = nt_fixedZone("", offset);
+		nt_sharedFixedZones.loc[nt_sharedFixedZoneSlot(nt_sharedFixedZones.loc, nt_sharedFixedZones.cap, offset)] = l;
+		nt_sharedFixedZones.len++;
+	}
+	pthread_mutex_unlock(&nt_sharedFixedZones.mu);
+	return l;
+}
+
+// sharedFixedZoneHas reports whether l is one of the shared FixedZones.
+static bool nt_sharedFixedZoneHas(nt_Location *l)
+{
+	uintptr_t p = (uintptr_t)l, fixed = (uintptr_t)nt_unnamedFixedZones;
+	if (p >= fixed && p < fixed + sizeof(nt_unnamedFixedZones)) {
+		return true;
+	}
+	if (l->zoneLen != 1 || !nt_EMPTY_STR(l->zone[0].name)) {
+		return false;
+	}
+	pthread_mutex_lock(&nt_sharedFixedZones.mu);
+	bool has = nt_sharedFixedZones.cap > 0 &&
+		nt_sharedFixedZones.loc[nt_sharedFixedZoneSlot(nt_sharedFixedZones.loc, nt_sharedFixedZones.cap, l->zone[0].offset)] == l;
+	pthread_mutex_unlock(&nt_sharedFixedZones.mu);
+	return has;
+}
+
+// newLocation allocates a Location with room for zoneLen zones and
+// txLen transitions, and copies of name and extend, as one cache line
+// aligned block: the header, then the zones, the transitions and the
+// strings. A lookup walks header, tx and zone in that order, so they
+// sit together and the whole Location goes with a single free.
+nt_Location *nt_newLocation(const char *name, size_t zoneLen, size_t txLen, const char *extend)
+{
+	enum { align = 64 };
+	size_t nameLen = strlen(name) + 1;
+	size_t extendLen = strlen(extend) + 1;
+	size_t zoneOff = sizeof(nt_Location);
+	size_t txOff = (zoneOff + zoneLen*sizeof(nt_zone) + 7) &~ (size_t)7;
+	size_t nameOff = txOff + txLen*sizeof(nt_zoneTrans);
+	size_t size = nameOff + nameLen + extendLen;
+	char *b = aligned_alloc(align, (size + align-1) &~ (size_t)(align-1));
+	if (b == NULL) {
+		return NULL;
+	}
+	nt_STAT(locationAllocs, 1);
+	memset(b, 0, size);
+	nt_Location *l = (nt_Location *)b;
+	l->zone = (nt_zone *)(b + zoneOff);
+	l->zoneLen = zoneLen;
+	l->tx = (nt_zoneTrans *)(b + txOff);
+	l->txLen = txLen;
+	l->name = memcpy(b + nameOff, name, nameLen);
+	l->extend = memcpy(b + nameOff + nameLen, extend, extendLen);
+	return l;
+}
+
+nt_Location *nt_fixedZone(char *name, int offset)
+{
+	if (name == NULL) {
+		name = "";
+	}
+	nt_Location *l = nt_newLocation("", 1, 1, "");
+	if (l == NULL) {
+		nt_panic("time: out of memory in call to FixedZone\n");
+	}
+	strncpy(l->zone[0].name, name, sizeof(l->zone[0].name) - 1);
+	l->zone[0].offset = offset;
+	l->tx[0] = (nt_zoneTrans){nt_alpha, 0, false, false};
+	l->name = l->zone[0].name;
+	l->cacheStart = nt_alpha;
+	l->cacheEnd = nt_omega;
+	l->cacheZone = &l->zone[0];
+	return l;
+}
+
+// String returns a descriptive name for the time zone information,
+// corresponding to the name argument to LoadLocation or FixedZone.
+char *nt_LocationString(nt_Location *l) 
+{
+	return nt_Location_get(l)->name;
+}
+
+// lookup returns information about the time zone in use at an
+// instant in time expressed as seconds since January 1, 1970 00:00:00 UTC.
+//
+// The returned information gives the name of the zone (such as "CET"),
+// the start and end times bracketing sec when that zone is in effect,
+// the offset in seconds east of UTC (such as -5*60*60), and whether
+// the daylight savings is being observed at that time.
+struct nt_Location_lookup nt_Location_lookup(nt_Location *l, int64_t sec) {
+	l = nt_Location_get(l);
+	nt_STAT(lookups, 1);
+	nt_PROBE2(zone_lookup, l, sec);
+
+    struct nt_Location_lookup ret = {0};
+
+	if (l->zoneLen == 0) {
+		ret.name = "UTC";
+		ret.offset = 0;
+		ret.start = nt_alpha;
+		ret.end = nt_omega;
+		ret.isDST = false;
+		return ret;
+	}
+    nt_zone *zone = l->cacheZone; 
+	if (zone != NULL && l->cacheStart <= sec && sec < l->cacheEnd) {
+		ret.name = zone->name;
+		ret.offset = zone->offset;
+		ret.start = l->cacheStart;
+		ret.end = l->cacheEnd;
+		ret.isDST = zone->isDST;
+		return ret;
+	}
+
+	if (l->txLen == 0 || sec < l->tx[0].when) {
+		zone = &l->zone[nt_Location_lookupFirstZone(l)];
+		ret.name = zone->name;
+		ret.offset = zone->offset;
+		ret.start = nt_alpha;
+		if (l->txLen > 0) {
+			ret.end = l->tx[0].when;
+		} else {
+			ret.end = nt_omega;
+		}
+		ret.isDST = zone->isDST;
+		return ret;
+	}
+
+	// Binary search for entry with largest time <= sec.
+	// Not using sort.Search to avoid dependencies.
+	nt_zoneTrans *tx = l->tx;
+    size_t txLen = l->txLen;
+	ret.end = nt_omega;
+	size_t lo = 0;
+	size_t hi = txLen;
+	while (hi-lo > 1) {
+		nt_STAT(lookupSteps, 1);
+		int m = (lo+hi) >> 1;
+		int64_t lim = tx[m].when;
+		if (sec < lim) {
+			ret.end = lim;
+			hi = m;
+		} else {
+			lo = m;
+		}
+	}
+	zone = &l->zone[tx[lo].index];
+	ret.name = zone->name;
+	ret.offset = zone->offset;
+	ret.start = tx[lo].when;
+	// end = maintained during the search
+	ret.isDST = zone->isDST;
+
+	// If we're at the end of the known zone transitions,
+	// try the extend string.
+	if (lo == txLen-1 && !nt_EMPTY_STR(l->extend)) {
+		nt_STAT(extendEvals, 1);
+		struct nt_tzset e = nt_tzset(l->extend, ret.start, sec);
+		nt_zone *ez;
+		if (e.ok && (ez = nt_findZone(l, e.name, e.nameLen, e.offset, e.isDST)) != NULL) {
+			return (struct nt_Location_lookup){ez->name, e.offset, e.start, e.end, e.isDST};
+		}
+	}
+
+	return ret;
+}
+
+// lookupFirstZone returns the index of the time zone to use for times
+// before the first transition time, or when there are no transition
+// times.
+//
+// The reference implementation in localtime.c from
+// https://www.iana.org/time-zones/repository/releases/tzcode2013g.tar.gz
+// implements the following algorithm for these cases:
+//  1. If the first zone is unused by the transitions, use it.
+//  2. Otherwise, if there are transition times, and the first
+//     transition is to a zone in daylight time, find the first
+//     non-daylight-time zone before and closest to the first transition
+//     zone.
+//  3. Otherwise, use the first zone that is not daylight time, if
+//     there is one.
+//  4. Otherwise, use the first zone.
+int nt_Location_lookupFirstZone(nt_Location *l) {
+	// Case 1.
+	if (!nt_Location_firstZoneUsed(l)) {
+		return 0;
+	}
+
+	// Case 2.
+	if (l->txLen > 0 && l->zone[l->tx[0].index].isDST) {
+		for (int zi = l->tx[0].index - 1; zi >= 0; zi--) {
+			if (!l->zone[zi].isDST) {
+				return zi;
+			}
+		}
+	}
+
+	// Case 3.
+	/* for zi := range l.zone { */
+    for (int zi = 0; zi < l->zoneLen; zi++) {
+		if (!l->zone[zi].isDST) {
+			return zi;
+		}
+	}
+
+	// Case 4.
+	return 0;
+}
+
+// firstZoneUsed reports whether the first zone is used by some
+// transition.
+bool nt_Location_firstZoneUsed(nt_Location *l)
+{
+    for (int i = 0; i < l->txLen; i++ ) {
+        nt_zoneTrans tx = l->tx[i];
+		if (tx.index == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// tzsetZones parses the standard and daylight savings zones at the start
+// of the tzset string s: the part of tzset that does not depend on time.
+// Names are returned as slices of s, since they are not NUL terminated.
+struct nt_tzsetZones nt_tzsetZones(char *s)
+{
+	struct nt_tzsetZones ret = {0};
+
+	struct nt_tzsetName name = nt_tzsetName(s);
+	bool ok = name.ok;
+	if (ok) {
+		ret.stdName = name.tzName;
+		ret.stdLen = name.tzNameLen;
+		struct nt_tzsetOffset offset = nt_tzsetOffset(name.remainder);
+		ret.stdOffset = offset.offset;
+		s = offset.rest;
+		ok = offset.ok;
+	}
+	if (!ok) {
+		return (struct nt_tzsetZones){0};
+	}
+
+	// The numbers in the tzset string are added to local time to get UTC,
+	// but our offsets are added to UTC to get local time,
+	// so we negate the number we see here.
+	ret.stdOffset = -ret.stdOffset;
+
+	if (s[0] == '\0' || s[0] == ',') {
+		// No daylight savings time.
+		ret.rest = s;
+		ret.ok = true;
+		return ret;
+	}
+
+	name = nt_tzsetName(s);
+	ok = name.ok;
+	if (ok) {
+		ret.dstName = name.tzName;
+		ret.dstLen = name.tzNameLen;
+		s = name.remainder;
+		if (s[0] == '\0' || s[0] == ',') {
+			ret.dstOffset = ret.stdOffset + nt_secondsPerHour;
+		} else {
+			struct nt_tzsetOffset offset = nt_tzsetOffset(s);
+			ret.dstOffset = -offset.offset; // as with stdOffset, above
+			s = offset.rest;
+			ok = offset.ok;
+		}
+	}
+	if (!ok) {
+		return (struct nt_tzsetZones){0};
+	}
+	ret.hasDST = true;
+	ret.rest = s;
+	ret.ok = true;
+	return ret;
+}
+
+// tzset takes a timezone string like the one found in the TZ environment
+// variable, the time of the last time zone transition expressed as seconds
+// since January 1, 1970 00:00:00 UTC, and a time expressed the same way.
+// We call this a tzset string since in C the function tzset reads TZ.
+// The return values are as for lookup, plus ok which reports whether the
+// parse succeeded. The name is a slice of s of length nameLen.
+struct nt_tzset nt_tzset(char *s, int64_t lastTxSec, int64_t sec)
+{
+	struct nt_tzsetZones z = nt_tzsetZones(s);
+	if (!z.ok) {
+		return (struct nt_tzset){0};
+	}
+	if (!z.hasDST) {
+		return (struct nt_tzset){z.stdName, z.stdLen, z.stdOffset, lastTxSec, nt_omega, false, true};
+	}
+	s = z.rest;
+
+	if (s[0] == '\0') {
+		// Default DST rules per tzcode.
+		s = ",M3.2.0,M11.1.0";
+	}
+	// The TZ definition does not mention ';' here but tzcode accepts it.
+	if (s[0] != ',' && s[0] != ';') {
+		return (struct nt_tzset){0};
+	}
+	s++;
+
+	struct nt_tzsetRule startRule = nt_tzsetRule(s);
+	s = startRule.rest;
+	if (!startRule.ok || s[0] != ',') {
+		return (struct nt_tzset){0};
+	}
+	s++;
+	struct nt_tzsetRule endRule = nt_tzsetRule(s);
+	if (!endRule.ok || endRule.rest[0] != '\0') {
+		return (struct nt_tzset){0};
+	}
+
+	struct nt_date d = nt_absDate(sec + nt_unixToInternal + nt_internalToAbsolute, false);
+	int year = d.year;
+
+	int64_t ysec = (int64_t)d.yday*nt_secondsPerDay + sec%nt_secondsPerDay;
+
+	// Compute start of year in seconds since Unix epoch.
+	int64_t abs = nt_daysSinceEpoch(year) * nt_secondsPerDay;
+	abs += nt_absoluteToInternal + nt_internalToUnix;
+
+	int64_t startSec = nt_tzruleTime(year, startRule.r, z.stdOffset);
+	int64_t endSec = nt_tzruleTime(year, endRule.r, z.dstOffset);
+	bool dstIsDST = true, stdIsDST = false;
+	// Note: this is a flipping of "DST" and "STD" while retaining the labels
+	// This happens in southern hemispheres. The labelling here thus is a little
+	// inconsistent with the goal.
+	if (endSec < startSec) {
+		int64_t t = startSec; startSec = endSec; endSec = t;
+		char *name = z.stdName; z.stdName = z.dstName; z.dstName = name;
+		size_t len = z.stdLen; z.stdLen = z.dstLen; z.dstLen = len;
+		int offset = z.stdOffset; z.stdOffset = z.dstOffset; z.dstOffset = offset;
+		stdIsDST = true; dstIsDST = false;
+	}
+
+	// The start and end values that we return are accurate
+	// close to a daylight savings transition, but are otherwise
+	// just the start and end of the year. That suffices for
+	// the only caller that cares, which is Date.
+	if (ysec < startSec) {
+		return (struct nt_tzset){z.stdName, z.stdLen, z.stdOffset, abs, startSec + abs, stdIsDST, true};
+	} else if (ysec >= endSec) {
+		return (struct nt_tzset){z.stdName, z.stdLen, z.stdOffset, endSec + abs, abs + 365*nt_secondsPerDay, stdIsDST, true};
+	} else {
+		return (struct nt_tzset){z.dstName, z.dstLen, z.dstOffset, startSec + abs, endSec + abs, dstIsDST, true};
+	}
+}
+
+// tzsetName returns the timezone name at the start of the tzset string s,
+// and the remainder of s, and reports whether the parsing is OK.
+// The name is returned as a slice of s of length tzNameLen.
+struct nt_tzsetName nt_tzsetName(char *s)
+{
+	size_t sLen = strlen(s);
+
+	if (sLen == 0) {
+		return (struct nt_tzsetName){"", 0, "", false};
+	}
+	if (s[0] != '<') {
+		for (size_t i = 0; i < sLen; i++) {
+			switch (s[i]) {
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+			case ',': case '-': case '+':
+				if (i < 3) {
+					return (struct nt_tzsetName){"", 0, "", false};
+				}
+				return (struct nt_tzsetName){s, i, s + i, true};
+			}
+		}
+		if (sLen < 3) {
+			return (struct nt_tzsetName){"", 0, "", false};
+		}
+		return (struct nt_tzsetName){s, sLen, s + sLen, true};
+	} else {
+		for (size_t i = 0; i < sLen; i++) {
+			if (s[i] == '>') {
+				return (struct nt_tzsetName){s + 1, i - 1, s + i + 1, true};
+			}
+		}
+		return (struct nt_tzsetName){"", 0, "", false};
+	}
+}
+
+// tzsetOffset returns the timezone offset at the start of the tzset string s,
+// and the remainder of s, and reports whether the parsing is OK.
+// The timezone offset is returned as a number of seconds.
+struct nt_tzsetOffset nt_tzsetOffset(char *s)
+{
+	if (s[0] == '\0') {
+		return (struct nt_tzsetOffset){0, "", false};
+	}
+	bool neg = false;
+	if (s[0] == '+') {
+		s++;
+	} else if (s[0] == '-') {
+		s++;
+		neg = true;
+	}
+
+	// The tzdata code permits values up to 24 * 7 here,
+	// although POSIX does not.
+	struct nt_tzsetNum num = nt_tzsetNum(s, 0, 24*7);
+	if (!num.ok) {
+		return (struct nt_tzsetOffset){0, "", false};
+	}
+	int off = num.num * nt_secondsPerHour;
+	s = num.rest;
+	if (s[0] != ':') {
+		return (struct nt_tzsetOffset){neg ? -off : off, s, true};
+	}
+
+	num = nt_tzsetNum(s + 1, 0, 59);
+	if (!num.ok) {
+		return (struct nt_tzsetOffset){0, "", false};
+	}
+	off += num.num * nt_secondsPerMinute;
+	s = num.rest;
+	if (s[0] != ':') {
+		return (struct nt_tzsetOffset){neg ? -off : off, s, true};
+	}
+
+	num = nt_tzsetNum(s + 1, 0, 59);
+	if (!num.ok) {
+		return (struct nt_tzsetOffset){0, "", false};
+	}
+	off += num.num;
+
+	return (struct nt_tzsetOffset){neg ? -off : off, num.rest, true};
+}
+
+// tzsetRule parses a rule from a tzset string.
+// It returns the rule, and the remainder of the string, and reports success.
+struct nt_tzsetRule nt_tzsetRule(char *s)
+{
+	nt_rule r = {0};
+	if (s[0] == '\0') {
+		return (struct nt_tzsetRule){0};
+	}
+	struct nt_tzsetNum num;
+	if (s[0] == 'J') {
+		num = nt_tzsetNum(s + 1, 1, 365);
+		if (!num.ok) {
+			return (struct nt_tzsetRule){0};
+		}
+		r.kind = nt_ruleJulian;
+		r.day = num.num;
+		s = num.rest;
+	} else if (s[0] == 'M') {
+		num = nt_tzsetNum(s + 1, 1, 12);
+		if (!num.ok || num.rest[0] != '.') {
+			return (struct nt_tzsetRule){0};
+		}
+		r.mon = num.num;
+		num = nt_tzsetNum(num.rest + 1, 1, 5);
+		if (!num.ok || num.rest[0] != '.') {
+			return (struct nt_tzsetRule){0};
+		}
+		r.week = num.num;
+		num = nt_tzsetNum(num.rest + 1, 0, 6);
+		if (!num.ok) {
+			return (struct nt_tzsetRule){0};
+		}
+		r.kind = nt_ruleMonthWeekDay;
+		r.day = num.num;
+		s = num.rest;
+	} else {
+		num = nt_tzsetNum(s, 0, 365);
+		if (!num.ok) {
+			return (struct nt_tzsetRule){0};
+		}
+		r.kind = nt_ruleDOY;
+		r.day = num.num;
+		s = num.rest;
+	}
+
+	if (s[0] != '/') {
+		r.time = 2 * nt_secondsPerHour; // 2am is the default
+		return (struct nt_tzsetRule){r, s, true};
+	}
+
+	struct nt_tzsetOffset offset = nt_tzsetOffset(s + 1);
+	if (!offset.ok) {
+		return (struct nt_tzsetRule){0};
+	}
+	r.time = offset.offset;
+
+	return (struct nt_tzsetRule){r, offset.rest, true};
+}
+
+// tzsetNum parses a number from a tzset string.
+// It returns the number, and the remainder of the string, and reports success.
+// The number must be between min and max.
+struct nt_tzsetNum nt_tzsetNum(char *s, int min, int max)
+{
+	if (s[0] == '\0') {
+		return (struct nt_tzsetNum){0, "", false};
+	}
+	int num = 0;
+	for (size_t i = 0; s[i] != '\0'; i++) {
+		char r = s[i];
+		if (r < '0' || r > '9') {
+			if (i == 0 || num < min) {
+				return (struct nt_tzsetNum){0, "", false};
+			}
+			return (struct nt_tzsetNum){num, s + i, true};
+		}
+		num *= 10;
+		num += r - '0';
+		if (num > max) {
+			return (struct nt_tzsetNum){0, "", false};
+		}
+	}
+	if (num < min) {
+		return (struct nt_tzsetNum){0, "", false};
+	}
+	return (struct nt_tzsetNum){num, "", true};
+}
+
+// tzruleTime takes a year, a rule, and a timezone offset,
+// and returns the number of seconds since the start of the year
+// that the rule takes effect.
+int nt_tzruleTime(int year, nt_rule r, int off)
+{
+	int s = 0;
+	switch (r.kind) {
+	case nt_ruleJulian:
+		s = (r.day - 1) * nt_secondsPerDay;
+		if (nt_isLeap(year) && r.day >= 60) {
+			s += nt_secondsPerDay;
+		}
+		break;
+	case nt_ruleDOY:
+		s = r.day * nt_secondsPerDay;
+		break;
+	case nt_ruleMonthWeekDay: {
+		// Zeller's Congruence.
+		int m1 = (r.mon+9)%12 + 1;
+		int yy0 = year;
+		if (r.mon <= 2) {
+			yy0--;
+		}
+		int yy1 = yy0 / 100;
+		int yy2 = yy0 % 100;
+		int dow = ((26*m1-2)/10 + 1 + yy2 + yy2/4 + yy1/4 - 2*yy1) % 7;
+		if (dow < 0) {
+			dow += 7;
+		}
+		// Now dow is the day-of-week of the first day of r.mon.
+		// Get the day-of-month of the first "dow" day.
+		int d = r.day - dow;
+		if (d < 0) {
+			d += 7;
+		}
+		for (int i = 1; i < r.week; i++) {
+			if (d+7 >= daysIn(r.mon, year)) {
+				break;
+			}
+			d += 7;
+		}
+		d += nt_daysBefore[r.mon-1];
+		if (nt_isLeap(year) && r.mon > 2) {
+			d++;
+		}
+		s = d * nt_secondsPerDay;
+		break;
+	}
+	}
+
+	return s + r.time - off;
+}
+
+// findZone returns the zone of l with the given name, offset and
+// daylight savings flag, or NULL. The name is a slice of length nameLen.
+nt_zone *nt_findZone(nt_Location *l, char *name, size_t nameLen, int offset, bool isDST)
+{
+	if (nameLen >= sizeof(l->zone[0].name)) {
+		nameLen = sizeof(l->zone[0].name) - 1;
+	}
+	for (size_t i = 0; i < l->zoneLen; i++) {
+		nt_zone *z = &l->zone[i];
+		if (strncmp(z->name, name, nameLen) == 0 && z->name[nameLen] == '\0' &&
+				z->offset == offset && z->isDST == isDST) {
+			return z;
+		}
+	}
+	return NULL;
+}
+
+// end zoneinfo.go
+
+/*** zoneinfo_read.go Implementation ***/
+
+// Parse "zoneinfo" time zone file.
+// This is a fairly standard file format used on OS X, Linux, BSD, Sun, and others.
+// See tzfile(5), https://en.wikipedia.org/wiki/Zoneinfo,
+// and ftp://munnari.oz.au/pub/oldtz/
+//
+// The loaded Location owns its zone and transition arrays, and its name
+// and extend strings; release it with LocationFree.
+
+// maxFileSize is the max permitted size of files read by readFile.
+// The largest file in the tz database is under 4 KB; 10 MB is
+// plenty for a corrupted or unrelated file to be rejected.
+#define nt_maxFileSize (10 << 20)
+
+// dataIO is a reader over a byte slice; once a read runs past the end
+// error is set and all further reads fail.
+typedef struct {
+	const uint8_t *p;
+	size_t len;
+	bool error;
+} nt_dataIO;
+
+static const uint8_t *nt_dataIO_read(nt_dataIO *d, size_t n)
+{
+	if (d->len < n) {
+		d->p = NULL;
+		d->len = 0;
+		d->error = true;
+		return NULL;
+	}
+	const uint8_t *p = d->p;
+	d->p += n;
+	d->len -= n;
+	return p;
+}
+
+static bool nt_dataIO_big4(nt_dataIO *d, uint32_t *n)
+{
+	const uint8_t *p = nt_dataIO_read(d, 4);
+	if (p == NULL) {
+		return false;
+	}
+	*n = nt_be32(p);
+	return true;
+}
+
+static bool nt_dataIO_big8(nt_dataIO *d, uint64_t *n)
+{
+	const uint8_t *p = nt_dataIO_read(d, 8);
+	if (p == NULL) {
+		return false;
+	}
+	*n = nt_be64(p);
+	return true;
+}
+
+static bool nt_dataIO_byte(nt_dataIO *d, uint8_t *n)
+{
+	const uint8_t *p = nt_dataIO_read(d, 1);
+	if (p == NULL) {
+		return false;
+	}
+	*n = p[0];
+	return true;
+}
+
+static char *nt_errBadData = "time: malformed time zone information";
+static char *nt_errLocation = "time: invalid location name";
+static char *nt_errUnknownZone = "time: unknown time zone";
+
+// LocationFree releases a Location returned by LoadLocation,
+// LoadLocationFromTZData or FixedZone. UTC, Local, NULL and the shared
+// FixedZones, such as the whole-hour ones and those of decoded Times,
+// are ignored.
+void nt_LocationFree(nt_Location *l)
+{
+	if (l == NULL || l == &nt_utcLoc || l == &nt_localLoc || nt_sharedFixedZoneHas(l)) {
+		return;
+	}
+	free(l);
+}
+
+static struct nt_LoadLocation nt_loadLocationFromTZData(const char *name, const uint8_t *data, size_t len);
+
+// LoadLocationFromTZData returns a Location with the given name
+// initialized from the IANA Time Zone database-formatted data.
+// The data should be in the format of a standard IANA time zone file
+// (for example, the content of /etc/localtime on Unix systems).
+struct nt_LoadLocation nt_LoadLocationFromTZData(const char *name, const uint8_t *data, size_t len)
+{
+	struct nt_LoadLocation z = nt_loadLocationFromTZData(name, data, len);
+	nt_PROBE3(tzif_load, name, len, z.err);
+	return z;
+}
+
+static struct nt_LoadLocation nt_loadLocationFromTZData(const char *name, const uint8_t *data, size_t len)
+{
+	nt_dataIO d = {data, len, false};
+	const uint8_t *p;
+
+	// 4-byte magic "TZif"
+	if ((p = nt_dataIO_read(&d, 4)) == NULL || memcmp(p, "TZif", 4) != 0) {
+		return (struct nt_LoadLocation){NULL, nt_errBadData};
+	}
+
+	// 1-byte version, then 15 bytes of padding
+	int version;
+	if ((p = nt_dataIO_read(&d, 16)) == NULL) {
+		return (struct nt_LoadLocation){NULL, nt_errBadData};
+	}
+	switch (p[0]) {
+	case 0:   version = 1; break;
+	case '2': version = 2; break;
+	case '3': version = 3; break;
+	default:
+		return (struct nt_LoadLocation){NULL, nt_errBadData};
+	}
+
+	// six big-endian 32-bit integers:
+	//	number of UTC/local indicators
+	//	number of standard/wall indicators
+	//	number of leap seconds
+	//	number of transition times
+	//	number of local time zones
+	//	number of characters of time zone abbrev strings
+	enum { NUTCLocal, NStdWall, NLeap, NTime, NZone, NChar };
+	uint32_t n[6];
+	for (int i = 0; i < 6; i++) {
+		if (!nt_dataIO_big4(&d, &n[i]) || n[i] > nt_maxFileSize) {
+			return (struct nt_LoadLocation){NULL, nt_errBadData};
+		}
+	}
+
+	// If we have version 2 or 3, then the data is first written out
+	// in a 32-bit format, then written out again in a 64-bit format.
+	// Skip the 32-bit format and read the 64-bit one, as it can
+	// describe a broader range of dates.
+
+	bool is64 = false;
+	if (version > 1) {
+		// Skip the 32-bit data.
+		size_t skip = (size_t)n[NTime]*4 +
+			n[NTime] +
+			(size_t)n[NZone]*6 +
+			n[NChar] +
+			(size_t)n[NLeap]*8 +
+			n[NStdWall] +
+			n[NUTCLocal];
+		// Skip the version 2 header that we just read.
+		skip += 4 + 16;
+		nt_dataIO_read(&d, skip);
+
+		is64 = true;
+
+		// Read the counts again, they can differ.
+		for (int i = 0; i < 6; i++) {
+			if (!nt_dataIO_big4(&d, &n[i]) || n[i] > nt_maxFileSize) {
+				return (struct nt_LoadLocation){NULL, nt_errBadData};
+			}
+		}
+	}
+
+	size_t size = is64 ? 8 : 4;
+
+	// Transition times.
+	nt_dataIO txtimes = {nt_dataIO_read(&d, n[NTime] * size), n[NTime] * size, false};
+
+	// Time zone indices for transition times.
+	const uint8_t *txzones = nt_dataIO_read(&d, n[NTime]);
+
+	// Zone info structures
+	nt_dataIO zonedata = {nt_dataIO_read(&d, (size_t)n[NZone] * 6), (size_t)n[NZone] * 6, false};
+
+	// Time zone abbreviations.
+	const uint8_t *abbrev = nt_dataIO_read(&d, n[NChar]);
+
+	// Leap-second time pairs
+	nt_dataIO_read(&d, n[NLeap] * (size + 4));
+
+	// Whether tx times associated with local time types
+	// are specified as standard time or wall time.
+	size_t isstdLen = n[NStdWall];
+	const uint8_t *isstd = nt_dataIO_read(&d, isstdLen);
+
+	// Whether tx times associated with local time types
+	// are specified as UTC or local time.
+	size_t isutcLen = n[NUTCLocal];
+	const uint8_t *isutc = nt_dataIO_read(&d, isutcLen);
+
+	if (d.error) { // ran out of data
+		return (struct nt_LoadLocation){NULL, nt_errBadData};
+	}
+
+	char extend[256] = "";
+	if (d.len > 2 && d.p[0] == '\n' && d.p[d.len-1] == '\n' && d.len - 2 < sizeof(extend)) {
+		memcpy(extend, d.p + 1, d.len - 2);
+		extend[d.len - 2] = '\0';
+	}
+
+	// Now we can build up a useful data structure.
+	// First the zone information.
+	//	utcoff[4] isdst[1] nameindex[1]
+	size_t nzone = n[NZone];
+	if (nzone == 0) {
+		// Reject tzdata files with no zones. There's nothing useful in them.
+		// This also avoids a panic later when we add and then use a fake transition (golang.org/issue/29437).
+		return (struct nt_LoadLocation){NULL, nt_errBadData};
+	}
+	// The extend string may name zones that no transition uses;
+	// leave room to add them so that lookup can always return
+	// one of l's zones.
+	struct nt_tzsetZones ez = nt_tzsetZones(extend);
+	size_t ntx = n[NTime] > 0 ? n[NTime] : 1;
+	nt_Location *l = nt_newLocation(name, nzone + 2, ntx, extend);
+	if (l == NULL) {
+		return (struct nt_LoadLocation){NULL, "time: out of memory"};
+	}
+	l->zoneLen = nzone;
+
+	for (size_t i = 0; i < nzone; i++) {
+		uint32_t off;
+		uint8_t b;
+		if (!nt_dataIO_big4(&zonedata, &off)) {
+			goto bad;
+		}
+		l->zone[i].offset = (int32_t)off;
+		if (!nt_dataIO_byte(&zonedata, &b)) {
+			goto bad;
+		}
+		l->zone[i].isDST = b != 0;
+		if (!nt_dataIO_byte(&zonedata, &b) || b >= n[NChar]) {
+			goto bad;
+		}
+		size_t nameLen = strnlen((const char *)abbrev + b, n[NChar] - b);
+		if (nameLen >= sizeof(l->zone[i].name)) {
+			nameLen = sizeof(l->zone[i].name) - 1;
+		}
+		memcpy(l->zone[i].name, abbrev + b, nameLen);
+	}
+
+	// Now the transition time info.
+	for (size_t i = 0; i < n[NTime]; i++) {
+		int64_t when;
+		if (!is64) {
+			uint32_t n4;
+			if (!nt_dataIO_big4(&txtimes, &n4)) {
+				goto bad;
+			}
+			when = (int32_t)n4;
+		} else {
+			uint64_t n8;
+			if (!nt_dataIO_big8(&txtimes, &n8)) {
+				goto bad;
+			}
+			when = (int64_t)n8;
+		}
+		l->tx[i].when = when;
+		if (txzones[i] >= nzone) {
+			goto bad;
+		}
+		l->tx[i].index = txzones[i];
+		if (i < isstdLen) {
+			l->tx[i].isstd = isstd[i] != 0;
+		}
+		if (i < isutcLen) {
+			l->tx[i].isutc = isutc[i] != 0;
+		}
+	}
+
+	if (n[NTime] == 0) {
+		// Build fake transition to cover all time.
+		// This happens in fixed locations like "Etc/GMT0".
+		l->tx[0] = (nt_zoneTrans){nt_alpha, 0, false, false};
+	}
+
+	// Committed to succeed.
+	if (ez.ok) {
+		if (nt_findZone(l, ez.stdName, ez.stdLen, ez.stdOffset, false) == NULL) {
+			nt_zone *z = &l->zone[l->zoneLen++];
+			*z = (nt_zone){"", ez.stdOffset, false};
+			memcpy(z->name, ez.stdName, ez.stdLen < sizeof(z->name) ? ez.stdLen : sizeof(z->name) - 1);
+		}
+		if (ez.hasDST && nt_findZone(l, ez.dstName, ez.dstLen, ez.dstOffset, true) == NULL) {
+			nt_zone *z = &l->zone[l->zoneLen++];
+			*z = (nt_zone){"", ez.dstOffset, true};
+			memcpy(z->name, ez.dstName, ez.dstLen < sizeof(z->name) ? ez.dstLen : sizeof(z->name) - 1);
+		}
+	}
+
+	nt_Location_fillCache(l, nt_now().sec);
+
+	return (struct nt_LoadLocation){l, NULL};
+
+bad:
+	nt_LocationFree(l);
+	return (struct nt_LoadLocation){NULL, nt_errBadData};
+}
+
+// fillCache fills in the cache with information about sec,
+// which is normally right now, since that will be the most common lookup.
+void nt_Location_fillCache(nt_Location *l, int64_t sec)
+{
+	nt_zoneTrans *tx = l->tx;
+	for (size_t i = 0; i < l->txLen; i++) {
+		if (tx[i].when <= sec && (i+1 == l->txLen || sec < tx[i+1].when)) {
+			l->cacheStart = tx[i].when;
+			l->cacheEnd = nt_omega;
+			l->cacheZone = &l->zone[tx[i].index];
+			if (i+1 < l->txLen) {
+				l->cacheEnd = tx[i+1].when;
+			} else if (!nt_EMPTY_STR(l->extend)) {
+				// If we're at the end of the known zone transitions,
+				// try the extend string.
+				nt_STAT(extendEvals, 1);
+				struct nt_tzset e = nt_tzset(l->extend, l->cacheStart, sec);
+				nt_zone *z;
+				if (e.ok && (z = nt_findZone(l, e.name, e.nameLen, e.offset, e.isDST)) != NULL) {
+					l->cacheStart = e.start;
+					l->cacheEnd = e.end;
+					l->cacheZone = z;
+				}
+			}
+			break;
+		}
+	}
+}
+
+// readFile reads the whole file at path into a malloc'd buffer.
+// It returns NULL with errno set on failure.
+static uint8_t *nt_readFile(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+	size_t cap = 4096, n = 0;
+	uint8_t *buf = malloc(cap);
+	while (buf != NULL) {
+		n += fread(buf + n, 1, cap - n, f);
+		if (n < cap || ferror(f)) {
+			break;
+		}
+		if (cap >= nt_maxFileSize) {
+			free(buf);
+			buf = NULL;
+			break;
+		}
+		uint8_t *b = realloc(buf, cap * 2);
+		if (b == NULL) {
+			free(buf);
+		}
+		buf = b;
+		cap *= 2;
+	}
+	if (buf != NULL && ferror(f)) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = n;
+	return buf;
+}
+
+// loadTzinfoFromDir returns the contents of the file with the given
+// name in dir. An empty dir means name is a path.
+static uint8_t *nt_loadTzinfoFromDir(const char *dir, const char *name, size_t *len)
+{
+	char path[4096];
+	if (nt_EMPTY_STR(dir)) {
+		snprintf(path, sizeof(path), "%s", name);
+	} else {
+		snprintf(path, sizeof(path), "%s/%s", dir, name);
+	}
+	return nt_readFile(path, len);
+}
+
+// loadLocation returns the Location with the given name from one of
+// the specified sources. See loadTzinfo for a list of supported sources.
+// The first timezone data matching the given name that is successfully loaded
+// and parsed is returned as a Location.
+static struct nt_LoadLocation nt_loadLocation(const char *name, const char *const *sources)
+{
+	char *firstErr = NULL;
+	for (const char *const *source = sources; *source != NULL; source++) {
+		size_t len;
+		uint8_t *zoneData = nt_loadTzinfoFromDir(*source, name, &len);
+		if (zoneData == NULL) {
+			continue;
+		}
+		struct nt_LoadLocation z = nt_LoadLocationFromTZData(name, zoneData, len);
+		free(zoneData);
+		if (z.err == NULL) {
+			return z;
+		}
+		if (firstErr == NULL) {
+			firstErr = z.err;
+		}
+	}
+	if (firstErr != NULL) {
+		return (struct nt_LoadLocation){NULL, firstErr};
+	}
+	return (struct nt_LoadLocation){NULL, nt_errUnknownZone};
+}
+
+// Many systems use /usr/share/zoneinfo, Solaris 2 has
+// /usr/share/lib/zoneinfo, IRIX 6 has /usr/lib/locale/TZ,
+// NixOS has /etc/zoneinfo.
+static const char *const nt_platformZoneSources[] = {
+	"/usr/share/zoneinfo/",
+	"/usr/share/lib/zoneinfo/",
+	"/usr/lib/locale/TZ/",
+	"/etc/zoneinfo/",
+	NULL,
+};
+
+// initLocal initializes Local from the TZ environment variable,
+// falling back to /etc/localtime and then UTC.
+static void nt_initLocal(void)
+{
+	// consult $TZ to find the time zone to use.
+	// no $TZ means use the system default /etc/localtime.
+	// $TZ="" means use UTC.
+	// $TZ="foo" or $TZ=":foo" if foo is an absolute path, then the file pointed
+	// by foo will be used to initialize timezone; otherwise, file
+	// /usr/share/zoneinfo/foo will be used.
+
+	struct nt_LoadLocation z = {NULL, NULL};
+	char *tz = getenv("TZ");
+	char *name = NULL;
+	if (tz == NULL) {
+		z = nt_loadLocation("localtime", (const char *const[]){"/etc", NULL});
+		name = "Local";
+	} else {
+		if (tz[0] == ':') {
+			tz++;
+		}
+		if (tz[0] == '/') {
+			z = nt_loadLocation(tz, (const char *const[]){"", NULL});
+			name = strcmp(tz, "/etc/localtime") == 0 ? "Local" : tz;
+		} else if (tz[0] != '\0' && strcmp(tz, "UTC") != 0) {
+			z = nt_loadLocation(tz, nt_platformZoneSources);
+		}
+	}
+	if (z.loc != NULL) {
+		// Local keeps the loaded block for the life of the process.
+		nt_localLoc = *z.loc;
+		if (name != NULL) {
+			nt_localLoc.name = strcmp(name, "Local") == 0 ? "Local" : strdup(name);
+		}
+		if (nt_localLoc.name != NULL) {
+			return;
+		}
+	}
+
+	// Fall back to UTC.
+	nt_localLoc = (nt_Location){.name = "UTC"};
+}
+
+// LoadLocation returns the Location with the given name.
+//
+// If the name is "" or "UTC", LoadLocation returns UTC.
+// If the name is "Local", LoadLocation returns Local.
+//
+// Otherwise, the name is taken to be a location name corresponding to a file
+// in the IANA Time Zone database, such as "America/New_York".
+//
+// LoadLocation looks for the IANA Time Zone database in the following
+// locations in order:
+//
+//   - the directory named by the ZONEINFO environment variable
+//   - on a Unix system, the system standard installation location
+struct nt_LoadLocation nt_LoadLocation(const char *name)
+{
+	if (nt_EMPTY_STR(name) || strcmp(name, "UTC") == 0) {
+		return (struct nt_LoadLocation){nt_UTC, NULL};
+	}
+	if (strcmp(name, "Local") == 0) {
+		return (struct nt_LoadLocation){nt_Local, NULL};
+	}
+	if (strstr(name, "..") != NULL || name[0] == '/' || name[0] == '\\') {
+		// No valid IANA Time Zone name contains a single dot,
+		// much less dot dot. Likewise, none begin with a slash.
+		return (struct nt_LoadLocation){NULL, nt_errLocation};
+	}
+	char *firstErr = NULL;
+	char *zoneinfo = getenv("ZONEINFO");
+	if (!nt_EMPTY_STR(zoneinfo)) {
+		struct nt_LoadLocation z = nt_loadLocation(name, (const char *const[]){zoneinfo, NULL});
+		if (z.err == NULL) {
+			return z;
+		}
+		if (z.err != nt_errUnknownZone) {
+			firstErr = z.err;
+		}
+	}
+	struct nt_LoadLocation z = nt_loadLocation(name, nt_platformZoneSources);
+	if (z.err != NULL && firstErr != NULL) {
+		z.err = firstErr;
+	}
+	return z;
+}
+
+// end zoneinfo_read.go
+
+/*** Zone snapshots ***/
+
+// A zone snapshot is a single file holding fully loaded Locations, so a
+// process can get at hundreds of zones with one mmap instead of opening
+// and parsing a TZif file per zone. The file is laid out as
+//
+//	header | entry[count] sorted by name | seeds | slots | strings |
+//	zone arrays | tx arrays
+//
+// with every reference stored as a byte offset from the start of the
+// file, so the mapping can land at any address. A minimal perfect hash
+// over the names, as a seed per bucket and an entry per slot, follows the
+// entries so that ZoneSnapshotIndex is one hash, one probe and one
+// memcmp. A string table such as stb_ds's, built at Open, looks names up
+// about as fast, but every process mapping the snapshot would rebuild it
+// on the heap. Zones and transitions are stored in their in-memory
+// layout, which ties a snapshot to the byte order and struct layout of
+// the machine that wrote it; the header records both and Open rejects a
+// mismatch.
+//
+// Transitions produced by the extend string are expanded up to
+// nt_snapshotHorizon, so lookups before then are a binary search over
+// tx alone. The extend string is kept for times after the horizon.
+
+#define nt_SNAPSHOT_MAGIC "NTZSNAP1"
+
+// snapshotHorizon is 2100-01-01T00:00:00Z.
+#define nt_snapshotHorizon INT64_C(4102444800)
+
+struct nt_snapHeader {
+	char magic[8];
+	uint32_t order;    // 0x01020304 as written by the producer
+	uint16_t zoneSize; // sizeof(nt_zone)
+	uint16_t txSize;   // sizeof(nt_zoneTrans)
+	uint64_t count;    // number of entries
+	uint64_t buckets;  // number of perfect hash seeds
+	uint64_t size;     // size of the whole file
+};
+
+struct nt_snapEntry {
+	uint64_t name, extend; // offsets of NUL terminated strings
+	uint64_t nameLen;
+	uint64_t zone, tx;     // offsets of the zone and tx arrays
+	uint64_t zoneLen, txLen;
+	int64_t cacheStart, cacheEnd;
+	int64_t cacheZone;     // index into zone, or -1
+};
+
+struct nt_ZoneSnapshot {
+	void *base;
+	size_t size;
+	size_t count;
+	nt_Location *locs; // sorted by name
+	size_t buckets;
+	const uint32_t *seeds; // [buckets]
+	const uint32_t *slots; // [count], entry index
+	const struct nt_snapEntry *entries;
+};
+
+// snapHash hashes name with FNV-1a, the only pass made over the key,
+// and stores its length in len.
+static uint64_t nt_snapHash(const char *name, size_t *len)
+{
+	uint64_t h = UINT64_C(14695981039346656037);
+	size_t i = 0;
+	for (; name[i] != '\0'; i++) {
+		h ^= (uint8_t)name[i];
+		h *= UINT64_C(1099511628211);
+	}
+	*len = i;
+	return h;
+}
+
+// snapSlot mixes a name hash with a seed and reduces it to [0, n).
+// Seed 0 picks the bucket; a bucket's own seed picks the slot.
+static size_t nt_snapSlot(uint64_t h, uint32_t seed, size_t n)
+{
+	h ^= seed * UINT64_C(0x9e3779b97f4a7c15);
+	h ^= h >> 30;
+	h *= UINT64_C(0xbf58476d1ce4e5b9);
+	h ^= h >> 27;
+	h *= UINT64_C(0x94d049bb133111eb);
+	h ^= h >> 31;
+	return h % n;
+}
+
+// snapPerfectHash builds a minimal perfect hash over the n names by hash
+// and displace: keys are grouped into buckets, and, largest bucket
+// first, each bucket gets the first seed that sends all its keys to free
+// slots. slots[i] receives the index of the name in slot i.
+static bool nt_snapPerfectHash(const char **names, size_t n, uint32_t *seeds, size_t buckets, uint32_t *slots)
+{
+	uint64_t *h = malloc(n * sizeof(*h));
+	uint32_t *first = calloc(buckets + 1, sizeof(*first)); // bucket start in keys
+	uint32_t *keys = malloc(n * sizeof(*keys));          // name indexes grouped by bucket
+	uint32_t *order = malloc(buckets * sizeof(*order));
+	bool ok = h != NULL && first != NULL && keys != NULL && order != NULL;
+	for (size_t i = 0; ok && i < n; i++) {
+		size_t len;
+		h[i] = nt_snapHash(names[i], &len);
+		first[nt_snapSlot(h[i], 0, buckets) + 1]++;
+	}
+	for (size_t b = 0; ok && b < buckets; b++) {
+		order[b] = first[b+1]; // bucket size, counted down as keys are placed
+		first[b+1] += first[b];
+	}
+	for (size_t i = 0; ok && i < n; i++) {
+		size_t b = nt_snapSlot(h[i], 0, buckets);
+		keys[first[b] + --order[b]] = i;
+	}
+	if (ok) {
+		// Counting sort of buckets by size, largest first.
+		size_t at = 0;
+		for (uint32_t size = n; size > 0 && at < buckets; size--) {
+			for (size_t b = 0; b < buckets; b++) {
+				if (first[b+1] - first[b] == size) {
+					order[at++] = b;
+				}
+			}
+		}
+		for (size_t b = 0; b < buckets; b++) {
+			if (first[b+1] == first[b]) {
+				order[at++] = b;
+			}
+		}
+	}
+	for (size_t i = 0; ok && i < n; i++) {
+		slots[i] = UINT32_MAX;
+	}
+	for (size_t o = 0; ok && o < buckets; o++) {
+		size_t b = order[o];
+		uint32_t *k = &keys[first[b]];
+		size_t kn = first[b+1] - first[b];
+		seeds[b] = 0;
+		if (kn == 0) {
+			continue;
+		}
+		uint32_t seed;
+		for (seed = 1; seed < (1u << 24); seed++) {
+			size_t j;
+			for (j = 0; j < kn; j++) {
+				size_t slot = nt_snapSlot(h[k[j]], seed, n);
+				bool clash = slots[slot] != UINT32_MAX;
+				for (size_t i = 0; i < j && !clash; i++) {
+					clash = nt_snapSlot(h[k[i]], seed, n) == slot;
+				}
+				if (clash) {
+					break;
+				}
+			}
+			if (j == kn) {
+				break;
+			}
+		}
+		if (seed == (1u << 24)) {
+			ok = false;
+			break;
+		}
+		seeds[b] = seed;
+		for (size_t j = 0; j < kn; j++) {
+			slots[nt_snapSlot(h[k[j]], seed, n)] = k[j];
+		}
+	}
+	free(h);
+	free(first);
+	free(keys);
+	free(order);
+	return ok;
+}
+
+// snapExpand appends the transitions l's extend string produces up to
+// the snapshot horizon to tx, which holds l->txLen entries and has room
+// for cap. It returns the new number of transitions.
+static size_t nt_snapExpand(nt_Location *l, nt_zoneTrans *tx, size_t cap)
+{
+	size_t n = l->txLen;
+	if (nt_EMPTY_STR(l->extend) || n == 0) {
+		return n;
+	}
+	int64_t t = tx[n-1].when;
+	while (t < nt_snapshotHorizon && n < cap) {
+		struct nt_tzset e = nt_tzset(l->extend, tx[n-1].when, t);
+		if (!e.ok || e.end == nt_omega) {
+			break;
+		}
+		nt_zone *z = nt_findZone(l, e.name, e.nameLen, e.offset, e.isDST);
+		if (z == NULL) {
+			break;
+		}
+		uint8_t index = z - l->zone;
+		if (e.start > tx[n-1].when && index != tx[n-1].index) {
+			tx[n++] = (nt_zoneTrans){e.start, index, false, false};
+		}
+		t = e.end > t ? e.end : t + nt_secondsPerDay;
+	}
+	return n;
+}
+
+static int nt_snapCompare(const void *a, const void *b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// ZoneSnapshotWrite loads the n named zones with LoadLocation and writes
+// them to a snapshot file at path, replacing any existing file. Names are
+// stored as given; duplicates are rejected.
+char *nt_ZoneSnapshotWrite(const char *path, const char *const *names, size_t n)
+{
+	static nt_zone utc = {"UTC", 0, false};
+	static nt_zoneTrans utcTx = {nt_alpha, 0, false, false};
+	static nt_Location utcSnap = {.zone = &utc, .zoneLen = 1, .tx = &utcTx, .txLen = 1,
+		.extend = "", .cacheStart = nt_alpha, .cacheEnd = nt_omega, .cacheZone = &utc};
+
+	char *err = NULL;
+	const char **sorted = calloc(n ? n : 1, sizeof(*sorted));
+	nt_Location **locs = calloc(n ? n : 1, sizeof(*locs));
+	nt_zoneTrans **txs = calloc(n ? n : 1, sizeof(*txs));
+	size_t *txLens = calloc(n ? n : 1, sizeof(*txLens));
+	struct nt_snapEntry *entries = calloc(n ? n : 1, sizeof(*entries));
+	// About four names a bucket keeps the seed search short.
+	size_t buckets = n/4 + 1;
+	uint32_t *seeds = calloc(buckets, sizeof(*seeds));
+	uint32_t *slots = calloc(n ? n : 1, sizeof(*slots));
+	FILE *f = NULL;
+	char tmp[4096];
+	tmp[0] = '\0';
+	if (sorted == NULL || locs == NULL || txs == NULL || txLens == NULL || entries == NULL ||
+			seeds == NULL || slots == NULL) {
+		err = "time: out of memory";
+		goto done;
+	}
+	memcpy(sorted, names, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), nt_snapCompare);
+
+	// Load everything first, so a bad name leaves any old file alone.
+	size_t seedOff = sizeof(struct nt_snapHeader) + n * sizeof(struct nt_snapEntry);
+	size_t strOff = seedOff + (buckets + n) * sizeof(uint32_t);
+	size_t strLen = 0, zoneBytes = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (i > 0 && strcmp(sorted[i-1], sorted[i]) == 0) {
+			err = "time: duplicate zone name in snapshot";
+			goto done;
+		}
+		struct nt_LoadLocation z = nt_LoadLocation(sorted[i]);
+		if (z.err != NULL) {
+			err = z.err;
+			goto done;
+		}
+		// UTC has no zones of its own; give its entry one so that
+		// it stands alone like the others.
+		nt_Location *l = nt_Location_get(z.loc);
+		if (l->zoneLen == 0) {
+			l = &utcSnap;
+		}
+		locs[i] = l;
+
+		// Enough for two transitions a year from the last one to the horizon.
+		size_t cap = l->txLen + 2 * 400;
+		txs[i] = malloc(cap * sizeof(nt_zoneTrans));
+		if (txs[i] == NULL) {
+			err = "time: out of memory";
+			goto done;
+		}
+		memcpy(txs[i], l->tx, l->txLen * sizeof(nt_zoneTrans));
+		txLens[i] = nt_snapExpand(l, txs[i], cap);
+
+		strLen += strlen(sorted[i]) + 1 + strlen(l->extend ? l->extend : "") + 1;
+		zoneBytes += l->zoneLen * sizeof(nt_zone);
+	}
+
+	if (!nt_snapPerfectHash(sorted, n, seeds, buckets, slots)) {
+		err = "time: cannot build snapshot name index";
+		goto done;
+	}
+
+	// Lay out the file.
+	size_t off = (strOff + strLen + 7) &~ (size_t)7;
+	size_t zoneOff = off;
+	size_t txOff = (zoneOff + zoneBytes + 7) &~ (size_t)7;
+	size_t s = strOff, zo = zoneOff, to = txOff;
+	for (size_t i = 0; i < n; i++) {
+		nt_Location *l = locs[i];
+		struct nt_snapEntry *e = &entries[i];
+		e->name = s;
+		e->nameLen = strlen(sorted[i]);
+		s += e->nameLen + 1;
+		e->extend = s;
+		s += strlen(l->extend ? l->extend : "") + 1;
+		e->zone = zo;
+		e->zoneLen = l->zoneLen;
+		zo += l->zoneLen * sizeof(nt_zone);
+		e->tx = to;
+		e->txLen = txLens[i];
+		to += txLens[i] * sizeof(nt_zoneTrans);
+		e->cacheStart = l->cacheStart;
+		e->cacheEnd = l->cacheEnd;
+		e->cacheZone = l->cacheZone != NULL ? l->cacheZone - l->zone : -1;
+	}
+	struct nt_snapHeader h = {
+		.magic = nt_SNAPSHOT_MAGIC,
+		.order = 0x01020304,
+		.zoneSize = sizeof(nt_zone),
+		.txSize = sizeof(nt_zoneTrans),
+		.count = n,
+		.buckets = buckets,
+		.size = to,
+	};
+
+	// Write to a temporary file and rename it into place, so that
+	// readers never map a partial snapshot.
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		err = "time: cannot create snapshot file";
+		goto done;
+	}
+	static const char zeros[8];
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(entries, sizeof(*entries), n, f);
+	fwrite(seeds, sizeof(*seeds), buckets, f);
+	fwrite(slots, sizeof(*slots), n, f);
+	for (size_t i = 0; i < n; i++) {
+		nt_Location *l = locs[i];
+		fwrite(sorted[i], strlen(sorted[i]) + 1, 1, f);
+		fwrite(l->extend ? l->extend : "", strlen(l->extend ? l->extend : "") + 1, 1, f);
+	}
+	fwrite(zeros, zoneOff - (strOff + strLen), 1, f);
+	for (size_t i = 0; i < n; i++) {
+		fwrite(locs[i]->zone, sizeof(nt_zone), locs[i]->zoneLen, f);
+	}
+	fwrite(zeros, txOff - (zoneOff + zoneBytes), 1, f);
+	for (size_t i = 0; i < n; i++) {
+		fwrite(txs[i], sizeof(nt_zoneTrans), txLens[i], f);
+	}
+	if (ferror(f) | fclose(f)) {
+		err = "time: cannot write snapshot file";
+	} else if (rename(tmp, path) != 0) {
+		err = "time: cannot rename snapshot file";
+	}
+	f = NULL;
+
+done:
+	if (f != NULL) {
+		fclose(f);
+	}
+	if (err != NULL && tmp[0] != '\0') {
+		remove(tmp);
+	}
+	for (size_t i = 0; locs != NULL && txs != NULL && i < n; i++) {
+		if (locs[i] != &utcSnap) {
+			nt_LocationFree(locs[i]);
+		}
+		free(txs[i]);
+	}
+	free(sorted);
+	free(locs);
+	free(txs);
+	free(txLens);
+	free(entries);
+	free(seeds);
+	free(slots);
+	return err;
+}
+
+// snapString reports whether a NUL terminated string starts at off.
+static bool nt_snapString(const char *base, size_t size, uint64_t off)
+{
+	return off < size && memchr(base + off, '\0', size - off) != NULL;
+}
+
+// snapArray reports whether n elements of the given size starting at off
+// lie within the file and are suitably aligned.
+static bool nt_snapArray(size_t size, uint64_t off, uint64_t n, size_t elem)
+{
+	return off % 8 == 0 && off <= size && n <= (size - off) / elem;
+}
+
+// ZoneSnapshotOpen maps the snapshot file at path. The Locations it
+// hands out point straight into the mapping and stay valid until
+// ZoneSnapshotClose; only their small headers are built here.
+struct nt_ZoneSnapshotOpen nt_ZoneSnapshotOpen(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return (struct nt_ZoneSnapshotOpen){NULL, "time: cannot open snapshot file"};
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct nt_snapHeader)) {
+		close(fd);
+		return (struct nt_ZoneSnapshotOpen){NULL, "time: malformed snapshot file"};
+	}
+	size_t size = st.st_size;
+	char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return (struct nt_ZoneSnapshotOpen){NULL, "time: cannot map snapshot file"};
+	}
+
+	char *err = "time: malformed snapshot file";
+	nt_ZoneSnapshot *s = NULL;
+	const struct nt_snapHeader *h = (const void *)base;
+	if (memcmp(h->magic, nt_SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 || h->size != size) {
+		goto bad;
+	}
+	if (h->order != 0x01020304 || h->zoneSize != sizeof(nt_zone) || h->txSize != sizeof(nt_zoneTrans)) {
+		err = "time: snapshot written for a different platform";
+		goto bad;
+	}
+	if (!nt_snapArray(size - sizeof(*h), 0, h->count, sizeof(struct nt_snapEntry)) ||
+			h->buckets == 0 || h->buckets > size || h->count > size / sizeof(uint32_t) ||
+			(h->buckets + h->count) * sizeof(uint32_t) > size - sizeof(*h) - h->count * sizeof(struct nt_snapEntry)) {
+		goto bad;
+	}
+	const struct nt_snapEntry *entries = (const void *)(base + sizeof(*h));
+	const uint32_t *seeds = (const void *)(entries + h->count);
+	const uint32_t *slots = seeds + h->buckets;
+	for (size_t i = 0; i < h->count; i++) {
+		if (slots[i] >= h->count) {
+			goto bad;
+		}
+	}
+
+	s = malloc(sizeof(*s) + h->count * sizeof(nt_Location));
+	if (s == NULL) {
+		err = "time: out of memory";
+		goto bad;
+	}
+	nt_STAT(snapshotAllocs, 1);
+	*s = (nt_ZoneSnapshot){base, size, h->count, (nt_Location *)(s + 1), h->buckets, seeds, slots, entries};
+	for (size_t i = 0; i < s->count; i++) {
+		const struct nt_snapEntry *e = &entries[i];
+		if (!nt_snapString(base, size, e->name) || !nt_snapString(base, size, e->extend) ||
+				e->nameLen != strlen(base + e->name) ||
+				!nt_snapArray(size, e->zone, e->zoneLen, sizeof(nt_zone)) ||
+				!nt_snapArray(size, e->tx, e->txLen, sizeof(nt_zoneTrans)) ||
+				e->zoneLen == 0 || e->txLen == 0 ||
+				e->cacheZone < -1 || e->cacheZone >= (int64_t)e->zoneLen) {
+			goto bad;
+		}
+		nt_zone *zone = (nt_zone *)(base + e->zone);
+		nt_zoneTrans *tx = (nt_zoneTrans *)(base + e->tx);
+		for (size_t j = 0; j < e->txLen; j++) {
+			if (tx[j].index >= e->zoneLen) {
+				goto bad;
+			}
+		}
+		s->locs[i] = (nt_Location){
+			.name = base + e->name,
+			.zone = zone,
+			.zoneLen = e->zoneLen,
+			.tx = tx,
+			.txLen = e->txLen,
+			.extend = base + e->extend,
+			.cacheStart = e->cacheStart,
+			.cacheEnd = e->cacheEnd,
+			.cacheZone = e->cacheZone >= 0 ? &zone[e->cacheZone] : NULL,
+		};
+		if (i > 0 && strcmp(s->locs[i-1].name, s->locs[i].name) >= 0) {
+			goto bad;
+		}
+	}
+	return (struct nt_ZoneSnapshotOpen){s, NULL};
+
+bad:
+	free(s);
+	munmap(base, size);
+	return (struct nt_ZoneSnapshotOpen){NULL, err};
+}
+
+// ZoneSnapshotClose unmaps s. Locations obtained from s must not be
+// used afterwards.
+void nt_ZoneSnapshotClose(nt_ZoneSnapshot *s)
+{
+	if (s == NULL) {
+		return;
+	}
+	munmap(s->base, s->size);
+	free(s);
+}
+
+// ZoneSnapshotIndex returns the index of the Location with the given
+// name in s, as used by ZoneSnapshotAt, or -1 if s does not hold it.
+ptrdiff_t nt_ZoneSnapshotIndex(nt_ZoneSnapshot *s, const char *name)
+{
+	if (s->count == 0) {
+		return -1;
+	}
+	size_t len;
+	uint64_t h = nt_snapHash(name, &len);
+	uint32_t seed = s->seeds[nt_snapSlot(h, 0, s->buckets)];
+	uint32_t i = s->slots[nt_snapSlot(h, seed, s->count)];
+	const struct nt_snapEntry *e = &s->entries[i];
+	if (e->nameLen != len || memcmp((char *)s->base + e->name, name, len) != 0) {
+		return -1;
+	}
+	return i;
+}
+
+// ZoneSnapshotLocation returns the Location with the given name in s,
+// or NULL if s does not hold it.
+nt_Location *nt_ZoneSnapshotLocation(nt_ZoneSnapshot *s, const char *name)
+{
+	ptrdiff_t i = nt_ZoneSnapshotIndex(s, name);
+	return i < 0 ? NULL : &s->locs[i];
+}
+
+// ZoneSnapshotLen returns the number of Locations in s.
+size_t nt_ZoneSnapshotLen(nt_ZoneSnapshot *s)
+{
+	return s->count;
+}
+
+// ZoneSnapshotAt returns the i'th Location of s, in name order.
+nt_Location *nt_ZoneSnapshotAt(nt_ZoneSnapshot *s, size_t i)
+{
+	if (i >= s->count) {
+		nt_panic("time: snapshot index out of range\n");
+	}
+	return &s->locs[i];
+}
+
+/*** Zone abbreviation index ***/
+
+// A ZoneIndex answers the reverse question to lookup: given a zone
+// abbreviation such as "CEST" or "+0530" and a wall clock time, which
+// Locations were using it, and at what offset. It is the multi-Location
+// form of Go's lookupName, which parse uses for zone abbreviations.
+//
+// Every zone of every Location becomes one entry, recording the time
+// range over which a transition could select it. Entries are sorted by
+// abbreviation, so a query is a binary search for the abbreviation run,
+// a range check per candidate and one lookup to confirm it.
+
+typedef struct {
+	char name[sizeof(((nt_zone *)0)->name)];
+	int offset;
+	bool isDST;
+	int64_t start, end; // [start, end) covers every period using the zone
+	nt_Location *loc;
+} nt_zoneIndexEntry;
+
+struct nt_ZoneIndex {
+	size_t len;
+	nt_zoneIndexEntry *e;
+};
+
+static int nt_zoneIndexCompare(const void *a, const void *b)
+{
+	const nt_zoneIndexEntry *x = a, *y = b;
+	int c = strncmp(x->name, y->name, sizeof(x->name));
+	if (c != 0) {
+		return c;
+	}
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// ZoneIndexNew builds an index over the zones of the n Locations. The
+// Locations must outlive the index.
+nt_ZoneIndex *nt_ZoneIndexNew(nt_Location *const *locs, size_t n)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++) {
+		len += nt_Location_get(locs[i])->zoneLen;
+	}
+	nt_ZoneIndex *x = malloc(sizeof(*x) + (len ? len : 1) * sizeof(nt_zoneIndexEntry));
+	if (x == NULL) {
+		return NULL;
+	}
+	nt_STAT(zoneIndexAllocs, 1);
+	x->e = (nt_zoneIndexEntry *)(x + 1);
+	x->len = 0;
+	for (size_t i = 0; i < n; i++) {
+		nt_Location *l = nt_Location_get(locs[i]);
+		int first = l->zoneLen ? nt_Location_lookupFirstZone(l) : 0;
+		for (size_t zi = 0; zi < l->zoneLen; zi++) {
+			nt_zone *z = &l->zone[zi];
+			nt_zoneIndexEntry *e = &x->e[x->len];
+			memcpy(e->name, z->name, sizeof(e->name));
+			e->offset = z->offset;
+			e->isDST = z->isDST;
+			e->loc = l;
+			e->start = nt_omega;
+			e->end = nt_alpha;
+			if ((int)zi == first) {
+				e->start = nt_alpha;
+				e->end = l->txLen > 0 ? l->tx[0].when : nt_omega;
+			}
+			for (size_t ti = 0; ti < l->txLen; ti++) {
+				if (l->tx[ti].index != zi) {
+					continue;
+				}
+				if (l->tx[ti].when < e->start) {
+					e->start = l->tx[ti].when;
+				}
+				int64_t end = ti+1 < l->txLen ? l->tx[ti+1].when : nt_omega;
+				if (end > e->end) {
+					e->end = end;
+				}
+			}
+			// The extend string may select any zone after the last
+			// transition; the loader added its zones to zone[].
+			if (!nt_EMPTY_STR(l->extend)) {
+				struct nt_tzsetZones ez = nt_tzsetZones(l->extend);
+				if (ez.ok && (z == nt_findZone(l, ez.stdName, ez.stdLen, ez.stdOffset, false) ||
+						(ez.hasDST && z == nt_findZone(l, ez.dstName, ez.dstLen, ez.dstOffset, true)))) {
+					if (l->txLen > 0 && l->tx[l->txLen-1].when < e->start) {
+						e->start = l->tx[l->txLen-1].when;
+					}
+					e->end = nt_omega;
+				}
+			}
+			if (e->start < e->end) {
+				x->len++;
+			}
+		}
+	}
+	qsort(x->e, x->len, sizeof(*x->e), nt_zoneIndexCompare);
+	return x;
+}
+
+// ZoneIndexFree releases x.
+void nt_ZoneIndexFree(nt_ZoneIndex *x)
+{
+	free(x);
+}
+
+// zoneIndexAdd appends m to out unless its Location is already there.
+static size_t nt_zoneIndexAdd(nt_ZoneMatch *out, size_t n, size_t max, nt_ZoneMatch m)
+{
+	for (size_t i = 0; i < n && i < max; i++) {
+		if (out[i].loc == m.loc) {
+			return n;
+		}
+	}
+	if (n < max) {
+		out[n] = m;
+	}
+	return n + 1;
+}
+
+// ZoneIndexLookup finds the Locations using the zone abbreviation name
+// at the pseudo-Unix time wallSec (what the wall clock time would be in
+// UTC), writing up to max of them to out with the offset in effect. It
+// returns the number of matching Locations, which may exceed max.
+//
+// As with Go's lookupName, a Location matches if a zone with that name
+// was actually in effect at the time; if no Location matches that way,
+// every Location with a zone of that name matches at that zone's offset.
+size_t nt_ZoneIndexLookup(nt_ZoneIndex *x, const char *name, int64_t wallSec, nt_ZoneMatch *out, size_t max)
+{
+	nt_zoneIndexEntry key = {0};
+	strncpy(key.name, name, sizeof(key.name) - 1);
+	size_t lo = 0, hi = x->len;
+	while (lo < hi) {
+		size_t m = (lo+hi) >> 1;
+		if (strncmp(x->e[m].name, key.name, sizeof(key.name)) < 0) {
+			lo = m + 1;
+		} else {
+			hi = m;
+		}
+	}
+	size_t end = lo;
+	while (end < x->len && strncmp(x->e[end].name, key.name, sizeof(key.name)) == 0) {
+		end++;
+	}
+
+	size_t n = 0;
+	for (size_t i = lo; i < end; i++) {
+		nt_zoneIndexEntry *e = &x->e[i];
+		int64_t sec = wallSec - e->offset;
+		if (sec < e->start || sec >= e->end) {
+			continue;
+		}
+		// The range only bounds the periods using this zone; confirm
+		// that one of them covers sec.
+		struct nt_Location_lookup z = nt_Location_lookup(e->loc, sec);
+		if (strncmp(z.name, key.name, sizeof(key.name)) == 0) {
+			n = nt_zoneIndexAdd(out, n, max, (nt_ZoneMatch){e->loc, z.offset, z.isDST});
+		}
+	}
+	if (n > 0) {
+		return n;
+	}
+
+	// Otherwise fall back to an ordinary name match.
+	for (size_t i = lo; i < end; i++) {
+		nt_zoneIndexEntry *e = &x->e[i];
+		n = nt_zoneIndexAdd(out, n, max, (nt_ZoneMatch){e->loc, e->offset, e->isDST});
+	}
+	return n;
+}
+
+/*** Arrow C Data Interface ***/
+
+// Kernels over Arrow timestamp arrays, working directly on the producer's
+// buffers. Values are read through the array offset and null slots are
+// skipped; outputs line up with the input so the caller can reuse the
+// input validity bitmap as is.
+
+struct nt_arrowUnit {
+	int64_t perSec; // values per second
+	int64_t unitNs; // nanoseconds per value
+	const char *tz; // timezone from the format string, "" when naive
+	bool ok;
+};
+
+// arrowUnit decodes a timestamp format string such as "tsu:UTC".
+static struct nt_arrowUnit nt_arrowUnit(const char *format)
+{
+	struct nt_arrowUnit u = {0};
+	if (format == NULL || format[0] != 't' || format[1] != 's' || format[2] == '\0' || format[3] != ':') {
+		return u;
+	}
+	switch (format[2]) {
+	case 's': u.perSec = 1; break;
+	case 'm': u.perSec = 1000; break;
+	case 'u': u.perSec = 1000000; break;
+	case 'n': u.perSec = 1000000000; break;
+	default: return u;
+	}
+	u.unitNs = 1000000000 / u.perSec;
+	u.tz = &format[4];
+	u.ok = true;
+	return u;
+}
+
+static inline bool nt_arrowValid(const struct ArrowArray *a, int64_t i)
+{
+	const uint8_t *validity = a->buffers[0];
+	int64_t j = a->offset + i;
+	return validity == NULL || a->null_count == 0 || (validity[j>>3] >> (j&7)) & 1;
+}
+
+// ArrowLocation returns the Location named by the timezone of an Arrow
+// timestamp type. Naive timestamps and "UTC" map to UTC, and fixed
+// offsets such as "+05:30" map to a FixedZone shared by every schema with
+// that offset, which the caller does not own. Zone names need a loaded
+// Location, so NULL is returned for them and the caller must supply one.
+nt_Location *nt_ArrowLocation(const struct ArrowSchema *schema)
+{
+	struct nt_arrowUnit u = nt_arrowUnit(schema->format);
+	if (!u.ok) {
+		return NULL;
+	}
+	const char *tz = u.tz;
+	if (tz[0] == '\0' || strcmp(tz, "UTC") == 0 || strcmp(tz, "Z") == 0) {
+		return &nt_utcLoc;
+	}
+	if ((tz[0] == '+' || tz[0] == '-') && strlen(tz) == 6 && tz[3] == ':') {
+		int hh = (tz[1]-'0')*10 + (tz[2]-'0');
+		int mm = (tz[4]-'0')*10 + (tz[5]-'0');
+		if (hh < 0 || hh > 23 || mm < 0 || mm > 59) {
+			return NULL;
+		}
+		int offset = hh*nt_secondsPerHour + mm*nt_secondsPerMinute;
+		return nt_sharedFixedZone(tz[0] == '-' ? -offset : offset);
+	}
+	return NULL;
+}
+
+struct nt_arrowArgs {
+	struct nt_arrowUnit u;
+	nt_Location *loc;
+	const int64_t *values;
+	char *err;
+};
+
+static struct nt_arrowArgs nt_arrowArgs(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc)
+{
+	struct nt_arrowArgs ret = {0};
+	ret.u = nt_arrowUnit(schema->format);
+	if (!ret.u.ok) {
+		ret.err = "arrow: not a timestamp array";
+		return ret;
+	}
+	if (array->n_buffers != 2) {
+		ret.err = "arrow: timestamp array must have 2 buffers";
+		return ret;
+	}
+	if (loc == NULL) {
+		loc = nt_ArrowLocation(schema);
+		if (loc == NULL) {
+			ret.err = "arrow: unknown timezone, pass a Location";
+			return ret;
+		}
+	}
+	ret.loc = loc;
+	ret.values = (const int64_t *)array->buffers[1] + array->offset;
+	return ret;
+}
+
+// ArrowField extracts field from every slot of a timestamp array, in the
+// Location loc (NULL means the array's own timezone). out must hold
+// array->length values; null slots are set to 0.
+char *nt_ArrowField(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc, nt_Field field, int32_t *out, nt_Pool *pool)
+{
+	struct nt_arrowArgs a = nt_arrowArgs(schema, array, loc);
+	if (a.err != NULL) {
+		return a.err;
+	}
+	if (pool != NULL) {
+		struct nt_arrowChunk c = {.kind = nt_chunkArrowField, .schema = schema, .array = array, .loc = a.loc, .field = field, .out = out};
+		nt_ParallelFor(pool, array->length, nt_poolGrain(sizeof(int64_t) + sizeof(int32_t)), nt_arrowChunk, &c);
+		return NULL;
+	}
+	for (int64_t i = 0; i < array->length; i++) {
+		if (!nt_arrowValid(array, i)) {
+			out[i] = 0;
+			continue;
+		}
+		int64_t v = a.values[i];
+		int64_t sec = v / a.u.perSec;
+		int64_t sub = v % a.u.perSec;
+		if (sub < 0) {
+			sec--;
+			sub += a.u.perSec;
+		}
+		if (a.loc != &nt_utcLoc) {
+			sec += nt_Location_lookup(a.loc, sec).offset;
+		}
+		uint64_t abs = sec + (nt_unixToInternal + nt_internalToAbsolute);
+		switch (field) {
+		case nt_FIELD_YEAR:       out[i] = nt_absDate(abs, false).year; break;
+		case nt_FIELD_MONTH:      out[i] = nt_absDate(abs, true).month; break;
+		case nt_FIELD_DAY:        out[i] = nt_absDate(abs, true).day; break;
+		case nt_FIELD_YEARDAY:    out[i] = nt_absDate(abs, false).yday + 1; break;
+		case nt_FIELD_WEEKDAY:    out[i] = nt_Time_absWeekday(abs); break;
+		case nt_FIELD_HOUR:       out[i] = (abs%nt_secondsPerDay) / nt_secondsPerHour; break;
+		case nt_FIELD_MINUTE:     out[i] = (abs%nt_secondsPerHour) / nt_secondsPerMinute; break;
+		case nt_FIELD_SECOND:     out[i] = abs % nt_secondsPerMinute; break;
+		case nt_FIELD_NANOSECOND: out[i] = sub * a.u.unitNs; break;
+		}
+	}
+	return NULL;
+}
+
+// ArrowToLocal converts every slot of a timestamp array to the wall clock
+// reading in loc (NULL means the array's own timezone), written to out in
+// the same unit. The result is a naive timestamp column, as produced by
+// dropping the timezone from a zoned Arrow type.
+char *nt_ArrowToLocal(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc, int64_t *out, nt_Pool *pool)
+{
+	struct nt_arrowArgs a = nt_arrowArgs(schema, array, loc);
+	if (a.err != NULL) {
+		return a.err;
+	}
+	if (pool != NULL) {
+		struct nt_arrowChunk c = {.kind = nt_chunkArrowToLocal, .schema = schema, .array = array, .loc = a.loc, .out = out};
+		nt_ParallelFor(pool, array->length, nt_poolGrain(sizeof(int64_t) + sizeof(int64_t)), nt_arrowChunk, &c);
+		return NULL;
+	}
+	for (int64_t i = 0; i < array->length; i++) {
+		if (!nt_arrowValid(array, i)) {
+			out[i] = 0;
+			continue;
+		}
+		int64_t v = a.values[i];
+		int64_t sec = v / a.u.perSec - (v % a.u.perSec < 0);
+		out[i] = v + nt_Location_lookup(a.loc, sec).offset * a.u.perSec;
+	}
+	return NULL;
+}
+
+// ArrowTruncate rounds every slot of a timestamp array down to a multiple
+// of d since the zero time, as Time.Truncate does, written to out in the
+// same unit. d must be a positive multiple of the array's unit.
+char *nt_ArrowTruncate(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Duration d, int64_t *out, nt_Pool *pool)
+{
+	struct nt_arrowArgs a = nt_arrowArgs(schema, array, nt_UTC);
+	if (a.err != NULL) {
+		return a.err;
+	}
+	if (d <= 0 || d % a.u.unitNs != 0) {
+		return "arrow: truncation must be a positive multiple of the unit";
+	}
+	if (pool != NULL) {
+		struct nt_arrowChunk c = {.kind = nt_chunkArrowTruncate, .schema = schema, .array = array, .d = d, .out = out};
+		nt_ParallelFor(pool, array->length, nt_poolGrain(2 * sizeof(int64_t)), nt_arrowChunk, &c);
+		return NULL;
+	}
+	// Truncate counts from year 1, not from 1970. Fold the distance
+	// between the two epochs into a remainder once, in array units,
+	// so the loop is a single modulus per element.
+	int64_t du = d / a.u.unitNs;
+	int64_t epoch = nt_div((nt_Time){0, nt_unixToInternal, NULL}, d).r / a.u.unitNs;
+	for (int64_t i = 0; i < array->length; i++) {
+		int64_t v = a.values[i];
+		int64_t r = v % du;
+		if (r < 0) {
+			r += du;
+		}
+		r += epoch;
+		if (r >= du) {
+			r -= du;
+		}
+		out[i] = v - r;
+	}
+	return NULL;
+}
+
+// ArrowToTimes converts a timestamp array to Times in loc (NULL means the
+// array's own timezone). Null slots are set to the zero Time.
+char *nt_ArrowToTimes(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc, nt_Time *out, nt_Pool *pool)
+{
+	struct nt_arrowArgs a = nt_arrowArgs(schema, array, loc);
+	if (a.err != NULL) {
+		return a.err;
+	}
+	if (pool != NULL) {
+		struct nt_arrowChunk c = {.kind = nt_chunkArrowToTimes, .schema = schema, .array = array, .loc = a.loc, .out = out};
+		nt_ParallelFor(pool, array->length, nt_poolGrain(sizeof(int64_t) + sizeof(nt_Time)), nt_arrowChunk, &c);
+		return NULL;
+	}
+	if (a.loc == &nt_utcLoc) {
+		a.loc = NULL;
+	}
+	for (int64_t i = 0; i < array->length; i++) {
+		if (!nt_arrowValid(array, i)) {
+			out[i] = (nt_Time){0};
+			continue;
+		}
+		int64_t v = a.values[i];
+		int64_t sec = v / a.u.perSec;
+		int64_t sub = v % a.u.perSec;
+		if (sub < 0) {
+			sec--;
+			sub += a.u.perSec;
+		}
+		out[i] = (nt_Time){sub * a.u.unitNs, sec + nt_unixToInternal, a.loc};
+	}
+	return NULL;
+}
+
+/*** Parquet physical layouts ***/
+
+// Kernels between Parquet column layouts and Unix nanoseconds or Times.
+// INT96 is the legacy Impala/Hive layout: 8 little-endian bytes of
+// nanoseconds within the day followed by 4 little-endian bytes of Julian
+// day number. DATE is an int32 count of days since 1970-01-01 and TIME
+// is an int64 count of micro- or nanoseconds since midnight.
+//
+// All loops are branch free so the compiler can vectorize them.
+
+static const int64_t nt_nanosPerDay = 86400 * (int64_t)1000000000;
+
+// unixEpochJulianDay returns the Julian day number of 1970-01-01 (2440588),
+// derived from the same day counts used for absolute times.
+// Julian day 0 is November 24, 4714 BC in the proleptic Gregorian
+// calendar, that is November 24 of year -4713, which is not a leap year.
+static int64_t nt_unixEpochJulianDay(void)
+{
+	int64_t day0 = nt_daysSinceEpoch(-4713) + nt_daysBefore[nt_NOVEMBER-1] + 24 - 1;
+	return nt_daysSinceEpoch(1970) - day0;
+}
+
+static inline uint32_t nt_le32(const uint8_t *b)
+{
+	return (uint32_t)b[3]<<24 | (uint32_t)b[2]<<16 | (uint32_t)b[1]<<8 | b[0];
+}
+
+static inline uint64_t nt_le64(const uint8_t *b)
+{
+	return (uint64_t)nt_le32(b + 4)<<32 | nt_le32(b);
+}
+
+static inline void nt_le32put(uint8_t *b, uint32_t v)
+{
+	b[0] = v;
+	b[1] = v >> 8;
+	b[2] = v >> 16;
+	b[3] = v >> 24;
+}
+
+static inline void nt_le64put(uint8_t *b, uint64_t v)
+{
+	nt_le32put(b, v);
+	nt_le32put(b + 4, v >> 32);
+}
+
+// floorDiv returns the quotient and remainder of a/b rounded toward
+// negative infinity, for b > 0, without branching.
+static inline int64_t nt_floorDiv(int64_t a, int64_t b, int64_t *rem)
+{
+	int64_t q = a / b;
+	int64_t r = a % b;
+	int64_t neg = r < 0;
+	*rem = r + (b & -neg);
+	return q - neg;
+}
+
+// ParquetInt96ToUnixNano decodes n INT96 values from src into Unix
+// nanoseconds. The result is undefined outside the UnixNano range.
+void nt_ParquetInt96ToUnixNano(const uint8_t *src, size_t n, int64_t *dst, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_parquetChunk c = {.kind = nt_chunkInt96ToUnixNano, .src = src, .dst = dst};
+		nt_ParallelFor(pool, n, nt_poolGrain(nt_PARQUET_INT96_LEN + sizeof(int64_t)), nt_parquetChunk, &c);
+		return;
+	}
+	int64_t epoch = nt_unixEpochJulianDay();
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t *p = &src[i*nt_PARQUET_INT96_LEN];
+		int64_t nanos = nt_le64(p);
+		int64_t day = (int32_t)nt_le32(p + 8);
+		dst[i] = (day - epoch)*nt_nanosPerDay + nanos;
+	}
+}
+
+// ParquetInt96FromUnixNano encodes n Unix nanosecond values as INT96.
+void nt_ParquetInt96FromUnixNano(const int64_t *src, size_t n, uint8_t *dst, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_parquetChunk c = {.kind = nt_chunkInt96FromUnixNano, .src = src, .dst = dst};
+		nt_ParallelFor(pool, n, nt_poolGrain(nt_PARQUET_INT96_LEN + sizeof(int64_t)), nt_parquetChunk, &c);
+		return;
+	}
+	int64_t epoch = nt_unixEpochJulianDay();
+	for (size_t i = 0; i < n; i++) {
+		int64_t nanos;
+		int64_t day = nt_floorDiv(src[i], nt_nanosPerDay, &nanos);
+		uint8_t *p = &dst[i*nt_PARQUET_INT96_LEN];
+		nt_le64put(p, nanos);
+		nt_le32put(p + 8, day + epoch);
+	}
+}
+
+// ParquetInt96ToTimes decodes n INT96 values into UTC Times. Unlike the
+// nanosecond form it covers the whole Julian day range.
+void nt_ParquetInt96ToTimes(const uint8_t *src, size_t n, nt_Time *dst, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_parquetChunk c = {.kind = nt_chunkInt96ToTimes, .src = src, .dst = dst};
+		nt_ParallelFor(pool, n, nt_poolGrain(nt_PARQUET_INT96_LEN + sizeof(nt_Time)), nt_parquetChunk, &c);
+		return;
+	}
+	int64_t epoch = nt_unixEpochJulianDay();
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t *p = &src[i*nt_PARQUET_INT96_LEN];
+		int64_t nsec;
+		int64_t sec = nt_floorDiv(nt_le64(p), nt_SECOND, &nsec);
+		int64_t day = (int32_t)nt_le32(p + 8);
+		sec += (day - epoch)*nt_secondsPerDay;
+		dst[i] = (nt_Time){nsec, sec + nt_unixToInternal, NULL};
+	}
+}
+
+// ParquetInt96FromTimes encodes n Times as INT96.
+void nt_ParquetInt96FromTimes(const nt_Time *src, size_t n, uint8_t *dst, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_parquetChunk c = {.kind = nt_chunkInt96FromTimes, .src = src, .dst = dst};
+		nt_ParallelFor(pool, n, nt_poolGrain(nt_PARQUET_INT96_LEN + sizeof(nt_Time)), nt_parquetChunk, &c);
+		return;
+	}
+	int64_t epoch = nt_unixEpochJulianDay();
+	for (size_t i = 0; i < n; i++) {
+		nt_Time t = src[i];
+		int64_t secOfDay;
+		int64_t day = nt_floorDiv(nt_Time_unixSec(&t), nt_secondsPerDay, &secOfDay);
+		uint8_t *p = &dst[i*nt_PARQUET_INT96_LEN];
+		nt_le64put(p, secOfDay*nt_SECOND + nt_Time_nsec(&t));
+		nt_le32put(p + 8, day + epoch);
+	}
+}
+
+// ParquetDateTimeToUnixNano combines n DATE values and n TIME values,
+// counted in units of unit (nt_MICROSECOND or nt_NANOSECOND), into Unix
+// nanoseconds. time may be NULL to decode dates alone.
+void nt_ParquetDateTimeToUnixNano(const int32_t *date, const int64_t *time, nt_Duration unit, size_t n, int64_t *dst, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_parquetChunk c = {.kind = nt_chunkDateTimeToUnixNano, .src = date, .src2 = time, .dst = dst, .unit = unit};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(int32_t) + 2*sizeof(int64_t)), nt_parquetChunk, &c);
+		return;
+	}
+	if (time == NULL) {
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = date[i]*nt_nanosPerDay;
+		}
+		return;
+	}
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = date[i]*nt_nanosPerDay + time[i]*unit;
+	}
+}
+
+// ParquetDateTimeFromUnixNano splits n Unix nanosecond values into DATE
+// and TIME values in units of unit. Either output may be NULL.
+void nt_ParquetDateTimeFromUnixNano(const int64_t *src, size_t n, nt_Duration unit, int32_t *date, int64_t *time, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_parquetChunk c = {.kind = nt_chunkDateTimeFromUnixNano, .src = src, .dst = date, .dst2 = time, .unit = unit};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(int32_t) + 2*sizeof(int64_t)), nt_parquetChunk, &c);
+		return;
+	}
+	for (size_t i = 0; i < n; i++) {
+		int64_t nanos;
+		int64_t day = nt_floorDiv(src[i], nt_nanosPerDay, &nanos);
+		if (date != NULL) {
+			date[i] = day;
+		}
+		if (time != NULL) {
+			time[i] = nanos / unit;
+		}
+	}
+}
+
+/*** ASN.1 times ***/
+
+// Parsers for the DER content of the ASN.1 UTCTime and GeneralizedTime
+// types, as used for certificate validity (RFC 5280, section 4.1.2.5).
+// Only the DER forms are accepted: UTC ("Z") and seconds always present.
+//
+// Digits are checked and converted eight at a time (SWAR): the bytes are
+// loaded as one little-endian word, validated as ASCII digits with two
+// masks, and folded into two-digit values in 16-bit lanes.
+
+// swarDigits reports whether all eight bytes of x are ASCII digits.
+static inline bool nt_swarDigits(uint64_t x)
+{
+	return ((x & 0xF0F0F0F0F0F0F0F0) |
+		(((x + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+// swarPairs converts eight ASCII digits into four two-digit values, the
+// first pair in the low 16 bits.
+static inline uint64_t nt_swarPairs(uint64_t x)
+{
+	x -= 0x3030303030303030;
+	return (x & 0x00FF00FF00FF00FF)*10 + ((x >> 8) & 0x00FF00FF00FF00FF);
+}
+
+#define nt_PAIR(v, i) ((int)(((v) >> (16*(i))) & 0xFF))
+
+// asn1Time validates the broken down time and builds a UTC Time.
+static char *nt_asn1Time(nt_Time *t, int year, int month, int day, int hour, int min, int sec, int nsec)
+{
+	if (month < 1 || month > 12 || day < 1 || day > daysIn(month, year) ||
+		hour > 23 || min > 59 || sec > 59) {
+		return "asn1: time field out of range";
+	}
+	int64_t d = nt_daysSinceEpoch(year) + nt_daysBefore[month-1] + day - 1;
+	if (nt_isLeap(year) && month >= nt_MARCH) {
+		d++; // February 29
+	}
+	int64_t abs = d*nt_secondsPerDay + hour*nt_secondsPerHour + min*nt_secondsPerMinute + sec;
+	*t = (nt_Time){nsec, abs + nt_absoluteToInternal, NULL};
+	return NULL;
+}
+
+static char *nt_parseASN1UTCTime(nt_Time *t, const uint8_t *p, size_t len);
+
+// ParseASN1UTCTime parses the DER content bytes of a UTCTime,
+// "YYMMDDHHMMSSZ". Following RFC 5280, years 50 to 99 are 1950 to 1999
+// and years 00 to 49 are 2000 to 2049.
+char *nt_ParseASN1UTCTime(nt_Time *t, const uint8_t *p, size_t len)
+{
+	char *err = nt_parseASN1UTCTime(t, p, len);
+	if (err != NULL) {
+		nt_PROBE3(parse_fail, err, p, len);
+	}
+	return err;
+}
+
+static char *nt_parseASN1UTCTime(nt_Time *t, const uint8_t *p, size_t len)
+{
+	if (len != 13 || p[12] != 'Z') {
+		return "asn1: malformed UTCTime";
+	}
+	uint64_t a = nt_le64(&p[0]); // YYMMDDHH
+	uint64_t b = nt_le64(&p[4]); // DDHHMMSS
+	if (!nt_swarDigits(a) || !nt_swarDigits(b)) {
+		return "asn1: malformed UTCTime";
+	}
+	a = nt_swarPairs(a);
+	b = nt_swarPairs(b);
+	int year = nt_PAIR(a, 0);
+	year += year >= 50 ? 1900 : 2000;
+	return nt_asn1Time(t, year, nt_PAIR(a, 1), nt_PAIR(a, 2), nt_PAIR(a, 3), nt_PAIR(b, 2), nt_PAIR(b, 3), 0);
+}
+
+static char *nt_parseASN1GeneralizedTime(nt_Time *t, const uint8_t *p, size_t len);
+
+// ParseASN1GeneralizedTime parses the DER content bytes of a
+// GeneralizedTime, "YYYYMMDDHHMMSS[.f]Z". RFC 5280 forbids the fraction
+// in certificates, but DER allows it elsewhere, so up to nine digits
+// without trailing zeros are accepted.
+char *nt_ParseASN1GeneralizedTime(nt_Time *t, const uint8_t *p, size_t len)
+{
+	char *err = nt_parseASN1GeneralizedTime(t, p, len);
+	if (err != NULL) {
+		nt_PROBE3(parse_fail, err, p, len);
+	}
+	return err;
+}
+
+static char *nt_parseASN1GeneralizedTime(nt_Time *t, const uint8_t *p, size_t len)
+{
+	if (len < 15 || p[len-1] != 'Z') {
+		return "asn1: malformed GeneralizedTime";
+	}
+	uint64_t a = nt_le64(&p[0]); // YYYYMMDD
+	uint64_t b = nt_le64(&p[6]); // DDHHMMSS
+	if (!nt_swarDigits(a) || !nt_swarDigits(b)) {
+		return "asn1: malformed GeneralizedTime";
+	}
+	int nsec = 0;
+	if (len > 15) {
+		size_t digits = len - 16;
+		if (p[14] != '.' || digits == 0 || digits > 9 || p[len-2] == '0') {
+			return "asn1: malformed GeneralizedTime";
+		}
+		int scale = 1000000000;
+		for (size_t i = 15; i < len-1; i++) {
+			if (p[i] < '0' || p[i] > '9') {
+				return "asn1: malformed GeneralizedTime";
+			}
+			scale /= 10;
+			nsec += (p[i] - '0') * scale;
+		}
+	}
+	a = nt_swarPairs(a);
+	b = nt_swarPairs(b);
+	int year = nt_PAIR(a, 0)*100 + nt_PAIR(a, 1);
+	return nt_asn1Time(t, year, nt_PAIR(a, 2), nt_PAIR(a, 3), nt_PAIR(b, 1), nt_PAIR(b, 2), nt_PAIR(b, 3), nsec);
+}
+
+#undef nt_PAIR
+
+// ParseASN1TimeBatch parses n DER encoded times, each a complete element
+// (tag 0x17 UTCTime or 0x18 GeneralizedTime, short form length, content)
+// such as the notBefore and notAfter of a certificate. Elements that do
+// not parse are set to the zero Time. It returns the number of failures.
+size_t nt_ParseASN1TimeBatch(const uint8_t *const *der, size_t n, nt_Time *out, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_timeChunk c = {.kind = nt_chunkParseASN1, .der = der, .ts = out};
+		nt_ParallelFor(pool, n, nt_poolGrain(64), nt_timeChunk, &c);
+		return atomic_load(&c.failed);
+	}
+	size_t failed = 0;
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t *p = der[i];
+		char *err;
+		if (p[0] == 0x17 && p[1] < 0x80) {
+			err = nt_ParseASN1UTCTime(&out[i], &p[2], p[1]);
+		} else if (p[0] == 0x18 && p[1] < 0x80) {
+			err = nt_ParseASN1GeneralizedTime(&out[i], &p[2], p[1]);
+		} else {
+			err = "asn1: not a time";
+		}
+		if (err != NULL) {
+			out[i] = (nt_Time){0};
+			failed++;
+		}
+	}
+	return failed;
+}
+
+/*** Thread pool ***/
+
+// A Pool runs ParallelFor loops on a fixed set of worker threads plus the
+// calling thread. Each loop's range is dealt out evenly; a participant
+// takes grain-sized chunks from the front of its own range and, when it
+// runs dry, steals the back half of the next range that still has work. Ranges
+// are guarded by a small per-slot lock, which is only contended while
+// stealing.
+
+typedef struct {
+	pthread_mutex_t mu;
+	size_t lo, hi;
+	nt_Pool *pool;
+	char pad[64]; // keep slots on separate cache lines
+} nt_poolSlot;
+
+struct nt_Pool {
+	int nthreads;        // worker threads, not counting the caller
+	pthread_t *threads;
+	nt_poolSlot *slots;  // nthreads+1, the caller uses the last
+	pthread_mutex_t run; // serializes ParallelFor calls
+	pthread_mutex_t mu;
+	pthread_cond_t wake, done;
+	uint64_t generation; // bumped for every loop
+	int active;          // workers still inside the current loop
+	bool quit;
+
+	void (*fn)(void *ctx, size_t lo, size_t hi);
+	void *ctx;
+	size_t grain;
+};
+
+static bool nt_poolTake(nt_poolSlot *s, size_t grain, size_t *lo, size_t *hi)
+{
+	pthread_mutex_lock(&s->mu);
+	bool ok = s->lo < s->hi;
+	if (ok) {
+		*lo = s->lo;
+		*hi = s->hi - s->lo > grain ? s->lo + grain : s->hi;
+		s->lo = *hi;
+	}
+	pthread_mutex_unlock(&s->mu);
+	return ok;
+}
+
+static bool nt_poolSteal(nt_Pool *p, int self)
+{
+	int nslots = p->nthreads + 1;
+	for (int k = 1; k < nslots; k++) {
+		nt_poolSlot *victim = &p->slots[(self + k) % nslots];
+		pthread_mutex_lock(&victim->mu);
+		size_t left = victim->hi - victim->lo;
+		if (victim->lo < victim->hi) {
+			// Take the back half, or everything if that is under a chunk.
+			size_t mid = left > p->grain ? victim->lo + left/2 : victim->lo;
+			size_t hi = victim->hi;
+			victim->hi = mid;
+			pthread_mutex_unlock(&victim->mu);
+
+			nt_poolSlot *s = &p->slots[self];
+			pthread_mutex_lock(&s->mu);
+			s->lo = mid;
+			s->hi = hi;
+			pthread_mutex_unlock(&s->mu);
+			return true;
+		}
+		pthread_mutex_unlock(&victim->mu);
+	}
+	return false;
+}
+
+static void nt_poolWork(nt_Pool *p, int self)
+{
+	size_t lo, hi;
+	do {
+		while (nt_poolTake(&p->slots[self], p->grain, &lo, &hi)) {
+			p->fn(p->ctx, lo, hi);
+		}
+	} while (nt_poolSteal(p, self));
+}
+
+static void *nt_poolWorker(void *arg)
+{
+	nt_poolSlot *slot = arg;
+	nt_Pool *p = slot->pool;
+	int self = slot - p->slots;
+	uint64_t seen = 0;
+	pthread_mutex_lock(&p->mu);
+	for (;;) {
+		while (!p->quit && p->generation == seen) {
+			pthread_cond_wait(&p->wake, &p->mu);
+		}
+		if (p->quit) {
+			break;
+		}
+		seen = p->generation;
+		pthread_mutex_unlock(&p->mu);
+
+		nt_poolWork(p, self);
+
+		pthread_mutex_lock(&p->mu);
+		if (--p->active == 0) {
+			pthread_cond_signal(&p->done);
+		}
+	}
+	pthread_mutex_unlock(&p->mu);
+	return NULL;
+}
+
+// PoolNew starts a Pool with nthreads workers in addition to the threads
+// that call ParallelFor. nthreads <= 0 means one fewer than the number of
+// online CPUs. It returns NULL if the threads cannot be started.
+nt_Pool *nt_PoolNew(int nthreads)
+{
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+		if (nthreads < 0) {
+			nthreads = 0;
+		}
+	}
+	nt_Pool *p = calloc(1, sizeof(nt_Pool));
+	if (p == NULL) {
+		return NULL;
+	}
+	nt_STAT(poolAllocs, 1);
+	p->slots = calloc(nthreads + 1, sizeof(nt_poolSlot));
+	p->threads = calloc(nthreads, sizeof(pthread_t));
+	if (p->slots == NULL || (nthreads > 0 && p->threads == NULL)) {
+		free(p->slots);
+		free(p->threads);
+		free(p);
+		return NULL;
+	}
+	pthread_mutex_init(&p->run, NULL);
+	pthread_mutex_init(&p->mu, NULL);
+	pthread_cond_init(&p->wake, NULL);
+	pthread_cond_init(&p->done, NULL);
+	for (int i = 0; i <= nthreads; i++) {
+		pthread_mutex_init(&p->slots[i].mu, NULL);
+		p->slots[i].pool = p;
+	}
+	for (int i = 0; i < nthreads; i++) {
+		if (pthread_create(&p->threads[i], NULL, nt_poolWorker, &p->slots[i]) != 0) {
+			p->nthreads = i;
+			nt_PoolFree(p);
+			return NULL;
+		}
+	}
+	p->nthreads = nthreads;
+	return p;
+}
+
+// PoolFree stops the workers and releases the Pool.
+void nt_PoolFree(nt_Pool *p)
+{
+	if (p == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&p->mu);
+	p->quit = true;
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->mu);
+	for (int i = 0; i < p->nthreads; i++) {
+		pthread_join(p->threads[i], NULL);
+	}
+	free(p->threads);
+	free(p->slots);
+	free(p);
+}
+
+// PoolThreads returns the number of threads that run a ParallelFor loop,
+// including the caller.
+int nt_PoolThreads(nt_Pool *p)
+{
+	return p == NULL ? 1 : p->nthreads + 1;
+}
+
+// ParallelFor calls fn(ctx, lo, hi) over disjoint chunks of at most grain
+// indexes that together cover [0, n), and returns when all have run.
+// Chunks run concurrently and in no particular order.
+// If p is NULL, or ParallelFor is called from inside a running loop on
+// the same Pool, the whole range runs on the calling thread.
+void nt_ParallelFor(nt_Pool *p, size_t n, size_t grain, void (*fn)(void *ctx, size_t lo, size_t hi), void *ctx)
+{
+	if (grain == 0) {
+		grain = 1;
+	}
+	if (p == NULL || p->nthreads == 0 || n <= grain || pthread_mutex_trylock(&p->run) != 0) {
+		if (n > 0) {
+			fn(ctx, 0, n);
+		}
+		return;
+	}
+
+	int nslots = p->nthreads + 1;
+	size_t per = n / nslots;
+	for (int i = 0; i < nslots; i++) {
+		p->slots[i].lo = i * per;
+		p->slots[i].hi = i == nslots-1 ? n : (i+1) * per;
+	}
+	p->fn = fn;
+	p->ctx = ctx;
+	p->grain = grain;
+
+	pthread_mutex_lock(&p->mu);
+	p->active = p->nthreads;
+	p->generation++;
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->mu);
+
+	nt_poolWork(p, p->nthreads);
+
+	pthread_mutex_lock(&p->mu);
+	while (p->active > 0) {
+		pthread_cond_wait(&p->done, &p->mu);
+	}
+	pthread_mutex_unlock(&p->mu);
+	pthread_mutex_unlock(&p->run);
+}
+
+// poolGrain returns the chunk length for a kernel that touches
+// bytesPerElem bytes per element, so that a chunk's input and output
+// stay within nt_POOL_CHUNK_BYTES.
+static size_t nt_poolGrain(size_t bytesPerElem)
+{
+	size_t grain = nt_POOL_CHUNK_BYTES / bytesPerElem;
+	return grain > 0 ? grain : 1;
+}
+
+/*** Statistics ***/
+
+#ifdef NANOTIME_STATS
+// Each thread gets its own counters on first use, linked into a global
+// list so that StatsRead can sum them. When a thread exits its counts
+// are folded into statsRetired and its block is released.
+typedef struct nt_statsSlot {
+	nt_statsCounters c;
+	struct nt_statsSlot *next;
+} nt_statsSlot;
+
+static pthread_mutex_t nt_statsMu = PTHREAD_MUTEX_INITIALIZER;
+static nt_statsSlot *nt_statsAll;
+static nt_statsCounters nt_statsRetired;
+static nt_statsSlot nt_statsFallback; // shared if a slot cannot be allocated
+static pthread_key_t nt_statsKey;
+static pthread_once_t nt_statsOnce = PTHREAD_ONCE_INIT;
+
+static void nt_statsExit(void *arg)
+{
+	nt_statsSlot *s = arg;
+	pthread_mutex_lock(&nt_statsMu);
+	for (size_t i = 0; i < sizeof(s->c.v) / sizeof(s->c.v[0]); i++) {
+		uint64_t v = atomic_load_explicit(&nt_statsRetired.v[i], memory_order_relaxed);
+		atomic_store_explicit(&nt_statsRetired.v[i], v + s->c.v[i], memory_order_relaxed);
+	}
+	for (nt_statsSlot **p = &nt_statsAll; *p != NULL; p = &(*p)->next) {
+		if (*p == s) {
+			*p = s->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&nt_statsMu);
+	free(s);
+}
+
+static void nt_statsInit(void)
+{
+	pthread_key_create(&nt_statsKey, nt_statsExit);
+}
+
+static nt_statsCounters *nt_statsRegister(void)
+{
+	pthread_once(&nt_statsOnce, nt_statsInit);
+	nt_statsSlot *s = calloc(1, sizeof(*s));
+	if (s == NULL || pthread_setspecific(nt_statsKey, s) != 0) {
+		free(s);
+		return &nt_statsFallback.c;
+	}
+	pthread_mutex_lock(&nt_statsMu);
+	s->next = nt_statsAll;
+	nt_statsAll = s;
+	pthread_mutex_unlock(&nt_statsMu);
+	nt_statsMine = &s->c;
+	return nt_statsMine;
+}
+#endif
+
+// StatsRead sums every thread's counters into out. It reports false,
+// leaving out zeroed, when the library was built without NANOTIME_STATS.
+bool nt_StatsRead(nt_Stats *out)
+{
+	*out = (nt_Stats){0};
+#ifdef NANOTIME_STATS
+	uint64_t *sum = (uint64_t *)out;
+	pthread_mutex_lock(&nt_statsMu);
+	for (size_t i = 0; i < sizeof(nt_statsRetired.v) / sizeof(nt_statsRetired.v[0]); i++) {
+		sum[i] = atomic_load_explicit(&nt_statsRetired.v[i], memory_order_relaxed) +
+			atomic_load_explicit(&nt_statsFallback.c.v[i], memory_order_relaxed);
+		for (nt_statsSlot *s = nt_statsAll; s != NULL; s = s->next) {
+			sum[i] += atomic_load_explicit(&s->c.v[i], memory_order_relaxed);
+		}
+	}
+	pthread_mutex_unlock(&nt_statsMu);
+	return true;
+#else
+	return false;
+#endif
+}
+
+// StatsDump writes the summed counters to fd, one "name value" per line.
+void nt_StatsDump(int fd)
+{
+	static const struct {
+		const char *name;
+		size_t off;
+	} fields[] = {
+		{"lookups", offsetof(nt_Stats, lookups)},
+		{"lookup_steps", offsetof(nt_Stats, lookupSteps)},
+		{"extend_evals", offsetof(nt_Stats, extendEvals)},
+		{"cache_hits", offsetof(nt_Stats, cacheHits)},
+		{"cache_misses", offsetof(nt_Stats, cacheMisses)},
+		{"location_allocs", offsetof(nt_Stats, locationAllocs)},
+		{"snapshot_allocs", offsetof(nt_Stats, snapshotAllocs)},
+		{"zone_index_allocs", offsetof(nt_Stats, zoneIndexAllocs)},
+		{"pool_allocs", offsetof(nt_Stats, poolAllocs)},
+		{"string_allocs", offsetof(nt_Stats, stringAllocs)},
+		{"realtime_reads", offsetof(nt_Stats, realtimeReads)},
+		{"monotonic_reads", offsetof(nt_Stats, monotonicReads)},
+		{"ring_enters", offsetof(nt_Stats, ringEnters)},
+	};
+	nt_Stats st;
+	if (!nt_StatsRead(&st)) {
+		dprintf(fd, "nanotime: built without NANOTIME_STATS\n");
+		return;
+	}
+	for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		dprintf(fd, "%s %llu\n", fields[i].name,
+			(unsigned long long)*(uint64_t *)((char *)&st + fields[i].off));
+	}
+}
+
+/*** Broken-down time ***/
+
+// fieldsFill recomputes every field of f from f->unixSec, f->nsec and f->loc.
+static void nt_fieldsFill(nt_TimeFields *f)
+{
+	struct nt_Location_lookup z = nt_Location_lookup(f->loc, f->unixSec);
+	f->zone = z.name;
+	f->offset = z.offset;
+	f->zoneStart = z.start;
+	f->zoneEnd = z.end;
+
+	uint64_t abs = f->unixSec + z.offset + (nt_unixToInternal + nt_internalToAbsolute);
+	struct nt_date d = nt_absDate(abs, true);
+	struct nt_Clock c = nt_Time_absClock(abs);
+	f->year = d.year;
+	f->month = d.month;
+	f->day = d.day;
+	f->yday = d.yday + 1;
+	f->weekday = nt_Time_absWeekday(abs);
+	f->hour = c.hour;
+	f->min = c.min;
+	f->sec = c.sec;
+}
+
+// TimeFieldsOf returns the broken-down form of t in its Location.
+nt_TimeFields nt_TimeFieldsOf(nt_Time t)
+{
+	nt_TimeFields f = {0};
+	f.loc = nt_Location_get(t.loc);
+	f.unixSec = nt_Time_unixSec(&t);
+	f.nsec = nt_Time_nsec(&t);
+	nt_fieldsFill(&f);
+	return f;
+}
+
+// FieldsAdvance moves f forward by delta, leaving it as
+// TimeFieldsOf(nt_TimeAdd(t, delta)) would for the Time t it described.
+//
+// Steps of less than a day that stay within the current zone period only
+// carry from one field to the next as far as needed, so a scan over
+// closely spaced Times mostly touches nsec and sec. Longer or negative
+// steps, and steps that cross a zone transition, recompute every field.
+void nt_FieldsAdvance(nt_TimeFields *f, nt_Duration delta)
+{
+	int64_t sec = delta / nt_SECOND;
+	int64_t nsec = f->nsec + delta % nt_SECOND;
+	if (nsec < 0) {
+		nsec += nt_SECOND;
+		sec--;
+	} else if (nsec >= nt_SECOND) {
+		nsec -= nt_SECOND;
+		sec++;
+	}
+	f->nsec = nsec;
+	if (sec == 0) {
+		return;
+	}
+	f->unixSec += sec;
+	if (sec < 0 || sec >= nt_secondsPerDay || f->unixSec < f->zoneStart || f->unixSec >= f->zoneEnd) {
+		nt_fieldsFill(f);
+		return;
+	}
+
+	// sec < secondsPerDay, so at most one day is carried.
+	sec += f->sec;
+	if (sec < nt_secondsPerMinute) {
+		f->sec = sec;
+		return;
+	}
+	f->sec = sec % nt_secondsPerMinute;
+	int64_t min = f->min + sec / nt_secondsPerMinute;
+	if (min < 60) {
+		f->min = min;
+		return;
+	}
+	f->min = min % 60;
+	int64_t hour = f->hour + min / 60;
+	if (hour < 24) {
+		f->hour = hour;
+		return;
+	}
+	f->hour = hour - 24;
+	f->weekday = (f->weekday + 1) % 7;
+	f->yday++;
+	if (++f->day <= daysIn(f->month, f->year)) {
+		return;
+	}
+	f->day = 1;
+	if (f->month++ == nt_DECEMBER) {
+		f->month = nt_JANUARY;
+		f->year++;
+		f->yday = 1;
+	}
+}
+
+/*** Civil dates and times ***/
+
+// unixDays is the number of days from the absolute epoch to 1970-01-01,
+// the zero CivilDate.
+static const int64_t nt_unixDays = (nt_unixToInternal + nt_internalToAbsolute) / 86400;
+
+// civilDays returns the CivilDate of a normalized year and month.
+static int64_t nt_civilDays(int year, nt_Month month, int day)
+{
+	int64_t d = nt_daysSinceEpoch(year) + nt_daysBefore[month-1] + day - 1;
+	if (nt_isLeap(year) && month >= nt_MARCH) {
+		d++; // February 29
+	}
+	return d - nt_unixDays;
+}
+
+// civilAbs returns the absolute time of midnight on d.
+static inline uint64_t nt_civilAbs(nt_CivilDate d)
+{
+	return (uint64_t)(d + nt_unixDays) * nt_secondsPerDay;
+}
+
+// CivilDateOf returns the CivilDate of the given year, month and day.
+// As with Date, values outside their usual ranges are normalized, so
+// October 32 becomes November 1.
+nt_CivilDate nt_CivilDateOf(int year, nt_Month month, int day)
+{
+	struct nt_norm norm = nt_norm(year, month - 1, 12);
+	return nt_civilDays(norm.nhi, norm.nlo + 1, day);
+}
+
+// CivilDateFromTime returns the date on which t occurs in its Location.
+nt_CivilDate nt_CivilDateFromTime(nt_Time t)
+{
+	return nt_Time_abs(t) / nt_secondsPerDay - nt_unixDays;
+}
+
+// CivilDateDate returns the year, month and day of d.
+struct nt_Date nt_CivilDateDate(nt_CivilDate d)
+{
+	struct nt_date x = nt_absDate(nt_civilAbs(d), true);
+	return (struct nt_Date){x.year, x.month, x.day};
+}
+
+// CivilDateWeekday returns the day of the week of d.
+nt_Weekday nt_CivilDateWeekday(nt_CivilDate d)
+{
+	// January 1, 1970 was a Thursday.
+	return (d % 7 + 7 + nt_THURSDAY) % 7;
+}
+
+// CivilDateYearDay returns the day of the year of d, in the range
+// [1,365] for non-leap years, and [1,366] in leap years.
+int nt_CivilDateYearDay(nt_CivilDate d)
+{
+	return nt_absDate(nt_civilAbs(d), false).yday + 1;
+}
+
+// CivilDateAddDate returns the date corresponding to adding the given
+// number of years, months, and days to d, normalized as by AddDate, so
+// adding one month to October 31 yields December 1.
+nt_CivilDate nt_CivilDateAddDate(nt_CivilDate d, int years, int months, int days)
+{
+	struct nt_Date x = nt_CivilDateDate(d);
+	return nt_CivilDateOf(x.year + years, x.month + months, x.day + days);
+}
+
+// CivilDateIn returns the Time at time of day c on date d in loc. Clock
+// readings skipped or repeated by a zone transition are resolved as by
+// Date.
+nt_Time nt_CivilDateIn(nt_CivilDate d, nt_CivilTime c, nt_Location *loc)
+{
+	struct nt_Date x = nt_CivilDateDate(d);
+	return nt_Date(x.year, x.month, x.day, 0, 0, c / nt_SECOND, c % nt_SECOND, loc);
+}
+
+static inline void nt_civilPut2(char *b, int v)
+{
+	b[0] = '0' + v/10;
+	b[1] = '0' + v%10;
+}
+
+// civilGet2 returns the value of two decimal digits, or -1.
+static inline int nt_civilGet2(const char *b)
+{
+	unsigned hi = (unsigned char)b[0] - '0';
+	unsigned lo = (unsigned char)b[1] - '0';
+	return hi < 10 && lo < 10 ? (int)(hi*10 + lo) : -1;
+}
+
+// CivilDateFormat writes d to buf as "2006-01-02". Only years 0 to 9999
+// fit; others are written modulo 10000.
+void nt_CivilDateFormat(nt_CivilDate d, char buf[nt_CIVIL_DATE_LEN])
+{
+	struct nt_Date x = nt_CivilDateDate(d);
+	int year = (x.year%10000 + 10000) % 10000;
+	nt_civilPut2(&buf[0], year / 100);
+	nt_civilPut2(&buf[2], year % 100);
+	buf[4] = '-';
+	nt_civilPut2(&buf[5], x.month);
+	buf[7] = '-';
+	nt_civilPut2(&buf[8], x.day);
+}
+
+static char *nt_civilDateParse(nt_CivilDate *d, const char *s, size_t len);
+
+// CivilDateParse parses a date of the form "2006-01-02".
+char *nt_CivilDateParse(nt_CivilDate *d, const char *s, size_t len)
+{
+	char *err = nt_civilDateParse(d, s, len);
+	if (err != NULL) {
+		nt_PROBE3(parse_fail, err, s, len);
+	}
+	return err;
+}
+
+static char *nt_civilDateParse(nt_CivilDate *d, const char *s, size_t len)
+{
+	if (len != nt_CIVIL_DATE_LEN || s[4] != '-' || s[7] != '-') {
+		return "civil: malformed date";
+	}
+	int hi = nt_civilGet2(&s[0]), lo = nt_civilGet2(&s[2]);
+	int month = nt_civilGet2(&s[5]), day = nt_civilGet2(&s[8]);
+	if ((hi | lo | month | day) < 0) {
+		return "civil: malformed date";
+	}
+	int year = hi*100 + lo;
+	if (month < 1 || month > 12 || day < 1 || day > daysIn(month, year)) {
+		return "civil: date field out of range";
+	}
+	*d = nt_civilDays(year, month, day);
+	return NULL;
+}
+
+// CivilDateFormatBatch writes n dates to buf as consecutive
+// nt_CIVIL_DATE_LEN byte fields, with no separators or terminator.
+void nt_CivilDateFormatBatch(const nt_CivilDate *d, size_t n, char *buf, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_civilChunk c = {.kind = nt_chunkCivilDateFormat, .src = d, .dst = buf};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_CivilDate) + nt_CIVIL_DATE_LEN), nt_civilChunk, &c);
+		return;
+	}
+	for (size_t i = 0; i < n; i++) {
+		nt_CivilDateFormat(d[i], &buf[i*nt_CIVIL_DATE_LEN]);
+	}
+}
+
+// CivilDateParseBatch parses n consecutive nt_CIVIL_DATE_LEN byte fields
+// from buf. Fields that do not parse are set to 0, which is 1970-01-01.
+// It returns the number of failures.
+size_t nt_CivilDateParseBatch(const char *buf, size_t n, nt_CivilDate *d, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_civilChunk c = {.kind = nt_chunkCivilDateParse, .src = buf, .dst = d};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_CivilDate) + nt_CIVIL_DATE_LEN), nt_civilChunk, &c);
+		return atomic_load(&c.failed);
+	}
+	size_t failed = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (nt_CivilDateParse(&d[i], &buf[i*nt_CIVIL_DATE_LEN], nt_CIVIL_DATE_LEN) != NULL) {
+			d[i] = 0;
+			failed++;
+		}
+	}
+	return failed;
+}
+
+// CivilTimeOf returns the CivilTime of the given clock reading. Values
+// outside their usual ranges are normalized and wrap around midnight, so
+// 25:00 becomes 01:00.
+nt_CivilTime nt_CivilTimeOf(int hour, int min, int sec, int nsec)
+{
+	int64_t c = ((int64_t)hour*nt_secondsPerHour + (int64_t)min*nt_secondsPerMinute + sec)*nt_SECOND + nsec;
+	int64_t r;
+	nt_floorDiv(c, nt_nanosPerDay, &r);
+	return r;
+}
+
+// CivilTimeFromTime returns the time of day of t in its Location.
+nt_CivilTime nt_CivilTimeFromTime(nt_Time t)
+{
+	return (int64_t)(nt_Time_abs(t) % nt_secondsPerDay)*nt_SECOND + nt_Time_nsec(&t);
+}
+
+// CivilTimeClock returns the hour, minute, and second of c.
+struct nt_Clock nt_CivilTimeClock(nt_CivilTime c)
+{
+	int sec = c / nt_SECOND;
+	return (struct nt_Clock){sec / nt_secondsPerHour, sec / nt_secondsPerMinute % 60, sec % nt_secondsPerMinute};
+}
+
+// CivilTimeAdd returns the time of day d after c, wrapping around
+// midnight.
+nt_CivilTime nt_CivilTimeAdd(nt_CivilTime c, nt_Duration d)
+{
+	int64_t r;
+	nt_floorDiv(c + d%nt_nanosPerDay, nt_nanosPerDay, &r);
+	return r;
+}
+
+// CivilTimeFormat writes c to buf as "15:04:05.000000000".
+void nt_CivilTimeFormat(nt_CivilTime c, char buf[nt_CIVIL_TIME_LEN])
+{
+	struct nt_Clock x = nt_CivilTimeClock(c);
+	nt_civilPut2(&buf[0], x.hour);
+	buf[2] = ':';
+	nt_civilPut2(&buf[3], x.min);
+	buf[5] = ':';
+	nt_civilPut2(&buf[6], x.sec);
+	buf[8] = '.';
+	int nsec = c % nt_SECOND;
+	for (int i = nt_CIVIL_TIME_LEN - 1; i > 8; i--) {
+		buf[i] = '0' + nsec%10;
+		nsec /= 10;
+	}
+}
+
+static char *nt_civilTimeParse(nt_CivilTime *c, const char *s, size_t len);
+
+// CivilTimeParse parses a time of day of the form "15:04:05", optionally
+// followed by a decimal point and one to nine digits of fraction.
+char *nt_CivilTimeParse(nt_CivilTime *c, const char *s, size_t len)
+{
+	char *err = nt_civilTimeParse(c, s, len);
+	if (err != NULL) {
+		nt_PROBE3(parse_fail, err, s, len);
+	}
+	return err;
+}
+
+static char *nt_civilTimeParse(nt_CivilTime *c, const char *s, size_t len)
+{
+	if (len < 8 || len == 9 || len > nt_CIVIL_TIME_LEN || s[2] != ':' || s[5] != ':' || (len > 8 && s[8] != '.')) {
+		return "civil: malformed time";
+	}
+	int hour = nt_civilGet2(&s[0]), min = nt_civilGet2(&s[3]), sec = nt_civilGet2(&s[6]);
+	if ((hour | min | sec) < 0) {
+		return "civil: malformed time";
+	}
+	int64_t nsec = 0;
+	for (size_t i = 9; i < nt_CIVIL_TIME_LEN; i++) {
+		nsec *= 10;
+		if (i < len) {
+			unsigned d = (unsigned char)s[i] - '0';
+			if (d > 9) {
+				return "civil: malformed time";
+			}
+			nsec += d;
+		}
+	}
+	if (hour > 23 || min > 59 || sec > 59) {
+		return "civil: time field out of range";
+	}
+	*c = ((int64_t)hour*nt_secondsPerHour + min*nt_secondsPerMinute + sec)*nt_SECOND + nsec;
+	return NULL;
+}
+
+// CivilTimeFormatBatch writes n times of day to buf as consecutive
+// nt_CIVIL_TIME_LEN byte fields, with no separators or terminator.
+void nt_CivilTimeFormatBatch(const nt_CivilTime *c, size_t n, char *buf, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_civilChunk cc = {.kind = nt_chunkCivilTimeFormat, .src = c, .dst = buf};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_CivilTime) + nt_CIVIL_TIME_LEN), nt_civilChunk, &cc);
+		return;
+	}
+	for (size_t i = 0; i < n; i++) {
+		nt_CivilTimeFormat(c[i], &buf[i*nt_CIVIL_TIME_LEN]);
+	}
+}
+
+// CivilTimeParseBatch parses n consecutive nt_CIVIL_TIME_LEN byte fields
+// from buf. Fields that do not parse are set to 0, which is midnight.
+// It returns the number of failures.
+size_t nt_CivilTimeParseBatch(const char *buf, size_t n, nt_CivilTime *c, nt_Pool *pool)
+{
+	if (pool != NULL) {
+		struct nt_civilChunk cc = {.kind = nt_chunkCivilTimeParse, .src = buf, .dst = c};
+		nt_ParallelFor(pool, n, nt_poolGrain(sizeof(nt_CivilTime) + nt_CIVIL_TIME_LEN), nt_civilChunk, &cc);
+		return atomic_load(&cc.failed);
+	}
+	size_t failed = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (nt_CivilTimeParse(&c[i], &buf[i*nt_CIVIL_TIME_LEN], nt_CIVIL_TIME_LEN) != NULL) {
+			c[i] = 0;
+			failed++;
+		}
+	}
+	return failed;
+}
+
+/*** Time-keyed hash map ***/
+
+// TimeKey returns the Instant of t. Unlike Equal it does not branch on
+// the monotonic bit: the bit is turned into a mask that selects between
+// the seconds packed into wall and those in ext.
+nt_Instant nt_TimeKey(nt_Time t)
+{
+	uint64_t mono = -(t.wall >> 63);
+	int64_t packed = nt_wallToInternal + (int64_t)(t.wall<<1>>(nt_nsecShift+1));
+	int64_t sec = (packed & mono) | (t.ext & ~mono);
+	return (nt_Instant){sec + nt_internalToUnix, t.wall & nt_nsecMask};
+}
+
+// InstantHash returns a well mixed 64-bit hash of k.
+uint64_t nt_InstantHash(nt_Instant k)
+{
+	// The finalizer of MurmurHash3 applied to both words.
+	uint64_t h = (uint64_t)k.sec*0x9E3779B97F4A7C15 ^ (uint32_t)k.nsec;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCD;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53;
+	h ^= h >> 33;
+	return h;
+}
+
+// InstantEqual reports whether a and b are the same instant.
+bool nt_InstantEqual(nt_Instant a, nt_Instant b)
+{
+	return a.sec == b.sec && a.nsec == b.nsec;
+}
+
+// The table uses linear probing with a power of two number of slots,
+// kept at most half full. A slot is empty when its nsec is negative,
+// which no Instant has. Deletion shifts later entries of the probe
+// sequence back, so there are no tombstones.
+//
+// stb_ds's hmput would also do, but it hashes the key's bytes, padding
+// included, so every caller would have to zero a temporary key first,
+// and it keeps keys and slots in separate arrays.
+
+typedef struct {
+	nt_Instant key;
+	uint64_t val;
+} nt_timeMapSlot;
+
+struct nt_TimeMap {
+	size_t len;
+	size_t mask;
+	nt_timeMapSlot *slot;
+};
+
+static nt_timeMapSlot *nt_timeMapAlloc(size_t cap)
+{
+	nt_timeMapSlot *s = malloc(cap * sizeof(*s));
+	if (s == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < cap; i++) {
+		s[i].key.nsec = -1;
+	}
+	return s;
+}
+
+// TimeMapNew returns an empty map sized to hold hint entries without
+// growing, or NULL if out of memory.
+nt_TimeMap *nt_TimeMapNew(size_t hint)
+{
+	size_t cap = 16;
+	while (cap < 2*hint) {
+		cap <<= 1;
+	}
+	nt_TimeMap *m = malloc(sizeof(*m));
+	if (m == NULL) {
+		return NULL;
+	}
+	m->slot = nt_timeMapAlloc(cap);
+	if (m->slot == NULL) {
+		free(m);
+		return NULL;
+	}
+	m->len = 0;
+	m->mask = cap - 1;
+	return m;
+}
+
+// TimeMapFree releases m.
+void nt_TimeMapFree(nt_TimeMap *m)
+{
+	if (m != NULL) {
+		free(m->slot);
+		free(m);
+	}
+}
+
+// TimeMapLen returns the number of entries in m.
+size_t nt_TimeMapLen(nt_TimeMap *m)
+{
+	return m->len;
+}
+
+// timeMapProbe returns the slot holding k, or the empty slot ending its
+// probe sequence.
+static nt_timeMapSlot *nt_timeMapProbe(nt_TimeMap *m, nt_Instant k)
+{
+	size_t i = nt_InstantHash(k) & m->mask;
+	for (;;) {
+		nt_timeMapSlot *s = &m->slot[i];
+		if (s->key.nsec < 0 || nt_InstantEqual(s->key, k)) {
+			return s;
+		}
+		i = (i+1) & m->mask;
+	}
+}
+
+// TimeMapFind returns a pointer to the value stored for t, or NULL if
+// there is none. The pointer is valid until the map is next modified.
+uint64_t *nt_TimeMapFind(nt_TimeMap *m, nt_Time t)
+{
+	nt_timeMapSlot *s = nt_timeMapProbe(m, nt_TimeKey(t));
+	return s->key.nsec < 0 ? NULL : &s->val;
+}
+
+// TimeMapInsert returns a pointer to the value stored for t, first
+// adding an entry with value 0 if there is none. It returns NULL if out
+// of memory. The pointer is valid until the map is next modified.
+uint64_t *nt_TimeMapInsert(nt_TimeMap *m, nt_Time t)
+{
+	nt_Instant k = nt_TimeKey(t);
+	nt_timeMapSlot *s = nt_timeMapProbe(m, k);
+	if (s->key.nsec >= 0) {
+		return &s->val;
+	}
+	if (2*(m->len+1) > m->mask+1) {
+		size_t cap = 2*(m->mask+1);
+		nt_timeMapSlot *old = m->slot, *slot = nt_timeMapAlloc(cap);
+		if (slot == NULL) {
+			return NULL;
+		}
+		m->slot = slot;
+		m->mask = cap - 1;
+		for (size_t i = 0; i < cap/2; i++) {
+			if (old[i].key.nsec >= 0) {
+				*nt_timeMapProbe(m, old[i].key) = old[i];
+			}
+		}
+		free(old);
+		s = nt_timeMapProbe(m, k);
+	}
+	m->len++;
+	s->key = k;
+	s->val = 0;
+	return &s->val;
+}
+
+// TimeMapDelete removes the entry for t, reporting whether there was one.
+bool nt_TimeMapDelete(nt_TimeMap *m, nt_Time t)
+{
+	nt_timeMapSlot *s = nt_timeMapProbe(m, nt_TimeKey(t));
+	if (s->key.nsec < 0) {
+		return false;
+	}
+	size_t hole = s - m->slot;
+	for (size_t i = (hole+1) & m->mask; m->slot[i].key.nsec >= 0; i = (i+1) & m->mask) {
+		// Move the entry at i back into the hole unless its home slot
+		// lies cyclically in (hole, i].
+		size_t home = nt_InstantHash(m->slot[i].key) & m->mask;
+		if (((i - home) & m->mask) >= ((i - hole) & m->mask)) {
+			m->slot[hole] = m->slot[i];
+			hole = i;
+		}
+	}
+	m->slot[hole].key.nsec = -1;
+	m->len--;
+	return true;
+}
+
+// TimeMapNext advances the iterator *iter, which should start at 0, to
+// the next entry of m, storing its key and a pointer to its value. It
+// returns false when there are no more entries. The order is arbitrary.
+bool nt_TimeMapNext(nt_TimeMap *m, size_t *iter, nt_Instant *key, uint64_t **val)
+{
+	for (size_t i = *iter; i <= m->mask; i++) {
+		if (m->slot[i].key.nsec >= 0) {
+			*key = m->slot[i].key;
+			*val = &m->slot[i].val;
+			*iter = i + 1;
+			return true;
+		}
+	}
+	*iter = m->mask + 1;
+	return false;
+}
+
+/*** Interval join ***/
+
+// An IntervalJoin pairs the events of a left and a right stream that
+// share a key and lie within a Duration of each other. Each side must be
+// pushed in time order, but the two sides may be interleaved freely.
+//
+// Events are spread over partitions by key. Each partition holds one
+// time-ordered ring per side. A new event first evicts, from the head of
+// both rings, events that no future event can reach, then takes the
+// run of the other side's ring that is within range as its matches, and
+// finally joins the tail of its own side's ring. A pair is therefore
+// emitted exactly once, when the later of its two events arrives.
+
+typedef struct {
+	nt_JoinEvent *ev;
+	size_t head, len, mask;
+} nt_joinRing;
+
+struct nt_IntervalJoin {
+	int64_t within;
+	int64_t watermark[2]; // the time of the latest event on each side
+	nt_JoinFunc emit;
+	void *ctx;
+	size_t buffered;
+	unsigned shift;       // partition of key is its hash >> shift
+	size_t partitions;
+	nt_joinRing *ring;    // partitions pairs of left and right rings
+};
+
+static inline nt_JoinEvent *nt_joinRingAt(nt_joinRing *r, size_t i)
+{
+	return &r->ev[(r->head + i) & r->mask];
+}
+
+static bool nt_joinRingPush(nt_joinRing *r, const nt_JoinEvent *e)
+{
+	if (r->ev == NULL || r->len > r->mask) {
+		size_t cap = r->ev == NULL ? 16 : 2*(r->mask+1);
+		nt_JoinEvent *ev = malloc(cap * sizeof(*ev));
+		if (ev == NULL) {
+			return false;
+		}
+		for (size_t i = 0; i < r->len; i++) {
+			ev[i] = *nt_joinRingAt(r, i);
+		}
+		free(r->ev);
+		r->ev = ev;
+		r->head = 0;
+		r->mask = cap - 1;
+	}
+	r->ev[(r->head + r->len) & r->mask] = *e;
+	r->len++;
+	return true;
+}
+
+// joinRingEvict drops the events of r before t.
+static void nt_joinRingEvict(nt_IntervalJoin *j, nt_joinRing *r, int64_t t)
+{
+	while (r->len > 0 && r->ev[r->head].when < t) {
+		r->head = (r->head+1) & r->mask;
+		r->len--;
+		j->buffered--;
+	}
+}
+
+// joinEvictLimit returns the time before which events of side can no
+// longer match, given the other side's watermark.
+static inline int64_t nt_joinEvictLimit(nt_IntervalJoin *j, nt_JoinSide side)
+{
+	int64_t w = j->watermark[!side];
+	return w < INT64_MIN + j->within ? INT64_MIN : w - j->within;
+}
+
+// IntervalJoinNew returns a join that calls emit(ctx, left, right) for
+// every left and right event with equal keys and times at most within
+// apart. Keys are spread over partitions rings per side, rounded up to a
+// power of two; more partitions mean fewer events of other keys scanned
+// per match. It returns NULL if out of memory.
+nt_IntervalJoin *nt_IntervalJoinNew(nt_Duration within, size_t partitions, nt_JoinFunc emit, void *ctx)
+{
+	if (within < 0) {
+		nt_panic("time: negative window in call to IntervalJoinNew\n");
+	}
+	unsigned bits = 0;
+	while (((size_t)1 << bits) < partitions) {
+		bits++;
+	}
+	nt_IntervalJoin *j = calloc(1, sizeof(*j));
+	if (j == NULL) {
+		return NULL;
+	}
+	j->partitions = (size_t)1 << bits;
+	j->ring = calloc(2*j->partitions, sizeof(nt_joinRing));
+	if (j->ring == NULL) {
+		free(j);
+		return NULL;
+	}
+	j->within = within;
+	j->watermark[nt_JOIN_LEFT] = j->watermark[nt_JOIN_RIGHT] = INT64_MIN;
+	j->emit = emit;
+	j->ctx = ctx;
+	j->shift = 64 - bits;
+	return j;
+}
+
+// IntervalJoinFree releases j.
+void nt_IntervalJoinFree(nt_IntervalJoin *j)
+{
+	if (j == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < 2*j->partitions; i++) {
+		free(j->ring[i].ev);
+	}
+	free(j->ring);
+	free(j);
+}
+
+// IntervalJoinPush adds n events to one side of j, emitting the pairs
+// they complete. The events must not be earlier than those pushed to the
+// same side before. On error the events from the offending one on are
+// not added.
+char *nt_IntervalJoinPush(nt_IntervalJoin *j, nt_JoinSide side, const nt_JoinEvent *ev, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		const nt_JoinEvent *e = &ev[i];
+		if (e->when < j->watermark[side]) {
+			return "join: events out of order";
+		}
+		j->watermark[side] = e->when;
+
+		// Fibonacci hashing; a shift of 64 would be undefined.
+		size_t p = j->shift == 64 ? 0 : (e->key * UINT64_C(0x9E3779B97F4A7C15)) >> j->shift;
+		nt_joinRing *own = &j->ring[2*p + side], *other = &j->ring[2*p + !side];
+		nt_joinRingEvict(j, own, nt_joinEvictLimit(j, side));
+		nt_joinRingEvict(j, other, nt_joinEvictLimit(j, !side));
+
+		// What remains of other starts no earlier than e->when - within.
+		int64_t end = e->when > INT64_MAX - j->within ? INT64_MAX : e->when + j->within;
+		for (size_t k = 0; k < other->len; k++) {
+			nt_JoinEvent *o = nt_joinRingAt(other, k);
+			if (o->when > end) {
+				break;
+			}
+			if (o->key == e->key) {
+				if (side == nt_JOIN_LEFT) {
+					j->emit(j->ctx, e, o);
+				} else {
+					j->emit(j->ctx, o, e);
+				}
+			}
+		}
+		if (!nt_joinRingPush(own, e)) {
+			return "join: out of memory";
+		}
+		j->buffered++;
+	}
+	return NULL;
+}
+
+// IntervalJoinEvict drops, from every partition, the buffered events
+// that can no longer match. Pushes only evict from the partition they
+// touch, so a long-running join over many keys should call this
+// periodically to bound its memory.
+void nt_IntervalJoinEvict(nt_IntervalJoin *j)
+{
+	int64_t limit[2] = {nt_joinEvictLimit(j, nt_JOIN_LEFT), nt_joinEvictLimit(j, nt_JOIN_RIGHT)};
+	for (size_t i = 0; i < 2*j->partitions; i++) {
+		nt_joinRingEvict(j, &j->ring[i], limit[i & 1]);
+	}
+}
+
+// IntervalJoinBuffered returns the number of events j holds.
+size_t nt_IntervalJoinBuffered(nt_IntervalJoin *j)
+{
+	return j->buffered;
+}
+
+/*** As-of join ***/
+
+// gallopTime returns the first i in [lo, hi) with a[i] > x, or hi. It
+// probes lo+1, lo+3, lo+7, ... before bisecting the last step, so the
+// cost is logarithmic in the distance moved rather than in hi-lo.
+static size_t nt_gallopTime(const int64_t *a, size_t lo, size_t hi, int64_t x)
+{
+	size_t step = 1;
+	while (lo < hi && a[lo] <= x) {
+		size_t next = lo + step;
+		if (next >= hi || a[next] > x) {
+			hi = next < hi ? next : hi;
+			lo++;
+			while (lo < hi) {
+				size_t m = lo + (hi-lo)/2;
+				if (a[m] <= x) {
+					lo = m + 1;
+				} else {
+					hi = m;
+				}
+			}
+			return lo;
+		}
+		lo = next + 1;
+		step *= 2;
+	}
+	return lo;
+}
+
+// gallopKey is gallopTime over keys, finding the first k[i] >= key, or
+// with strict, the first k[i] > key.
+static size_t nt_gallopKey(const uint64_t *k, size_t lo, size_t hi, uint64_t key, bool strict)
+{
+	size_t step = 1;
+	while (lo < hi && (strict ? k[lo] <= key : k[lo] < key)) {
+		size_t next = lo + step;
+		if (next >= hi || (strict ? k[next] > key : k[next] >= key)) {
+			hi = next < hi ? next : hi;
+			lo++;
+			while (lo < hi) {
+				size_t m = lo + (hi-lo)/2;
+				if (strict ? k[m] <= key : k[m] < key) {
+					lo = m + 1;
+				} else {
+					hi = m;
+				}
+			}
+			return lo;
+		}
+		lo = next + 1;
+		step *= 2;
+	}
+	return lo;
+}
+
+struct nt_asofJoin {
+	const uint64_t *lkey, *rkey;
+	const int64_t *left, *right;
+	size_t nr;
+	int64_t tolerance;
+	ptrdiff_t *out;
+};
+
+// asofRange joins left[lo:hi]. Each key group of left is matched against
+// the right group with the same key, both cursors only moving forward.
+static void nt_asofRange(void *ctx, size_t lo, size_t hi)
+{
+	struct nt_asofJoin *c = ctx;
+	size_t r = 0;
+	for (size_t i = lo; i < hi; ) {
+		size_t end = hi, rlo = 0, rhi = c->nr;
+		if (c->lkey != NULL) {
+			uint64_t key = c->lkey[i];
+			end = nt_gallopKey(c->lkey, i, hi, key, true);
+			rlo = nt_gallopKey(c->rkey, r, c->nr, key, false);
+			rhi = nt_gallopKey(c->rkey, rlo, c->nr, key, true);
+		}
+		// r is the first right element of the group after left[i].
+		r = rlo;
+		for (; i < end; i++) {
+			r = nt_gallopTime(c->right, r, rhi, c->left[i]);
+			ptrdiff_t m = -1;
+			if (r > rlo && (c->tolerance < 0 || c->left[i] - c->right[r-1] <= c->tolerance)) {
+				m = r - 1;
+			}
+			c->out[i] = m;
+		}
+		r = rhi;
+	}
+}
+
+// AsofJoin finds, for each left[i], the latest right[j] at or before
+// it, storing j in out[i], or -1 if there is none. With a non-negative
+// tolerance, matches more than tolerance before left[i] are dropped too.
+//
+// If lkey and rkey are not NULL, left and right are grouped by key and
+// only elements with equal keys match: each array must be sorted by key
+// and then by time. Otherwise each must be sorted by time. Times are in
+// any single unit, such as Unix nanoseconds.
+//
+// With a Pool, left is split into chunks that are joined in parallel,
+// each first galloping to its place in right.
+void nt_AsofJoin(const uint64_t *lkey, const int64_t *left, size_t nl,
+                 const uint64_t *rkey, const int64_t *right, size_t nr,
+                 nt_Duration tolerance, ptrdiff_t *out, nt_Pool *pool)
+{
+	if ((lkey == NULL) != (rkey == NULL)) {
+		nt_panic("time: AsofJoin needs keys for both sides or neither\n");
+	}
+	struct nt_asofJoin c = {lkey, rkey, left, right, nr, tolerance, out};
+	if (pool != NULL) {
+		nt_ParallelFor(pool, nl, nt_poolGrain(sizeof(int64_t) + sizeof(uint64_t) + sizeof(ptrdiff_t)), nt_asofRange, &c);
+		return;
+	}
+	nt_asofRange(&c, 0, nl);
+}
+
+/*** Resampling ***/
+
+// Both resampling passes walk the points and the grid together, so no
+// point's grid cell is ever found by division. The fill pass finds how
+// many grid times fall before the next point with one division per run
+// and then fills the run with a loop of known length; the aggregate pass
+// gallops to the end of each cell and folds the points in it. The inner
+// loops are branch free so the compiler can vectorize them.
+
+// resampleFill implements nt_RESAMPLE_FFILL and nt_RESAMPLE_LINEAR.
+static void nt_resampleFill(const int64_t *when, const double *val, size_t n,
+	int64_t start, int64_t step, size_t count, bool linear, double *out)
+{
+	size_t i = 0;
+	for (size_t k = 0; k < count; ) {
+		int64_t g = start + (int64_t)k*step;
+		// Points before i are at or before g.
+		i = nt_gallopTime(when, i, n, g);
+		size_t m = count - k;
+		if (i < n) {
+			uint64_t cells = ((uint64_t)(when[i] - g) + step - 1) / step;
+			if (cells < m) {
+				m = cells;
+			}
+		}
+		double *o = &out[k];
+		if (i == 0) {
+			for (size_t j = 0; j < m; j++) {
+				o[j] = NAN;
+			}
+		} else if (!linear) {
+			double v = val[i-1];
+			for (size_t j = 0; j < m; j++) {
+				o[j] = v;
+			}
+		} else if (i == n) {
+			// After the last point only a grid time on it has a value.
+			for (size_t j = 0; j < m; j++) {
+				o[j] = NAN;
+			}
+			if (g == when[n-1]) {
+				o[0] = val[n-1];
+			}
+		} else {
+			double y = val[i-1];
+			double slope = (val[i] - y) / (double)(when[i] - when[i-1]);
+			double d = (double)(g - when[i-1]), ds = (double)step;
+			for (size_t j = 0; j < m; j++) {
+				o[j] = y + slope*(d + ds*(double)j);
+			}
+		}
+		k += m;
+	}
+}
+
+// resampleAggregate implements the aggregate modes.
+static void nt_resampleAggregate(const int64_t *when, const double *val, size_t n,
+	int64_t start, int64_t step, size_t count, nt_ResampleMode mode, double *out)
+{
+	size_t i = start == INT64_MIN ? 0 : nt_gallopTime(when, 0, n, start - 1);
+	for (size_t k = 0; k < count; k++) {
+		int64_t end = start + (int64_t)(k+1)*step;
+		size_t e = nt_gallopTime(when, i, n, end - 1);
+		double sum = 0, min = INFINITY, max = -INFINITY;
+		for (size_t j = i; j < e; j++) {
+			double v = val[j];
+			sum += v;
+			min = v < min ? v : min;
+			max = v > max ? v : max;
+		}
+		size_t c = e - i;
+		double r;
+		switch (mode) {
+		case nt_RESAMPLE_MEAN:
+			r = c > 0 ? sum / c : NAN;
+			break;
+		case nt_RESAMPLE_SUM:
+			r = sum;
+			break;
+		case nt_RESAMPLE_MIN:
+			r = c > 0 ? min : NAN;
+			break;
+		case nt_RESAMPLE_MAX:
+			r = c > 0 ? max : NAN;
+			break;
+		default:
+			r = c;
+			break;
+		}
+		out[k] = r;
+		i = e;
+	}
+}
+
+// Resample maps the n points (when[i], val[i]), sorted by time, onto the
+// count grid times start, start+step, ..., writing one value per grid
+// time to out in a single pass. Times are Unix nanoseconds, or any unit
+// that step is given in.
+//
+// Grid times with no value are NaN: those before the first point when
+// forward filling, those outside the points when interpolating, and
+// empty cells for MEAN, MIN and MAX. SUM and COUNT of an empty cell are
+// 0.
+void nt_Resample(const int64_t *when, const double *val, size_t n,
+                 int64_t start, nt_Duration step, size_t count,
+                 nt_ResampleMode mode, double *out)
+{
+	if (step <= 0) {
+		nt_panic("time: non-positive step in call to Resample\n");
+	}
+	switch (mode) {
+	case nt_RESAMPLE_FFILL:
+	case nt_RESAMPLE_LINEAR:
+		nt_resampleFill(when, val, n, start, step, count, mode == nt_RESAMPLE_LINEAR, out);
+		break;
+	default:
+		nt_resampleAggregate(when, val, n, start, step, count, mode, out);
+		break;
+	}
+}
+
+/*** Delay queue ***/
+
+// A DelayQueue keeps jobs in a memory-mapped file until their deadlines.
+// It is laid out like the slots of a timing wheel: time is cut into
+// buckets of a fixed width, and each bucket owns a chain of fixed-size
+// segments that its jobs are appended to. A push is an append to the
+// tail segment of its bucket; a pop takes jobs from the earliest bucket
+// that has started, found with a heap of buckets.
+//
+// The file is a header block followed by segments of segSize bytes,
+// each a header and an array of records. Segment headers and records
+// carry checksums, and a record's covers the sequence number of its
+// segment, so neither a torn write nor a record left over from an
+// earlier use of the segment is mistaken for a job. Reopening the file
+// reads only the segment headers, then checks each tail for records
+// appended after the header was last written back.
+//
+// Durability is explicit: Sync writes everything out. A crash can lose
+// jobs pushed since the last Sync, and can deliver again jobs popped
+// since then. A DelayQueue is not safe for concurrent use.
+
+#define nt_DQ_MAGIC "NTDELAYQ"
+
+enum {
+	nt_dqFree,
+	nt_dqUsed = 0x5345474D, // "SEGM"
+};
+
+struct nt_dqHeader {
+	char magic[8];
+	uint32_t order;   // 0x01020304 in the writer's byte order
+	uint32_t segSize;
+	int64_t width;
+};
+
+typedef struct {
+	uint32_t state;
+	uint32_t count;   // records appended
+	uint32_t popped;  // records done; only a hint after reopening
+	uint32_t sum;     // over state, bucket and seq
+	int64_t bucket;
+	uint64_t seq;     // allocation order, unique over the file's life
+} nt_dqSegment;
+
+typedef struct {
+	int64_t deadline;
+	uint64_t id;
+	uint64_t data;
+	uint32_t sum;     // over the job and the segment's seq
+	uint32_t done;
+} nt_dqRecord;
+
+typedef struct {
+	int64_t bucket;
+	uint32_t *seg;    // segment numbers in append order
+	size_t len, cap;
+	size_t cursorSeg; // records before the cursor are all done
+	uint32_t cursorRec;
+	size_t scanSeg;   // where the last pop left off; records between
+	uint32_t scanRec; // the cursor and here are done or not due
+	int64_t minWait;  // before the earliest of those deadlines
+	size_t heapIndex;
+} nt_dqBucket;
+
+struct nt_DelayQueue {
+	int fd;
+	char *base;
+	size_t size;
+	size_t segSize;
+	uint32_t perSeg;
+	int64_t width;
+	uint64_t seq;
+	size_t len;
+	uint32_t *free;
+	size_t freeLen;
+	nt_dqBucket *b;
+	size_t bLen, bCap;
+	size_t *heap;     // indexes into b, ordered by bucket
+	nt_TimeMap *index; // bucket, as Unix seconds, to its index in b plus one
+};
+
+static uint32_t nt_dqSum(uint64_t a, uint64_t b, uint64_t c, uint64_t d)
+{
+	uint64_t h = 0x9E3779B97F4A7C15;
+	h = (h ^ a) * 0xFF51AFD7ED558CCD;
+	h = (h ^ (h >> 32) ^ b) * 0xC4CEB9FE1A85EC53;
+	h = (h ^ (h >> 32) ^ c) * 0xFF51AFD7ED558CCD;
+	h = (h ^ (h >> 32) ^ d) * 0xC4CEB9FE1A85EC53;
+	h ^= h >> 32;
+	// Zeroed space must never check out.
+	return (uint32_t)h ? (uint32_t)h : 1;
+}
+
+static inline nt_dqSegment *nt_dqSeg(nt_DelayQueue *q, uint32_t i)
+{
+	return (nt_dqSegment *)(q->base + q->segSize*((size_t)i + 1));
+}
+
+static inline nt_dqRecord *nt_dqRec(nt_dqSegment *h, uint32_t r)
+{
+	return (nt_dqRecord *)(h + 1) + r;
+}
+
+static inline uint32_t nt_dqSegSum(const nt_dqSegment *h)
+{
+	return nt_dqSum(h->state, h->bucket, h->seq, 0);
+}
+
+static inline bool nt_dqRecValid(const nt_dqRecord *r, const nt_dqSegment *h)
+{
+	return r->sum == nt_dqSum(r->deadline, r->id, r->data, h->seq);
+}
+
+static bool nt_dqHeapLess(nt_DelayQueue *q, size_t i, size_t j)
+{
+	return q->b[q->heap[i]].bucket < q->b[q->heap[j]].bucket;
+}
+
+static void nt_dqHeapSwap(nt_DelayQueue *q, size_t i, size_t j)
+{
+	size_t t = q->heap[i];
+	q->heap[i] = q->heap[j];
+	q->heap[j] = t;
+	q->b[q->heap[i]].heapIndex = i;
+	q->b[q->heap[j]].heapIndex = j;
+}
+
+static void nt_dqHeapUp(nt_DelayQueue *q, size_t i)
+{
+	while (i > 0 && nt_dqHeapLess(q, i, (i-1)/2)) {
+		nt_dqHeapSwap(q, i, (i-1)/2);
+		i = (i-1)/2;
+	}
+}
+
+static void nt_dqHeapDown(nt_DelayQueue *q, size_t i)
+{
+	for (;;) {
+		size_t m = i, l = 2*i + 1, r = 2*i + 2;
+		if (l < q->bLen && nt_dqHeapLess(q, l, m)) {
+			m = l;
+		}
+		if (r < q->bLen && nt_dqHeapLess(q, r, m)) {
+			m = r;
+		}
+		if (m == i) {
+			return;
+		}
+		nt_dqHeapSwap(q, i, m);
+		i = m;
+	}
+}
+
+// dqFindBucket returns the index in q->b of bucket, adding it if need be,
+// or -1 if out of memory.
+static ptrdiff_t nt_dqFindBucket(nt_DelayQueue *q, int64_t bucket)
+{
+	uint64_t *slot = nt_TimeMapInsert(q->index, nt_Unix(bucket, 0));
+	if (slot == NULL) {
+		return -1;
+	}
+	if (*slot != 0) {
+		return *slot - 1;
+	}
+	if (q->bLen == q->bCap) {
+		size_t cap = q->bCap ? 2*q->bCap : 64;
+		nt_dqBucket *b = realloc(q->b, cap * sizeof(*b));
+		size_t *heap = b ? realloc(q->heap, cap * sizeof(*heap)) : NULL;
+		if (b != NULL) {
+			q->b = b;
+		}
+		if (heap == NULL) {
+			nt_TimeMapDelete(q->index, nt_Unix(bucket, 0));
+			return -1;
+		}
+		q->heap = heap;
+		q->bCap = cap;
+	}
+	size_t k = q->bLen++;
+	q->b[k] = (nt_dqBucket){.bucket = bucket, .minWait = INT64_MAX, .heapIndex = k};
+	q->heap[k] = k;
+	nt_dqHeapUp(q, k);
+	*slot = k + 1;
+	return k;
+}
+
+// dqRemoveBucket frees the segments of the bucket at the top of the heap
+// and forgets it.
+static void nt_dqRemoveBucket(nt_DelayQueue *q)
+{
+	size_t k = q->heap[0];
+	nt_dqBucket *e = &q->b[k];
+	for (size_t i = 0; i < e->len; i++) {
+		nt_dqSeg(q, e->seg[i])->state = nt_dqFree;
+		q->free[q->freeLen++] = e->seg[i];
+	}
+	free(e->seg);
+	nt_TimeMapDelete(q->index, nt_Unix(e->bucket, 0));
+
+	size_t last = --q->bLen;
+	if (last > 0) {
+		nt_dqHeapSwap(q, 0, last);
+		nt_dqHeapDown(q, 0);
+	}
+	if (k != last) {
+		q->b[k] = q->b[last];
+		q->heap[q->b[k].heapIndex] = k;
+		*nt_TimeMapFind(q->index, nt_Unix(q->b[k].bucket, 0)) = k + 1;
+	}
+}
+
+// dqAppendSeg adds seg to the chain of bucket k.
+static bool nt_dqAppendSeg(nt_DelayQueue *q, size_t k, uint32_t seg)
+{
+	nt_dqBucket *e = &q->b[k];
+	if (e->len == e->cap) {
+		size_t cap = e->cap ? 2*e->cap : 4;
+		uint32_t *s = realloc(e->seg, cap * sizeof(*s));
+		if (s == NULL) {
+			return false;
+		}
+		e->seg = s;
+		e->cap = cap;
+	}
+	e->seg[e->len++] = seg;
+	return true;
+}
+
+// dqGrow doubles the number of segments in the file.
+static char *nt_dqGrow(nt_DelayQueue *q)
+{
+	size_t nsegs = q->size/q->segSize - 1;
+	size_t add = nsegs < 16 ? 16 : nsegs;
+	if (nsegs + add > UINT32_MAX) {
+		return "time: delay queue file full";
+	}
+	uint32_t *fl = realloc(q->free, (nsegs + add) * sizeof(*fl));
+	if (fl == NULL) {
+		return "time: out of memory";
+	}
+	q->free = fl;
+	size_t size = q->size + add*q->segSize;
+	if (ftruncate(q->fd, size) != 0) {
+		return "time: cannot grow delay queue file";
+	}
+	char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+	if (base == MAP_FAILED) {
+		return "time: cannot map delay queue file";
+	}
+	munmap(q->base, q->size);
+	q->base = base;
+	q->size = size;
+	// Hand out the lowest numbered segments first.
+	for (size_t i = nsegs + add; i-- > nsegs; ) {
+		q->free[q->freeLen++] = i;
+	}
+	return NULL;
+}
+
+struct nt_dqUsed {
+	int64_t bucket;
+	uint64_t seq;
+	uint32_t seg;
+};
+
+static int nt_dqUsedCompare(const void *a, const void *b)
+{
+	const struct nt_dqUsed *x = a, *y = b;
+	if (x->bucket != y->bucket) {
+		return x->bucket < y->bucket ? -1 : 1;
+	}
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// dqRecover rebuilds the in-memory state of q from its segment headers.
+static char *nt_dqRecover(nt_DelayQueue *q)
+{
+	size_t nsegs = q->size/q->segSize - 1;
+	q->free = malloc((nsegs ? nsegs : 1) * sizeof(*q->free));
+	struct nt_dqUsed *used = malloc((nsegs ? nsegs : 1) * sizeof(*used));
+	if (q->free == NULL || used == NULL) {
+		free(used);
+		return "time: out of memory";
+	}
+	size_t n = 0;
+	for (size_t i = nsegs; i-- > 0; ) {
+		nt_dqSegment *h = nt_dqSeg(q, i);
+		if (h->state != nt_dqUsed || h->sum != nt_dqSegSum(h)) {
+			h->state = nt_dqFree;
+			q->free[q->freeLen++] = i;
+			continue;
+		}
+		// Take in records appended after the count was written back.
+		uint32_t count = h->count < q->perSeg ? h->count : q->perSeg;
+		while (count < q->perSeg && nt_dqRecValid(nt_dqRec(h, count), h)) {
+			count++;
+		}
+		h->count = count;
+		if (h->popped > count) {
+			h->popped = count;
+		}
+		q->len += count - h->popped;
+		if (h->seq >= q->seq) {
+			q->seq = h->seq + 1;
+		}
+		used[n++] = (struct nt_dqUsed){h->bucket, h->seq, i};
+	}
+	qsort(used, n, sizeof(*used), nt_dqUsedCompare);
+	for (size_t i = 0; i < n; i++) {
+		ptrdiff_t k = nt_dqFindBucket(q, used[i].bucket);
+		if (k < 0 || !nt_dqAppendSeg(q, k, used[i].seg)) {
+			free(used);
+			return "time: out of memory";
+		}
+	}
+	free(used);
+	return NULL;
+}
+
+// DelayQueueOpen opens the delay queue file at path, creating it if it
+// does not exist. A new file gets buckets of the given width and
+// segments of segmentSize bytes, a power of two of at least 4096; an
+// existing file keeps its own.
+struct nt_DelayQueueOpen nt_DelayQueueOpen(const char *path, nt_Duration width, size_t segmentSize)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return (struct nt_DelayQueueOpen){NULL, "time: cannot open delay queue file"};
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return (struct nt_DelayQueueOpen){NULL, "time: cannot open delay queue file"};
+	}
+	struct nt_dqHeader h;
+	if (st.st_size == 0) {
+		if (width <= 0 || segmentSize < 4096 || segmentSize > (1u << 30) || (segmentSize & (segmentSize-1)) != 0) {
+			close(fd);
+			return (struct nt_DelayQueueOpen){NULL, "time: bad delay queue parameters"};
+		}
+		h = (struct nt_dqHeader){nt_DQ_MAGIC, 0x01020304, segmentSize, width};
+		if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h) || ftruncate(fd, segmentSize) != 0) {
+			close(fd);
+			return (struct nt_DelayQueueOpen){NULL, "time: cannot create delay queue file"};
+		}
+		st.st_size = segmentSize;
+	} else if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || memcmp(h.magic, nt_DQ_MAGIC, sizeof(h.magic)) != 0 ||
+			h.order != 0x01020304 || h.width <= 0 || h.segSize < 4096 || (h.segSize & (h.segSize-1)) != 0 ||
+			st.st_size % h.segSize != 0) {
+		close(fd);
+		return (struct nt_DelayQueueOpen){NULL, "time: malformed delay queue file"};
+	}
+
+	nt_DelayQueue *q = calloc(1, sizeof(*q));
+	nt_TimeMap *index = nt_TimeMapNew(0);
+	char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (q == NULL || index == NULL || base == MAP_FAILED) {
+		free(q);
+		nt_TimeMapFree(index);
+		if (base != MAP_FAILED) {
+			munmap(base, st.st_size);
+		}
+		close(fd);
+		return (struct nt_DelayQueueOpen){NULL, "time: cannot map delay queue file"};
+	}
+	q->fd = fd;
+	q->base = base;
+	q->size = st.st_size;
+	q->segSize = h.segSize;
+	q->perSeg = h.segSize/sizeof(nt_dqRecord) - 1;
+	q->width = h.width;
+	q->index = index;
+	char *err = nt_dqRecover(q);
+	if (err != NULL) {
+		nt_DelayQueueClose(q);
+		return (struct nt_DelayQueueOpen){NULL, err};
+	}
+	return (struct nt_DelayQueueOpen){q, NULL};
+}
+
+// DelayQueueClose releases q. It does not Sync.
+void nt_DelayQueueClose(nt_DelayQueue *q)
+{
+	if (q == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < q->bLen; i++) {
+		free(q->b[i].seg);
+	}
+	free(q->b);
+	free(q->heap);
+	free(q->free);
+	nt_TimeMapFree(q->index);
+	munmap(q->base, q->size);
+	close(q->fd);
+	free(q);
+}
+
+// DelayQueuePush adds job to q.
+char *nt_DelayQueuePush(nt_DelayQueue *q, nt_DelayJob job)
+{
+	int64_t rem;
+	ptrdiff_t k = nt_dqFindBucket(q, nt_floorDiv(job.deadline, q->width, &rem));
+	if (k < 0) {
+		return "time: out of memory";
+	}
+	nt_dqBucket *e = &q->b[k];
+	nt_dqSegment *h = e->len > 0 ? nt_dqSeg(q, e->seg[e->len-1]) : NULL;
+	if (h == NULL || h->count == q->perSeg) {
+		if (q->freeLen == 0) {
+			char *err = nt_dqGrow(q);
+			if (err != NULL) {
+				return err;
+			}
+		}
+		uint32_t seg = q->free[q->freeLen-1];
+		if (!nt_dqAppendSeg(q, k, seg)) {
+			return "time: out of memory";
+		}
+		q->freeLen--;
+		h = nt_dqSeg(q, seg);
+		h->count = 0;
+		h->popped = 0;
+		h->bucket = q->b[k].bucket;
+		h->seq = q->seq++;
+		h->state = nt_dqUsed;
+		h->sum = nt_dqSegSum(h);
+	}
+	nt_dqRecord *r = nt_dqRec(h, h->count);
+	r->deadline = job.deadline;
+	r->id = job.id;
+	r->data = job.data;
+	r->done = 0;
+	r->sum = nt_dqSum(job.deadline, job.id, job.data, h->seq);
+	h->count++;
+	q->len++;
+	return NULL;
+}
+
+// DelayQueuePop removes from q a job whose deadline is at or before now,
+// reporting whether there was one. Jobs come out in bucket order, and in
+// push order within a bucket, so deadlines are ordered to within the
+// bucket width.
+bool nt_DelayQueuePop(nt_DelayQueue *q, int64_t now, nt_DelayJob *job)
+{
+	int64_t rem;
+	int64_t nowBucket = nt_floorDiv(now, q->width, &rem);
+	while (q->bLen > 0) {
+		nt_dqBucket *e = &q->b[q->heap[0]];
+		if (e->bucket > nowBucket) {
+			return false;
+		}
+		// Records before the first one that is not done are skipped
+		// for good by moving the cursor past them. Records that were
+		// not due are only looked at again once now reaches one of them.
+		size_t si = e->scanSeg;
+		uint32_t r = e->scanRec;
+		if (now >= e->minWait) {
+			si = e->cursorSeg;
+			r = e->cursorRec;
+			e->minWait = INT64_MAX;
+		}
+		bool front = si == e->cursorSeg && r == e->cursorRec;
+		for (; si < e->len; si++, r = 0) {
+			nt_dqSegment *h = nt_dqSeg(q, e->seg[si]);
+			for (; r < h->count; r++) {
+				nt_dqRecord *rec = nt_dqRec(h, r);
+				bool due = !rec->done && nt_dqRecValid(rec, h);
+				if (due && rec->deadline > now) {
+					if (rec->deadline < e->minWait) {
+						e->minWait = rec->deadline;
+					}
+					front = false;
+					continue;
+				}
+				if (front) {
+					e->cursorSeg = si;
+					e->cursorRec = r + 1;
+				}
+				if (due) {
+					*job = (nt_DelayJob){rec->deadline, rec->id, rec->data};
+					rec->done = 1;
+					h->popped++;
+					q->len--;
+					e->scanSeg = si;
+					e->scanRec = r + 1;
+					return true;
+				}
+			}
+		}
+		// Resume after the last segment's records next time.
+		if (e->len > 0) {
+			e->scanSeg = e->len - 1;
+			e->scanRec = nt_dqSeg(q, e->seg[e->len-1])->count;
+		}
+		if (!front) {
+			return false;
+		}
+		nt_dqRemoveBucket(q);
+	}
+	return false;
+}
+
+// DelayQueueSync writes the state of q out to its file.
+char *nt_DelayQueueSync(nt_DelayQueue *q)
+{
+	if (msync(q->base, q->size, MS_SYNC) != 0) {
+		return "time: cannot sync delay queue file";
+	}
+	return NULL;
+}
+
+// DelayQueueLen returns the number of jobs in q. After reopening a file
+// it may count jobs whose pops were not synced.
+size_t nt_DelayQueueLen(nt_DelayQueue *q)
+{
+	return q->len;
+}
+
+/*** Deadline queue ***/
+
+// A DeadlineQueue hands items from any number of producer threads to one
+// consumer, which receives each at its deadline.
+//
+// Producers push onto a lock-free intake stack. The consumer moves the
+// whole stack into a pairing heap, which it alone touches, each time it
+// looks for work. While it sleeps it publishes the time it will wake at;
+// a producer only makes a system call when its item is due before then,
+// and at most one producer makes it for each sleep. Sleeping and waking
+// use a futex on Linux; elsewhere the consumer sleeps in short slices.
+
+struct nt_DeadlineQueue {
+	_Atomic(nt_DeadlineItem *) head;
+	_Atomic int64_t sleepUntil; // the consumer's wake time, or INT64_MIN
+	_Atomic uint32_t seq;       // futex word, bumped by each wake
+	atomic_bool woken;
+	nt_DeadlineItem *heap;      // the consumer's
+};
+
+static void nt_futexWait(_Atomic uint32_t *addr, uint32_t val, int64_t ns)
+{
+#ifdef __linux__
+	struct timespec ts = {ns / 1000000000, ns % 1000000000};
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+#else
+	(void)addr;
+	(void)val;
+	struct timespec ts = {0, ns < 1000000 ? ns : 1000000};
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void nt_futexWake(_Atomic uint32_t *addr)
+{
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+	(void)addr;
+#endif
+}
+
+static nt_DeadlineItem *nt_pairMeld(nt_DeadlineItem *a, nt_DeadlineItem *b)
+{
+	if (a == NULL) {
+		return b;
+	}
+	if (b == NULL) {
+		return a;
+	}
+	if (b->when < a->when) {
+		nt_DeadlineItem *t = a;
+		a = b;
+		b = t;
+	}
+	b->next = a->child;
+	a->child = b;
+	return a;
+}
+
+// pairMerge melds a list of heaps linked by next in the usual two
+// passes: pairs left to right, then the results right to left.
+static nt_DeadlineItem *nt_pairMerge(nt_DeadlineItem *list)
+{
+	nt_DeadlineItem *acc = NULL;
+	while (list != NULL) {
+		nt_DeadlineItem *a = list, *b = a->next;
+		list = b != NULL ? b->next : NULL;
+		a->next = NULL;
+		if (b != NULL) {
+			b->next = NULL;
+			a = nt_pairMeld(a, b);
 		}
+		a->next = acc;
+		acc = a;
 	}
-	zone = &l->zone[tx[lo].index];
-	ret.name = zone->name;
-	ret.offset = zone->offset;
-	ret.start = tx[lo].when;
-	// end = maintained during the search
-	ret.isDST = zone->isDST;
+	nt_DeadlineItem *root = NULL;
+	while (acc != NULL) {
+		nt_DeadlineItem *next = acc->next;
+		acc->next = NULL;
+		root = nt_pairMeld(acc, root);
+		acc = next;
+	}
+	return root;
+}
 
-	// If we're at the end of the known zone transitions,
-	// try the extend string.
-	if (lo == txLen-1 && !nt_EMPTY_STR(l->extend)) {
-       /* ename, eoffset, estart, eend, eisDST, ok := tzset(l.extend, start, sec); */ // TODO: implment tzset function
-		/* if (ok) { */
-		/* 	return (struct nt_Location_lookup){ename, eoffset, estart, eend, eisDST}; */
-		/* } */
+// DeadlineQueueNew returns an empty queue, or NULL if out of memory.
+nt_DeadlineQueue *nt_DeadlineQueueNew(void)
+{
+	nt_DeadlineQueue *q = malloc(sizeof(*q));
+	if (q == NULL) {
+		return NULL;
 	}
+	atomic_init(&q->head, NULL);
+	atomic_init(&q->sleepUntil, INT64_MIN);
+	atomic_init(&q->seq, 0);
+	atomic_init(&q->woken, false);
+	q->heap = NULL;
+	return q;
+}
 
-	return ret;
+// DeadlineQueueFree releases q. Items still in it are not touched.
+void nt_DeadlineQueueFree(nt_DeadlineQueue *q)
+{
+	free(q);
 }
 
-// lookupFirstZone returns the index of the time zone to use for times
-// before the first transition time, or when there are no transition
-// times.
-//
-// The reference implementation in localtime.c from
-// https://www.iana.org/time-zones/repository/releases/tzcode2013g.tar.gz
-// implements the following algorithm for these cases:
-//  1. If the first zone is unused by the transitions, use it.
-//  2. Otherwise, if there are transition times, and the first
-//     transition is to a zone in daylight time, find the first
-//     non-daylight-time zone before and closest to the first transition
-//     zone.
-//  3. Otherwise, use the first zone that is not daylight time, if
-//     there is one.
-//  4. Otherwise, use the first zone.
-int nt_Location_lookupFirstZone(nt_Location *l) {
-	// Case 1.
-	if (!nt_Location_firstZoneUsed(l)) {
-		return 0;
+// deadlineWhen returns d as a runtimeNano reading.
+static int64_t nt_deadlineWhen(nt_Time d)
+{
+	if ((d.wall&nt_hasMonotonic) != 0) {
+		return d.ext + nt_startNano;
 	}
+	return nt_runtimeNano() + nt_Until(d);
+}
 
-	// Case 2.
-	if (l->txLen > 0 && l->zone[l->tx[0].index].isDST) {
-		for (int zi = l->tx[0].index - 1; zi >= 0; zi--) {
-			if (!l->zone[zi].isDST) {
-				return zi;
-			}
+// wake moves the consumer on from its current or next sleep.
+static void nt_deadlineWake(nt_DeadlineQueue *q)
+{
+	atomic_fetch_add(&q->seq, 1);
+	nt_futexWake(&q->seq);
+}
+
+// DeadlineQueuePush adds it to q, to be returned by DeadlineQueueWait
+// once it->deadline has passed. It may be called from any thread, and
+// it must not be modified until it is returned.
+void nt_DeadlineQueuePush(nt_DeadlineQueue *q, nt_DeadlineItem *it)
+{
+	it->when = nt_deadlineWhen(it->deadline);
+	it->child = NULL;
+	nt_PROBE3(timer_start, it, it->when, 0);
+	nt_DeadlineItem *head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	do {
+		it->next = head;
+	} while (!atomic_compare_exchange_weak(&q->head, &head, it));
+
+	// The consumer stores sleepUntil before its last look at head, and
+	// we load it after pushing, so one of us sees the other.
+	int64_t s = atomic_load(&q->sleepUntil);
+	while (it->when < s) {
+		if (atomic_compare_exchange_weak(&q->sleepUntil, &s, INT64_MIN)) {
+			nt_deadlineWake(q);
+			return;
 		}
 	}
+}
+
+// DeadlineQueueWait returns the item in q with the earliest deadline,
+// sleeping until that deadline passes or an earlier item arrives. It
+// gives up and returns NULL after timeout, if it is not negative, or
+// when DeadlineQueueWake is called. Only one thread may wait on q.
+nt_DeadlineItem *nt_DeadlineQueueWait(nt_DeadlineQueue *q, nt_Duration timeout)
+{
+	int64_t limit = INT64_MAX;
+	if (timeout >= 0) {
+		int64_t now = nt_runtimeNano();
+		limit = timeout < INT64_MAX - now ? now + timeout : INT64_MAX;
+	}
+	for (;;) {
+		uint32_t seq = atomic_load(&q->seq);
+		if (atomic_exchange(&q->woken, false)) {
+			return NULL;
+		}
+		nt_DeadlineItem *list = atomic_exchange(&q->head, NULL);
+		while (list != NULL) {
+			nt_DeadlineItem *next = list->next;
+			list->next = NULL;
+			q->heap = nt_pairMeld(q->heap, list);
+			list = next;
+		}
 
-	// Case 3.
-	/* for zi := range l.zone { */
-    for (int zi = 0; zi < l->zoneLen; zi++) {
-		if (!l->zone[zi].isDST) {
-			return zi;
+		int64_t now = nt_runtimeNano();
+		nt_DeadlineItem *top = q->heap;
+		if (top != NULL && top->when <= now) {
+			q->heap = nt_pairMerge(top->child);
+			top->child = NULL;
+			nt_PROBE2(timer_fire, top, top->when);
+			nt_PROBE1(timer_stop, top);
+			return top;
+		}
+		if (now >= limit) {
+			return NULL;
+		}
+		int64_t until = top != NULL && top->when < limit ? top->when : limit;
+		atomic_store(&q->sleepUntil, until);
+		if (atomic_load(&q->head) == NULL) {
+			nt_futexWait(&q->seq, seq, until == INT64_MAX ? INT64_MAX/2 : until - now);
 		}
+		atomic_store(&q->sleepUntil, INT64_MIN);
 	}
+}
 
-	// Case 4.
-	return 0;
+// DeadlineQueueWake makes the current or next DeadlineQueueWait return
+// NULL.
+void nt_DeadlineQueueWake(nt_DeadlineQueue *q)
+{
+	atomic_store(&q->woken, true);
+	nt_deadlineWake(q);
 }
 
-// firstZoneUsed reports whether the first zone is used by some
-// transition.
-bool nt_Location_firstZoneUsed(nt_Location *l)
+/*** Timer ring ***/
+
+// A TimerRing is a timer backend on io_uring. Each timer is an
+// IORING_OP_TIMEOUT on the absolute monotonic deadline, so the kernel
+// keeps the timers and the ring only carries submissions and
+// completions. Adding a timer writes a submission queue entry; the next
+// TimerRingWait submits everything queued and sleeps for completions in
+// one io_uring_enter, then reaps as many as it was asked for.
+//
+// Repeating timers are multishot timeouts where the kernel has them
+// (Linux 6.4); elsewhere each completion rearms a one-shot timeout.
+// TimerRingNew fails without io_uring, or without the wait timeouts of
+// Linux 5.11, and the caller should fall back to a DeadlineQueue. Built
+// against kernel headers older than that, it always fails.
+
+#if defined(__linux__) && defined(IORING_FEAT_EXT_ARG)
+
+#ifndef IORING_TIMEOUT_MULTISHOT
+#define IORING_TIMEOUT_MULTISHOT (1U << 6)
+#endif
+
+struct nt_TimerRing {
+	int fd;
+	unsigned sqEntries, sqMask, cqMask;
+	_Atomic unsigned *sqHead, *sqTail, *cqHead, *cqTail;
+	unsigned *sqArray;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	struct __kernel_timespec *ts; // one per entry, read at submission
+	void *sqRing, *cqRing;
+	size_t sqRingSize, cqRingSize;
+	unsigned tail;     // the next submission queue entry
+	unsigned toSubmit; // entries written but not yet submitted
+	size_t len;        // timers armed
+	nt_DeadlineItem *retry; // repeating timers waiting to be rearmed
+	bool noMultishot;
+};
+
+// TimerRingNew returns a TimerRing submitting up to entries timers per
+// system call.
+struct nt_TimerRingNew nt_TimerRingNew(unsigned entries)
 {
-    for (int i = 0; i < l->txLen; i++ ) {
-        nt_zoneTrans tx = l->tx[i];
-		if (tx.index == 0) {
-			return true;
+	if (entries == 0) {
+		entries = 256;
+	}
+	struct io_uring_params p = {0};
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = entries * 4;
+	int fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0) {
+		return (struct nt_TimerRingNew){NULL, "time: io_uring is not available"};
+	}
+	unsigned need = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+	if ((p.features&need) != need) {
+		close(fd);
+		return (struct nt_TimerRingNew){NULL, "time: io_uring lacks wait timeouts"};
+	}
+
+	nt_TimerRing *r = calloc(1, sizeof(*r));
+	if (r == NULL) {
+		close(fd);
+		return (struct nt_TimerRingNew){NULL, "time: out of memory"};
+	}
+	r->fd = fd;
+	r->sqRingSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	r->cqRingSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if ((p.features&IORING_FEAT_SINGLE_MMAP) != 0) {
+		if (r->cqRingSize > r->sqRingSize) {
+			r->sqRingSize = r->cqRingSize;
 		}
+		r->cqRingSize = 0;
 	}
-	return false;
+	r->sqRing = mmap(NULL, r->sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	r->cqRing = r->sqRing;
+	if (r->cqRingSize != 0 && r->sqRing != MAP_FAILED) {
+		r->cqRing = mmap(NULL, r->cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	}
+	r->sqes = mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	r->ts = calloc(p.sq_entries, sizeof(*r->ts));
+	r->sqEntries = p.sq_entries;
+	if (r->sqRing == MAP_FAILED || r->cqRing == MAP_FAILED || r->sqes == MAP_FAILED || r->ts == NULL) {
+		if (r->sqes == MAP_FAILED) {
+			r->sqes = NULL;
+		}
+		if (r->cqRing == MAP_FAILED) {
+			r->cqRing = r->sqRing;
+			r->cqRingSize = 0;
+		}
+		if (r->sqRing == MAP_FAILED) {
+			r->sqRing = NULL;
+		}
+		nt_TimerRingFree(r);
+		return (struct nt_TimerRingNew){NULL, "time: cannot map io_uring"};
+	}
+
+	char *sq = r->sqRing, *cq = r->cqRing;
+	r->sqHead = (_Atomic unsigned *)(sq + p.sq_off.head);
+	r->sqTail = (_Atomic unsigned *)(sq + p.sq_off.tail);
+	r->sqMask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	r->sqArray = (unsigned *)(sq + p.sq_off.array);
+	r->cqHead = (_Atomic unsigned *)(cq + p.cq_off.head);
+	r->cqTail = (_Atomic unsigned *)(cq + p.cq_off.tail);
+	r->cqMask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	r->tail = atomic_load(r->sqTail);
+	return (struct nt_TimerRingNew){r, NULL};
 }
 
-// tzset takes a timezone string like the one found in the TZ environment
-// variable, the time of the last time zone transition expressed as seconds
-// since January 1, 1970 00:00:00 UTC, and a time expressed the same way.
-// We call this a tzset string since in C the function tzset reads TZ.
-// The return values are as for lookup, plus ok which reports whether the
-// parse succeeded.
-struct nt_tzset nt_tzset(char *s, int64_t lastTxSec, int64_t sec)
+// TimerRingFree releases r. Timers still armed are dropped.
+void nt_TimerRingFree(nt_TimerRing *r)
 {
-	char *stdName = NULL;
-    char *dstName = NULL;
-	int	stdOffset = 0;
-    int dstOffset = 0;
-    bool ok;
+	if (r == NULL) {
+		return;
+	}
+	if (r->sqes != NULL) {
+		munmap(r->sqes, r->sqEntries*sizeof(struct io_uring_sqe));
+	}
+	if (r->cqRing != r->sqRing) {
+		munmap(r->cqRing, r->cqRingSize);
+	}
+	if (r->sqRing != NULL) {
+		munmap(r->sqRing, r->sqRingSize);
+	}
+	close(r->fd);
+	free(r->ts);
+	free(r);
+}
 
-    struct nt_tzsetName name = nt_tzsetName(s);
-    stdName = name.tzName;
-    s = name.remainder;
-    ok = name.ok;
-	if (ok) {
-		/* stdOffset, s, ok = tzsetOffset(s); */
-        struct nt_tzsetOffset offset = nt_tzsetOffset(s);
-        stdOffset = offset.offset;
-        s = offset.rest;
-        ok = offset.ok;
+// ringEnter submits the queued entries and, if wait, waits up to timeout
+// (forever if negative) for a completion. It returns the number of
+// entries submitted or a negated errno.
+static int nt_ringEnter(nt_TimerRing *r, bool wait, int64_t timeout)
+{
+	struct __kernel_timespec ts = {timeout / 1000000000, timeout % 1000000000};
+	struct io_uring_getevents_arg arg = {0};
+	if (timeout >= 0) {
+		arg.ts = (uintptr_t)&ts;
 	}
-	if (!ok) {
-        return (struct nt_tzset){"", 0, 0, 0, false, false};
+	unsigned flags = IORING_ENTER_EXT_ARG;
+	if (wait) {
+		flags |= IORING_ENTER_GETEVENTS;
 	}
+	nt_STAT(ringEnters, 1);
+	int n = syscall(__NR_io_uring_enter, r->fd, r->toSubmit, wait ? 1 : 0, flags, &arg, sizeof(arg));
+	if (n < 0) {
+		return -errno;
+	}
+	r->toSubmit -= (unsigned)n < r->toSubmit ? (unsigned)n : r->toSubmit;
+	return n;
+}
 
-	// The numbers in the tzset string are added to local time to get UTC,
-	// but our offsets are added to UTC to get local time,
-	// so we negate the number we see here.
-	stdOffset = -stdOffset;
+// ringTimeout queues a timeout for it at ns: an absolute monotonic time,
+// or with IORING_TIMEOUT_MULTISHOT a period.
+static char *nt_ringTimeout(nt_TimerRing *r, nt_DeadlineItem *it, int64_t ns, unsigned flags)
+{
+	if (r->tail - atomic_load_explicit(r->sqHead, memory_order_acquire) == r->sqEntries) {
+		nt_ringEnter(r, false, -1);
+		if (r->tail - atomic_load_explicit(r->sqHead, memory_order_acquire) == r->sqEntries) {
+			return "time: io_uring submission queue is full";
+		}
+	}
+	unsigned i = r->tail & r->sqMask;
+	r->ts[i] = (struct __kernel_timespec){ns / 1000000000, ns % 1000000000};
+	struct io_uring_sqe *sqe = &r->sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t)&r->ts[i];
+	sqe->len = 1;
+	sqe->timeout_flags = flags;
+	sqe->user_data = (uintptr_t)it;
+	r->sqArray[i] = i;
+	r->tail++;
+	atomic_store_explicit(r->sqTail, r->tail, memory_order_release);
+	r->toSubmit++;
+	return NULL;
+}
 
-	if (strlen(s)== 0 || s[0] == ',') {
-		// No daylight savings time.
-		return (struct nt_tzset){stdName, stdOffset, lastTxSec, nt_omega, false, true};
+// TimerRingAdd arms a timer returning it from TimerRingWait once
+// it->deadline has passed. it must not be modified until then.
+char *nt_TimerRingAdd(nt_TimerRing *r, nt_DeadlineItem *it)
+{
+	it->when = nt_deadlineWhen(it->deadline);
+	it->period = 0;
+	char *err = nt_ringTimeout(r, it, it->when, IORING_TIMEOUT_ABS);
+	if (err == NULL) {
+		r->len++;
+		nt_PROBE3(timer_start, it, it->when, 0);
 	}
+	return err;
+}
 
-	name = nt_tzsetName(s);
-    dstName = name.tzName;
-    s = name.remainder;
-    ok = name.ok;
-	if (ok) {
-		if (strlen(s) == 0 || s[0] == ',') {
-			dstOffset = stdOffset + nt_secondsPerHour;
-		} else {
-			struct nt_tzsetOffset offset = nt_tzsetOffset(s);
-            dstOffset = offset.offset;
-            s = offset.rest;
-            ok = offset.ok;
-			dstOffset = -dstOffset; // as with stdOffset, above
-		}
+// TimerRingEvery arms a timer returning it from TimerRingWait every
+// period, starting a period from now. It stays armed until r is freed.
+char *nt_TimerRingEvery(nt_TimerRing *r, nt_DeadlineItem *it, nt_Duration period)
+{
+	if (period <= 0) {
+		nt_panic("time: non-positive interval for TimerRingEvery\n");
 	}
-	if (!ok) {
-        return (struct nt_tzset){"", 0, 0, 0, false, false};
+	it->period = period;
+	it->when = nt_runtimeNano() + period;
+	char *err = r->noMultishot ?
+		nt_ringTimeout(r, it, it->when, IORING_TIMEOUT_ABS) :
+		nt_ringTimeout(r, it, period, IORING_TIMEOUT_MULTISHOT);
+	if (err == NULL) {
+		r->len++;
+		nt_PROBE3(timer_start, it, it->when, period);
 	}
+	return err;
+}
 
-	if (strlen(s) == 0) {
-		// Default DST rules per tzcode.
-		s = ",M3.2.0,M11.1.0";
+// ringRearm arms a one-shot timeout for the next tick of it, skipping
+// ticks that have already passed. If the submission queue cannot take
+// it, it is kept on r->retry for the next TimerRingWait.
+static void nt_ringRearm(nt_TimerRing *r, nt_DeadlineItem *it)
+{
+	int64_t now = nt_runtimeNano();
+	if (it->when <= now) {
+		it->when += ((now - it->when)/it->period + 1) * it->period;
+	}
+	if (nt_ringTimeout(r, it, it->when, IORING_TIMEOUT_ABS) != NULL) {
+		it->next = r->retry;
+		r->retry = it;
 	}
-	// The TZ definition does not mention ';' here but tzcode accepts it.
-	if (s[0] != ',' && s[0] != ';') {
-        return (struct nt_tzset){"", 0, 0, 0, false, false};
-	}
-	/* s = s[1:]; // TODO: Need string work */
-    // START HERE
-
-	/* var startRule, endRule rule */
-	/* startRule, s, ok = tzsetRule(s) */
-	/* if !ok || len(s) == 0 || s[0] != ',' { */
-	/* 	return "", 0, 0, 0, false, false */
-	/* } */
-	/* s = s[1:] */
-	/* endRule, s, ok = tzsetRule(s) */
-	/* if !ok || len(s) > 0 { */
-	/* 	return "", 0, 0, 0, false, false */
-	/* } */
-
-	/* year, _, _, yday := absDate(uint64(sec+unixToInternal+internalToAbsolute), false) */
-
-	/* ysec := int64(yday*secondsPerDay) + sec%secondsPerDay */
-
-	/* // Compute start of year in seconds since Unix epoch. */
-	/* d := daysSinceEpoch(year) */
-	/* abs := int64(d * secondsPerDay) */
-	/* abs += absoluteToInternal + internalToUnix */
-
-	/* startSec := int64(tzruleTime(year, startRule, stdOffset)) */
-	/* endSec := int64(tzruleTime(year, endRule, dstOffset)) */
-	/* dstIsDST, stdIsDST := true, false */
-	/* // Note: this is a flipping of "DST" and "STD" while retaining the labels */
-	/* // This happens in southern hemispheres. The labelling here thus is a little */
-	/* // inconsistent with the goal. */
-	/* if endSec < startSec { */
-	/* 	startSec, endSec = endSec, startSec */
-	/* 	stdName, dstName = dstName, stdName */
-	/* 	stdOffset, dstOffset = dstOffset, stdOffset */
-	/* 	stdIsDST, dstIsDST = dstIsDST, stdIsDST */
-	/* } */
-
-	/* // The start and end values that we return are accurate */
-	/* // close to a daylight savings transition, but are otherwise */
-	/* // just the start and end of the year. That suffices for */
-	/* // the only caller that cares, which is Date. */
-	/* if ysec < startSec { */
-	/* 	return stdName, stdOffset, abs, startSec + abs, stdIsDST, true */
-	/* } else if ysec >= endSec { */
-	/* 	return stdName, stdOffset, endSec + abs, abs + 365*secondsPerDay, stdIsDST, true */
-	/* } else { */
-	/* 	return dstName, dstOffset, startSec + abs, endSec + abs, dstIsDST, true */
-	/* } */
 }
 
-// tzsetName returns the timezone name at the start of the tzset string s,
-// and the remainder of s, and reports whether the parsing is OK.
-struct nt_tzsetName nt_tzsetName(char *s)
+// ringRetry rearms the timers ringRearm could not.
+static void nt_ringRetry(nt_TimerRing *r)
 {
-    size_t sLen = strlen(s);
+	nt_DeadlineItem *list = r->retry;
+	r->retry = NULL;
+	while (list != NULL) {
+		nt_DeadlineItem *next = list->next;
+		nt_ringRearm(r, list);
+		list = next;
+	}
+}
 
-	if (sLen == 0) {
-		return (struct nt_tzsetName){"", "", false};
+// ringReap moves up to max fired items from the completion queue to out.
+static size_t nt_ringReap(nt_TimerRing *r, nt_DeadlineItem **out, size_t max)
+{
+	unsigned head = atomic_load_explicit(r->cqHead, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(r->cqTail, memory_order_acquire);
+	size_t n = 0;
+	for (; head != tail && n < max; head++) {
+		struct io_uring_cqe *c = &r->cqes[head & r->cqMask];
+		nt_DeadlineItem *it = (nt_DeadlineItem *)(uintptr_t)c->user_data;
+		int64_t when = it->when;
+		if (it->period == 0) {
+			r->len--;
+		} else if ((c->flags&IORING_CQE_F_MORE) != 0) {
+			it->when += it->period;
+		} else if (c->res == -EINVAL && !r->noMultishot) {
+			// The kernel predates multishot timeouts.
+			r->noMultishot = true;
+			nt_ringRearm(r, it);
+			continue;
+		} else {
+			nt_ringRearm(r, it);
+		}
+		nt_PROBE2(timer_fire, it, when);
+		if (it->period == 0) {
+			nt_PROBE1(timer_stop, it);
+		}
+		out[n++] = it;
 	}
-	if (s[0] != '<') {
-        for (int i = 0; i < sLen; i++) {
-            char r = s[i];
-			switch (r) {
-                case '0':
-                case '1':
-                case '2':
-                case '3':
-                case '4':
-                case '5':
-                case '6':
-                case '7':
-                case '8':
-                case '9':
-                case ',':
-                case '-':
-                case '+':
-                    if (i < 3) {
-                        return (struct nt_tzsetName){"", "", false};
-                    }
-                    /* return (struct nt_tzsetName){s[:i], s[i:], true}; */
-			}
+	atomic_store_explicit(r->cqHead, head, memory_order_release);
+	return n;
+}
+
+// TimerRingWait stores up to max fired items in out and returns how many
+// it stored, waiting up to timeout, or forever if it is negative, for the
+// first. A repeating item is stored once per tick.
+size_t nt_TimerRingWait(nt_TimerRing *r, nt_DeadlineItem **out, size_t max, nt_Duration timeout)
+{
+	int64_t limit = INT64_MAX;
+	if (timeout >= 0) {
+		int64_t now = nt_runtimeNano();
+		limit = timeout < INT64_MAX - now ? now + timeout : INT64_MAX;
+	}
+	for (;;) {
+		if (r->retry != NULL) {
+			nt_ringRetry(r);
 		}
-		if (sLen < 3) {
-            return (struct nt_tzsetName){"", "", false};
+		size_t n = nt_ringReap(r, out, max);
+		if (n > 0 || max == 0) {
+			return n;
 		}
-		return (struct nt_tzsetName){s, "", true};
-	} else {
-        for (int i = 0; i < sLen; i++) {
-            char r = s[i];
-			if (r == '>') {
-				/* return s[1:i], s[i+1:], true; */
+		int64_t wait = -1;
+		if (timeout >= 0) {
+			wait = limit - nt_runtimeNano();
+			if (wait <= 0) {
+				if (r->toSubmit > 0) {
+					nt_ringEnter(r, false, -1);
+				}
+				return nt_ringReap(r, out, max);
 			}
 		}
-        return (struct nt_tzsetName){"", "", false};
+		int res = nt_ringEnter(r, true, wait);
+		if (res < 0 && res != -EINTR && res != -EBUSY) {
+			// ETIME, or an error waiting will not fix.
+			return nt_ringReap(r, out, max);
+		}
 	}
 }
 
-// UPDATE //////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+// TimerRingLen returns the number of timers armed on r.
+size_t nt_TimerRingLen(nt_TimerRing *r)
+{
+	return r->len;
+}
 
-// tzsetOffset returns the timezone offset at the start of the tzset string s,
-// and the remainder of s, and reports whether the parsing is OK.
-// The timezone offset is returned as a number of seconds.
-struct nt_tzsetOffset nt_tzsetOffset(char *s)
+#else
+
+struct nt_TimerRing {
+	size_t len;
+};
+
+struct nt_TimerRingNew nt_TimerRingNew(unsigned entries)
 {
-    size_t sLen = strlen(s);
-	if (sLen == 0) {
-		return (struct nt_tzsetOffset){0, "", false};
+	(void)entries;
+	return (struct nt_TimerRingNew){NULL, "time: io_uring is not available"};
+}
+
+void nt_TimerRingFree(nt_TimerRing *r)
+{
+	free(r);
+}
+
+char *nt_TimerRingAdd(nt_TimerRing *r, nt_DeadlineItem *it)
+{
+	(void)r;
+	(void)it;
+	return "time: io_uring is not available";
+}
+
+char *nt_TimerRingEvery(nt_TimerRing *r, nt_DeadlineItem *it, nt_Duration period)
+{
+	(void)period;
+	return nt_TimerRingAdd(r, it);
+}
+
+size_t nt_TimerRingWait(nt_TimerRing *r, nt_DeadlineItem **out, size_t max, nt_Duration timeout)
+{
+	(void)r;
+	(void)out;
+	(void)max;
+	(void)timeout;
+	return 0;
+}
+
+size_t nt_TimerRingLen(nt_TimerRing *r)
+{
+	return r->len;
+}
+
+#endif
+
+/*** Clock monitor ***/
+
+// A ClockMonitor watches for the wall clock stepping and the clocks
+// slewing, and tells registered functions, so that caches built on wall
+// clock readings (formatted timestamps, wall clock anchors) can be
+// dropped. The Location zone caches are keyed by absolute time and stay
+// valid across a step.
+//
+// A step shows as a change in REALTIME-MONOTONIC between samples. On
+// Linux a timerfd armed with TFD_TIMER_CANCEL_ON_SET also reports every
+// clock_settime as it happens, so a waiting monitor sees a step at once
+// rather than at its next sample. A slew does not show in that delta,
+// since NTP frequency and offset corrections apply to both clocks, so the
+// monitor measures MONOTONIC against MONOTONIC_RAW instead. The smoothed
+// rate is the clock's drift; a rate departing from it by more than the
+// slew threshold starts a slew.
+
+enum { nt_clockEventsKept = 16 };
+
+struct nt_clockFunc {
+	nt_ClockFunc fn;
+	void *ctx;
+};
+
+struct nt_ClockMonitor {
+	nt_ClockMonitorConfig c;
+	int fd; // the timerfd, or -1
+	pthread_mutex_t mu;
+	int64_t delta0, delta; // REALTIME-MONOTONIC at the start and last sample
+	nt_ClockSample last;   // the last sample a rate was measured to
+	int64_t checked;       // MONOTONIC at the last sample
+	bool hasRate;
+	nt_ClockStats stats;
+	struct nt_clockFunc *funcs;
+	size_t nfuncs;
+	nt_ClockEvent events[nt_clockEventsKept];
+	uint64_t nevents;
+};
+
+static nt_ClockSample nt_clockSample(nt_ClockMonitor *m)
+{
+	if (m->c.clock != NULL) {
+		return m->c.clock(m->c.ctx);
 	}
-	bool neg = false;
-	if (s[0] == '+') {
-		/* s = s[1:]; */ // TODO: fix string
-	} else if (s[0] == '-') {
-		/* s = s[1:]; */ // TODO: fix string
-		neg = true;
+	struct timespec real, mono, raw;
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &raw);
+#else
+	raw = mono;
+#endif
+	return (nt_ClockSample){
+		real.tv_sec*(int64_t)1e9 + real.tv_nsec,
+		mono.tv_sec*(int64_t)1e9 + mono.tv_nsec,
+		raw.tv_sec*(int64_t)1e9 + raw.tv_nsec,
+	};
+}
+
+// clockArm arms the timerfd for a time it will never reach; only its
+// cancellation matters.
+static void nt_clockArm(nt_ClockMonitor *m)
+{
+#ifdef __linux__
+	struct itimerspec its = {0};
+	clock_gettime(CLOCK_REALTIME, &its.it_value);
+	its.it_value.tv_sec += 100*365*nt_secondsPerDay;
+	if (timerfd_settime(m->fd, TFD_TIMER_ABSTIME|TFD_TIMER_CANCEL_ON_SET, &its, NULL) < 0) {
+		close(m->fd);
+		m->fd = -1;
 	}
+#else
+	(void)m;
+#endif
+}
 
-	// The tzdata code permits values up to 24 * 7 here,
-	// although POSIX does not.
-	struct nt_tzsetNum num = nt_tzsetNum(s, 0, 24*7);
-    int hours = num.num;
-    s = num.rest;
-    bool ok = num.ok;
-	if (!ok) {
-		return (struct nt_tzsetOffset){0, "", false};
+// ClockMonitorNew returns a ClockMonitor configured by config, or with
+// the defaults if config is NULL. Events are reported against the sample
+// it takes now.
+struct nt_ClockMonitorNew nt_ClockMonitorNew(const nt_ClockMonitorConfig *config)
+{
+	nt_ClockMonitorConfig c = {0};
+	if (config != NULL) {
+		c = *config;
+	}
+	if (c.interval < 0 || c.step < 0 || c.slew < 0) {
+		return (struct nt_ClockMonitorNew){NULL, "time: negative ClockMonitorConfig field"};
 	}
-	int off = hours * nt_secondsPerHour;
-    sLen = strlen(s);
-	if (sLen == 0 || s[0] != ':') {
-		if (neg) {
-			off = -off;
+	if (c.interval == 0) {
+		c.interval = nt_SECOND;
+	}
+	if (c.step == 0) {
+		c.step = nt_MILLISECOND;
+	}
+	if (c.slew == 0) {
+		c.slew = 10;
+	}
+	nt_ClockMonitor *m = calloc(1, sizeof(*m));
+	if (m == NULL) {
+		return (struct nt_ClockMonitorNew){NULL, "time: out of memory"};
+	}
+	m->c = c;
+	m->fd = -1;
+	pthread_mutex_init(&m->mu, NULL);
+	m->last = nt_clockSample(m);
+	m->delta0 = m->delta = m->last.real - m->last.mono;
+	m->checked = m->last.mono;
+#ifdef __linux__
+	if (c.clock == NULL) {
+		m->fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (m->fd >= 0) {
+			nt_clockArm(m);
 		}
-		return (struct nt_tzsetOffset){off, s, true};
 	}
+#endif
+	return (struct nt_ClockMonitorNew){m, NULL};
+}
 
-	/* num = nt_tzsetNum(s[1:], 0, 59); // TODO: fix string */
-    int mins = num.num;
-    s = num.rest;
-    ok = num.ok;
-	if (!ok) {
-		return (struct nt_tzsetOffset){0, "", false};
+// ClockMonitorFree releases m.
+void nt_ClockMonitorFree(nt_ClockMonitor *m)
+{
+	if (m == NULL) {
+		return;
 	}
-	off += mins * nt_secondsPerMinute;
-    sLen = strlen(s);
-	if (sLen == 0 || s[0] != ':') {
-		if (neg) {
-			off = -off;
+	if (m->fd >= 0) {
+		close(m->fd);
+	}
+	pthread_mutex_destroy(&m->mu);
+	free(m->funcs);
+	free(m);
+}
+
+// ClockMonitorRegister arranges for fn(ctx, ev) to be called for each
+// event m detects. It is called with m locked and must not call back
+// into m. It reports false if it is out of memory.
+bool nt_ClockMonitorRegister(nt_ClockMonitor *m, nt_ClockFunc fn, void *ctx)
+{
+	pthread_mutex_lock(&m->mu);
+	struct nt_clockFunc *f = realloc(m->funcs, (m->nfuncs+1) * sizeof(*f));
+	if (f != NULL) {
+		f[m->nfuncs++] = (struct nt_clockFunc){fn, ctx};
+		m->funcs = f;
+	}
+	pthread_mutex_unlock(&m->mu);
+	return f != NULL;
+}
+
+// ClockMonitorUnregister removes a function registered with the same fn
+// and ctx.
+void nt_ClockMonitorUnregister(nt_ClockMonitor *m, nt_ClockFunc fn, void *ctx)
+{
+	pthread_mutex_lock(&m->mu);
+	for (size_t i = 0; i < m->nfuncs; i++) {
+		if (m->funcs[i].fn == fn && m->funcs[i].ctx == ctx) {
+			memmove(&m->funcs[i], &m->funcs[i+1], (m->nfuncs-i-1) * sizeof(*m->funcs));
+			m->nfuncs--;
+			break;
 		}
-		return (struct nt_tzsetOffset){off, s, true};
 	}
+	pthread_mutex_unlock(&m->mu);
+}
 
-	/* num = tzsetNum(s[1:], 0, 59); // TODO: fix string */
-    int secs = num.num;
-    s = num.rest;
-    ok = num.ok;
-	if (!ok) {
-		return (struct nt_tzsetOffset){0, "", false};
+// ClockMonitorFd returns a descriptor that becomes readable when the wall
+// clock is set, for waiting on with poll or epoll before calling
+// ClockMonitorCheck, or -1 if there is none.
+int nt_ClockMonitorFd(nt_ClockMonitor *m)
+{
+	return m->fd;
+}
+
+static void nt_clockEmit(nt_ClockMonitor *m, nt_ClockEvent ev)
+{
+	m->events[m->nevents++ % nt_clockEventsKept] = ev;
+	for (size_t i = 0; i < m->nfuncs; i++) {
+		m->funcs[i].fn(m->funcs[i].ctx, &ev);
+	}
+}
+
+// clockCheck takes a sample and reports what changed since the last one.
+// set says the timerfd saw the clock set.
+static size_t nt_clockCheck(nt_ClockMonitor *m, bool set)
+{
+	nt_ClockSample s = nt_clockSample(m);
+	nt_Time when = nt_Unix(0, s.real);
+	size_t n = 0;
+	m->stats.samples++;
+	m->checked = s.mono;
+
+	int64_t delta = s.real - s.mono;
+	int64_t step = delta - m->delta;
+	m->delta = delta;
+	m->stats.offset = delta - m->delta0;
+	if (set || step >= m->c.step || step <= -m->c.step) {
+		m->stats.steps++;
+		if ((step < 0 ? -step : step) > (m->stats.maxStep < 0 ? -m->stats.maxStep : m->stats.maxStep)) {
+			m->stats.maxStep = step;
+		}
+		nt_clockEmit(m, (nt_ClockEvent){nt_CLOCK_STEP, when, step, m->stats.rate});
+		n++;
 	}
-	off += secs;
 
-	if (neg) {
-		off = -off;
+	// Rates over short spans are mostly noise; wait for a long one.
+	int64_t raw = s.raw - m->last.raw;
+	if (raw < m->c.interval/2) {
+		return n;
+	}
+	double rate = (double)(s.mono - m->last.mono - raw) * 1e6 / (double)raw;
+	m->last = s;
+	if (!m->hasRate) {
+		m->hasRate = true;
+		m->stats.drift = rate;
+	}
+	double off = rate - m->stats.drift;
+	bool slewing = off >= m->c.slew || off <= -m->c.slew;
+	if (slewing && !m->stats.slewing) {
+		m->stats.slews++;
+		nt_clockEmit(m, (nt_ClockEvent){nt_CLOCK_SLEW, when, 0, rate});
+		n++;
+	}
+	if (!slewing) {
+		m->stats.drift += off / 16;
 	}
-	return (struct nt_tzsetOffset){off, s, true};
+	m->stats.rate = rate;
+	m->stats.slewing = slewing;
+	return n;
 }
 
-// tzsetNum parses a number from a tzset string.
-// It returns the number, and the remainder of the string, and reports success.
-// The number must be between min and max.
-struct nt_tzsetNum nt_tzsetNum(char *s, int min, int max)
+// ClockMonitorCheck samples the clocks, calls the registered functions
+// for any events, and returns how many there were.
+size_t nt_ClockMonitorCheck(nt_ClockMonitor *m)
 {
-    size_t sLen = strlen(s);
-	if (sLen == 0) {
-		return (struct nt_tzsetNum){0, "", false};
+	bool set = false;
+	pthread_mutex_lock(&m->mu);
+#ifdef __linux__
+	uint64_t expirations;
+	if (m->fd >= 0 && read(m->fd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED) {
+		set = true;
+		nt_clockArm(m);
 	}
-	int num = 0;
-    for (int i = 0; i < sLen; i++) {
-        char r = s[i];
-		if (r < '0' || r > '9') {
-			if (i == 0 || num < min) {
-                return (struct nt_tzsetNum){0, "", false};
+#endif
+	size_t n = nt_clockCheck(m, set);
+	pthread_mutex_unlock(&m->mu);
+	return n;
+}
+
+// ClockMonitorWait waits until the next sample is due, or the wall clock
+// is set, and then calls ClockMonitorCheck. A monitor of a simulated
+// clock does not wait.
+size_t nt_ClockMonitorWait(nt_ClockMonitor *m)
+{
+	if (m->c.clock == NULL) {
+		pthread_mutex_lock(&m->mu);
+		int64_t wait = m->checked + m->c.interval - nt_clockSample(m).mono;
+		pthread_mutex_unlock(&m->mu);
+		if (wait > 0) {
+#ifdef __linux__
+			if (m->fd >= 0) {
+				struct pollfd p = {.fd = m->fd, .events = POLLIN};
+				poll(&p, 1, (int)((wait + 999999) / 1000000));
+			} else
+#endif
+			{
+				struct timespec ts = {wait / 1000000000, wait % 1000000000};
+				nanosleep(&ts, NULL);
 			}
-			/* return (struct nt_tzsetNum){num, s[i:], true}; */ // TODO: Fix string
-		}
-		num *= 10;
-		num += r - '0';
-		if (num > max) {
-            return (struct nt_tzsetNum){0, "", false};
 		}
 	}
-	if (num < min) {
-        return (struct nt_tzsetNum){0, "", false};
+	return nt_ClockMonitorCheck(m);
+}
+
+// ClockMonitorStats returns m's counters and estimates.
+nt_ClockStats nt_ClockMonitorStats(nt_ClockMonitor *m)
+{
+	pthread_mutex_lock(&m->mu);
+	nt_ClockStats st = m->stats;
+	pthread_mutex_unlock(&m->mu);
+	return st;
+}
+
+// ClockMonitorEvents stores up to max of m's most recent events in out,
+// oldest first, and returns how many it stored. m keeps the last 16.
+size_t nt_ClockMonitorEvents(nt_ClockMonitor *m, nt_ClockEvent *out, size_t max)
+{
+	pthread_mutex_lock(&m->mu);
+	size_t n = m->nevents < nt_clockEventsKept ? m->nevents : nt_clockEventsKept;
+	if (n > max) {
+		n = max;
+	}
+	for (size_t i = 0; i < n; i++) {
+		out[i] = m->events[(m->nevents - n + i) % nt_clockEventsKept];
 	}
-    return (struct nt_tzsetNum){num, "", true};
+	pthread_mutex_unlock(&m->mu);
+	return n;
 }
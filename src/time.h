@@ -13,6 +13,10 @@ The majority of comment in the file a from the Go source.
 #include <stdbool.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /******************************************************************************
  * Header
  * time.h
@@ -109,7 +113,7 @@ The majority of comment in the file a from the Go source.
 
 // A zone represents a single time zone such as CET.
 typedef struct {
-	char name[4]; // abbreviated name, "CET"
+	char name[8]; // abbreviated name, "CET"
 	int  offset;  // seconds east of UTC
 	bool isDST;   // is this zone Daylight Savings Time?
 } nt_zone;
@@ -222,8 +226,8 @@ typedef struct Time {
 	nt_Location *loc;
 } nt_Time;
 
-extern nt_Location *time_UTC;
-extern nt_Location *time_Local;
+extern nt_Location *nt_UTC;
+extern nt_Location *nt_Local;
 
 // A Month specifies a month of the year (January = 1, ...).
 typedef enum {
@@ -301,8 +305,9 @@ void nt_init(void);
 
 nt_Time nt_TimeUTC(nt_Time t);
 nt_Time nt_TimeLocal(nt_Time t);
+nt_Time nt_TimeIn(nt_Time t, nt_Location *loc);
 bool nt_TimeAfter(nt_Time t, nt_Time u);
-bool nt_Before(nt_Time t, nt_Time u);
+bool nt_TimeBefore(nt_Time t, nt_Time u);
 int nt_TimeCompare(nt_Time t, nt_Time u);
 bool nt_TimeEqual(nt_Time t, nt_Time u);
 
@@ -351,5 +356,461 @@ nt_Duration nt_Since(nt_Time t);
 bool nt_TimeIsDST(nt_Time t);
 nt_Time nt_TimeRound(nt_Time t, nt_Duration d);
 char *nt_LocationString(nt_Location *l);
+nt_Location *nt_FixedZone(char *name, int offset);
+struct nt_LoadLocation {
+    nt_Location *loc;
+    char *err;
+};
+struct nt_LoadLocation nt_LoadLocation(const char *name);
+struct nt_LoadLocation nt_LoadLocationFromTZData(const char *name, const uint8_t *data, size_t len);
+void nt_LocationFree(nt_Location *l);
+
+typedef struct nt_ZoneSnapshot nt_ZoneSnapshot;
+struct nt_ZoneSnapshotOpen {
+    nt_ZoneSnapshot *snap;
+    char *err;
+};
+char *nt_ZoneSnapshotWrite(const char *path, const char *const *names, size_t n);
+struct nt_ZoneSnapshotOpen nt_ZoneSnapshotOpen(const char *path);
+void nt_ZoneSnapshotClose(nt_ZoneSnapshot *s);
+ptrdiff_t nt_ZoneSnapshotIndex(nt_ZoneSnapshot *s, const char *name);
+nt_Location *nt_ZoneSnapshotLocation(nt_ZoneSnapshot *s, const char *name);
+size_t nt_ZoneSnapshotLen(nt_ZoneSnapshot *s);
+nt_Location *nt_ZoneSnapshotAt(nt_ZoneSnapshot *s, size_t i);
+
+// A Pool is a set of worker threads for the batch kernels. Every batch
+// kernel takes a Pool as its last argument; NULL runs it on the calling
+// thread.
+typedef struct nt_Pool nt_Pool;
+
+// Bytes of input plus output the batch kernels process per chunk.
+#define nt_POOL_CHUNK_BYTES (64 * 1024)
+
+nt_Pool *nt_PoolNew(int nthreads);
+void nt_PoolFree(nt_Pool *p);
+int nt_PoolThreads(nt_Pool *p);
+void nt_ParallelFor(nt_Pool *p, size_t n, size_t grain, void (*fn)(void *ctx, size_t lo, size_t hi), void *ctx);
+
+// Size of the buffer needed by nt_TimeMarshalBinary.
+#define nt_TIME_BINARY_MAXLEN 16
+// Size of one value in the compact encoding.
+#define nt_TIME_COMPACT_LEN   12
+
+struct nt_TimeMarshalBinary {
+    size_t n;  // bytes written to buf
+    char *err; // NULL on success
+};
+struct nt_TimeMarshalBinary nt_TimeMarshalBinary(nt_Time t, uint8_t buf[nt_TIME_BINARY_MAXLEN]);
+char *nt_TimeUnmarshalBinary(nt_Time *t, const uint8_t *data, size_t len);
+void nt_TimeMarshalCompact(nt_Time t, uint8_t buf[nt_TIME_COMPACT_LEN]);
+bool nt_TimeUnmarshalCompact(nt_Time *t, const uint8_t buf[nt_TIME_COMPACT_LEN]);
+void nt_TimeMarshalCompactBatch(const nt_Time *ts, size_t n, uint8_t *buf, nt_Pool *pool);
+bool nt_TimeUnmarshalCompactBatch(const uint8_t *buf, size_t n, nt_Time *ts, nt_Pool *pool);
+
+// Buffer sizes for the RPC wire formats.
+#define nt_PROTO_TIMESTAMP_MAXLEN       17 // google.protobuf.Timestamp body
+#define nt_PROTO_DURATION_MAXLEN        22 // google.protobuf.Duration body
+#define nt_PROTO_TIMESTAMP_FIELD_MAXLEN 23 // tag, length and body of one repeated element
+#define nt_MSGPACK_TIME_MAXLEN          15 // MessagePack timestamp extension
+#define nt_CBOR_TIME_MAXLEN             10 // CBOR tag 1 date/time
+
+struct nt_TimeUnmarshalProtoBatch {
+    size_t n;  // Timestamps decoded
+    char *err; // NULL on success
+};
+struct nt_TimeUnmarshalMsgpack {
+    size_t n;  // bytes consumed
+    char *err; // NULL on success
+};
+struct nt_TimeUnmarshalCBOR {
+    size_t n;  // bytes consumed
+    char *err; // NULL on success
+};
+
+size_t nt_TimeMarshalProto(nt_Time t, uint8_t buf[nt_PROTO_TIMESTAMP_MAXLEN]);
+char *nt_TimeUnmarshalProto(nt_Time *t, const uint8_t *data, size_t len);
+size_t nt_DurationMarshalProto(nt_Duration d, uint8_t buf[nt_PROTO_DURATION_MAXLEN]);
+char *nt_DurationUnmarshalProto(nt_Duration *d, const uint8_t *data, size_t len);
+size_t nt_TimeMarshalProtoBatch(const nt_Time *ts, size_t n, uint32_t field, uint8_t *buf);
+struct nt_TimeUnmarshalProtoBatch nt_TimeUnmarshalProtoBatch(const uint8_t *data, size_t len, uint32_t field, nt_Time *ts, size_t cap);
+size_t nt_TimeMarshalMsgpack(nt_Time t, uint8_t buf[nt_MSGPACK_TIME_MAXLEN]);
+struct nt_TimeUnmarshalMsgpack nt_TimeUnmarshalMsgpack(nt_Time *t, const uint8_t *data, size_t len);
+size_t nt_TimeMarshalMsgpackBatch(const nt_Time *ts, size_t n, uint8_t *buf);
+struct nt_TimeUnmarshalMsgpack nt_TimeUnmarshalMsgpackBatch(nt_Time *ts, size_t n, const uint8_t *data, size_t len);
+size_t nt_TimeMarshalCBOR(nt_Time t, uint8_t buf[nt_CBOR_TIME_MAXLEN]);
+struct nt_TimeUnmarshalCBOR nt_TimeUnmarshalCBOR(nt_Time *t, const uint8_t *data, size_t len);
+size_t nt_TimeMarshalCBORBatch(const nt_Time *ts, size_t n, uint8_t *buf);
+struct nt_TimeUnmarshalCBOR nt_TimeUnmarshalCBORBatch(nt_Time *ts, size_t n, const uint8_t *data, size_t len);
+
+// Sizes of the order-preserving key encodings.
+#define nt_TIME_KEY_LEN   12
+#define nt_TIME_KEY64_LEN 8
+
+void nt_TimeEncodeKey(nt_Time t, uint8_t buf[nt_TIME_KEY_LEN]);
+bool nt_TimeDecodeKey(nt_Time *t, const uint8_t buf[nt_TIME_KEY_LEN]);
+void nt_TimeEncodeKeyDesc(nt_Time t, uint8_t buf[nt_TIME_KEY_LEN]);
+bool nt_TimeDecodeKeyDesc(nt_Time *t, const uint8_t buf[nt_TIME_KEY_LEN]);
+void nt_TimeEncodeKey64(nt_Time t, bool desc, uint8_t buf[nt_TIME_KEY64_LEN]);
+nt_Time nt_TimeDecodeKey64(const uint8_t buf[nt_TIME_KEY64_LEN], bool desc);
+void nt_TimeEncodeKeyBatch(const nt_Time *ts, size_t n, bool desc, uint8_t *buf, nt_Pool *pool);
+void nt_TimeEncodeKey64Batch(const nt_Time *ts, size_t n, bool desc, uint8_t *buf, nt_Pool *pool);
+
+// Stats holds the library's counters, summed over all threads. They are
+// only maintained when the library is built with NANOTIME_STATS defined.
+typedef struct {
+    uint64_t lookups;         // Location lookups
+    uint64_t lookupSteps;     // binary search steps over transitions
+    uint64_t extendEvals;     // evaluations of a Location's extend rule
+    uint64_t cacheHits;       // zone cache hits computing a Time's fields
+    uint64_t cacheMisses;     // zone cache misses computing a Time's fields
+    uint64_t locationAllocs;  // LoadLocation, FixedZone
+    uint64_t snapshotAllocs;  // ZoneSnapshotOpen
+    uint64_t zoneIndexAllocs; // ZoneIndexNew
+    uint64_t poolAllocs;      // PoolNew
+    uint64_t stringAllocs;    // MonthString, WeekdayString, DurationString
+    uint64_t realtimeReads;   // wall clock reads
+    uint64_t monotonicReads;  // monotonic clock reads
+    uint64_t ringEnters;      // io_uring_enter calls by TimerRings
+} nt_Stats;
+bool nt_StatsRead(nt_Stats *out);
+void nt_StatsDump(int fd);
+
+typedef struct nt_ZoneIndex nt_ZoneIndex;
+typedef struct {
+    nt_Location *loc;
+    int offset; // seconds east of UTC
+    bool isDST;
+} nt_ZoneMatch;
+nt_ZoneIndex *nt_ZoneIndexNew(nt_Location *const *locs, size_t n);
+void nt_ZoneIndexFree(nt_ZoneIndex *x);
+size_t nt_ZoneIndexLookup(nt_ZoneIndex *x, const char *name, int64_t wallSec, nt_ZoneMatch *out, size_t max);
+
+// Arrow C Data Interface, as specified at
+// https://arrow.apache.org/docs/format/CDataInterface.html
+// Defined here so that no Arrow headers are needed; the guard lets it
+// coexist with other copies of the same definitions.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+// A Field selects a calendar or clock component of a Time.
+typedef enum {
+    nt_FIELD_YEAR,
+    nt_FIELD_MONTH,
+    nt_FIELD_DAY,
+    nt_FIELD_YEARDAY,
+    nt_FIELD_WEEKDAY,
+    nt_FIELD_HOUR,
+    nt_FIELD_MINUTE,
+    nt_FIELD_SECOND,
+    nt_FIELD_NANOSECOND,
+} nt_Field;
+
+nt_Location *nt_ArrowLocation(const struct ArrowSchema *schema);
+char *nt_ArrowField(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc, nt_Field field, int32_t *out, nt_Pool *pool);
+char *nt_ArrowToLocal(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc, int64_t *out, nt_Pool *pool);
+char *nt_ArrowTruncate(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Duration d, int64_t *out, nt_Pool *pool);
+char *nt_ArrowToTimes(const struct ArrowSchema *schema, const struct ArrowArray *array, nt_Location *loc, nt_Time *out, nt_Pool *pool);
+
+// Size of one Parquet INT96 timestamp.
+#define nt_PARQUET_INT96_LEN 12
+
+void nt_ParquetInt96ToUnixNano(const uint8_t *src, size_t n, int64_t *dst, nt_Pool *pool);
+void nt_ParquetInt96FromUnixNano(const int64_t *src, size_t n, uint8_t *dst, nt_Pool *pool);
+void nt_ParquetInt96ToTimes(const uint8_t *src, size_t n, nt_Time *dst, nt_Pool *pool);
+void nt_ParquetInt96FromTimes(const nt_Time *src, size_t n, uint8_t *dst, nt_Pool *pool);
+void nt_ParquetDateTimeToUnixNano(const int32_t *date, const int64_t *time, nt_Duration unit, size_t n, int64_t *dst, nt_Pool *pool);
+void nt_ParquetDateTimeFromUnixNano(const int64_t *src, size_t n, nt_Duration unit, int32_t *date, int64_t *time, nt_Pool *pool);
+
+char *nt_ParseASN1UTCTime(nt_Time *t, const uint8_t *p, size_t len);
+char *nt_ParseASN1GeneralizedTime(nt_Time *t, const uint8_t *p, size_t len);
+size_t nt_ParseASN1TimeBatch(const uint8_t *const *der, size_t n, nt_Time *out, nt_Pool *pool);
+
+
+// TimeFields holds the broken-down form of a Time in its Location. A
+// scan over sorted Times can keep one up to date with FieldsAdvance
+// instead of decomposing every Time from scratch.
+typedef struct {
+    int year;
+    nt_Month month;
+    int day;
+    int yday;           // 1..366, as YearDay
+    nt_Weekday weekday;
+    int hour, min, sec;
+    int nsec;
+    char *zone;         // abbreviated zone name
+    int offset;         // seconds east of UTC
+
+    // Private: the instant, and the range over which offset holds.
+    int64_t unixSec;
+    int64_t zoneStart, zoneEnd;
+    nt_Location *loc;
+} nt_TimeFields;
+
+nt_TimeFields nt_TimeFieldsOf(nt_Time t);
+void nt_FieldsAdvance(nt_TimeFields *f, nt_Duration delta);
+
+
+// A CivilDate is a calendar date with no time of day or Location, held
+// as the number of days since 1970-01-01, the Parquet and Arrow DATE
+// layout. Dates compare and subtract as plain integers.
+typedef int32_t nt_CivilDate;
+
+// A CivilTime is a time of day with no date or Location, held as the
+// number of nanoseconds since midnight, in [0, 24h).
+typedef int64_t nt_CivilTime;
+
+// Lengths of the text forms, "2006-01-02" and "15:04:05.000000000".
+#define nt_CIVIL_DATE_LEN 10
+#define nt_CIVIL_TIME_LEN 18
+
+nt_CivilDate nt_CivilDateOf(int year, nt_Month month, int day);
+nt_CivilDate nt_CivilDateFromTime(nt_Time t);
+struct nt_Date nt_CivilDateDate(nt_CivilDate d);
+nt_Weekday nt_CivilDateWeekday(nt_CivilDate d);
+int nt_CivilDateYearDay(nt_CivilDate d);
+nt_CivilDate nt_CivilDateAddDate(nt_CivilDate d, int years, int months, int days);
+nt_Time nt_CivilDateIn(nt_CivilDate d, nt_CivilTime c, nt_Location *loc);
+void nt_CivilDateFormat(nt_CivilDate d, char buf[nt_CIVIL_DATE_LEN]);
+char *nt_CivilDateParse(nt_CivilDate *d, const char *s, size_t len);
+void nt_CivilDateFormatBatch(const nt_CivilDate *d, size_t n, char *buf, nt_Pool *pool);
+size_t nt_CivilDateParseBatch(const char *buf, size_t n, nt_CivilDate *d, nt_Pool *pool);
+
+nt_CivilTime nt_CivilTimeOf(int hour, int min, int sec, int nsec);
+nt_CivilTime nt_CivilTimeFromTime(nt_Time t);
+struct nt_Clock nt_CivilTimeClock(nt_CivilTime c);
+nt_CivilTime nt_CivilTimeAdd(nt_CivilTime c, nt_Duration d);
+void nt_CivilTimeFormat(nt_CivilTime c, char buf[nt_CIVIL_TIME_LEN]);
+char *nt_CivilTimeParse(nt_CivilTime *c, const char *s, size_t len);
+void nt_CivilTimeFormatBatch(const nt_CivilTime *c, size_t n, char *buf, nt_Pool *pool);
+size_t nt_CivilTimeParseBatch(const char *buf, size_t n, nt_CivilTime *c, nt_Pool *pool);
+
+
+// An Instant is the canonical form of the instant a Time represents,
+// without its Location or monotonic clock reading. Times have equal
+// Instants exactly when they are Equal once stripped of their monotonic
+// clock readings, so an Instant can key a hash table.
+typedef struct {
+    int64_t sec;  // seconds since January 1, 1970 UTC
+    int32_t nsec; // [0, 999999999]
+} nt_Instant;
+
+nt_Instant nt_TimeKey(nt_Time t);
+uint64_t nt_InstantHash(nt_Instant k);
+bool nt_InstantEqual(nt_Instant a, nt_Instant b);
+
+// A TimeMap is an open-addressing hash table from Instants to 64-bit
+// values.
+typedef struct nt_TimeMap nt_TimeMap;
+
+nt_TimeMap *nt_TimeMapNew(size_t hint);
+void nt_TimeMapFree(nt_TimeMap *m);
+size_t nt_TimeMapLen(nt_TimeMap *m);
+uint64_t *nt_TimeMapFind(nt_TimeMap *m, nt_Time t);
+uint64_t *nt_TimeMapInsert(nt_TimeMap *m, nt_Time t);
+bool nt_TimeMapDelete(nt_TimeMap *m, nt_Time t);
+bool nt_TimeMapNext(nt_TimeMap *m, size_t *iter, nt_Instant *key, uint64_t **val);
+
+
+// A JoinEvent is one element of a stream fed to IntervalJoin or AsofJoin.
+typedef struct {
+    uint64_t key; // only events with equal keys are joined
+    int64_t when; // Unix nanoseconds
+    uint64_t id;  // caller's payload, such as an index or a pointer
+} nt_JoinEvent;
+
+typedef enum {
+    nt_JOIN_LEFT,
+    nt_JOIN_RIGHT,
+} nt_JoinSide;
+
+// A JoinFunc receives each matching pair of a join.
+typedef void (*nt_JoinFunc)(void *ctx, const nt_JoinEvent *left, const nt_JoinEvent *right);
+
+typedef struct nt_IntervalJoin nt_IntervalJoin;
+
+nt_IntervalJoin *nt_IntervalJoinNew(nt_Duration within, size_t partitions, nt_JoinFunc emit, void *ctx);
+void nt_IntervalJoinFree(nt_IntervalJoin *j);
+char *nt_IntervalJoinPush(nt_IntervalJoin *j, nt_JoinSide side, const nt_JoinEvent *ev, size_t n);
+void nt_IntervalJoinEvict(nt_IntervalJoin *j);
+size_t nt_IntervalJoinBuffered(nt_IntervalJoin *j);
+
+
+void nt_AsofJoin(const uint64_t *lkey, const int64_t *left, size_t nl,
+                 const uint64_t *rkey, const int64_t *right, size_t nr,
+                 nt_Duration tolerance, ptrdiff_t *out, nt_Pool *pool);
+
+
+// A ResampleMode selects how Resample computes each grid value.
+typedef enum {
+    nt_RESAMPLE_FFILL,  // the last value at or before the grid time
+    nt_RESAMPLE_LINEAR, // interpolated between the values around it
+    nt_RESAMPLE_MEAN,   // aggregates over [grid time, grid time + step)
+    nt_RESAMPLE_SUM,
+    nt_RESAMPLE_MIN,
+    nt_RESAMPLE_MAX,
+    nt_RESAMPLE_COUNT,
+} nt_ResampleMode;
+
+void nt_Resample(const int64_t *when, const double *val, size_t n,
+                 int64_t start, nt_Duration step, size_t count,
+                 nt_ResampleMode mode, double *out);
+
+
+// A DelayJob is a job held by a DelayQueue until its deadline.
+typedef struct {
+    int64_t deadline; // Unix nanoseconds
+    uint64_t id;      // caller's payload
+    uint64_t data;    // caller's payload
+} nt_DelayJob;
+
+typedef struct nt_DelayQueue nt_DelayQueue;
+struct nt_DelayQueueOpen {
+    nt_DelayQueue *q;
+    char *err;
+};
+struct nt_DelayQueueOpen nt_DelayQueueOpen(const char *path, nt_Duration width, size_t segmentSize);
+void nt_DelayQueueClose(nt_DelayQueue *q);
+char *nt_DelayQueuePush(nt_DelayQueue *q, nt_DelayJob job);
+bool nt_DelayQueuePop(nt_DelayQueue *q, int64_t now, nt_DelayJob *job);
+char *nt_DelayQueueSync(nt_DelayQueue *q);
+size_t nt_DelayQueueLen(nt_DelayQueue *q);
+
+
+// A DeadlineItem is an element of a DeadlineQueue. The queue links items
+// through their private fields, so it never allocates.
+typedef struct nt_DeadlineItem {
+    nt_Time deadline;
+    void *data;
+
+    // Private.
+    struct nt_DeadlineItem *next, *child;
+    int64_t when, period;
+} nt_DeadlineItem;
+
+typedef struct nt_DeadlineQueue nt_DeadlineQueue;
+
+nt_DeadlineQueue *nt_DeadlineQueueNew(void);
+void nt_DeadlineQueueFree(nt_DeadlineQueue *q);
+void nt_DeadlineQueuePush(nt_DeadlineQueue *q, nt_DeadlineItem *it);
+nt_DeadlineItem *nt_DeadlineQueueWait(nt_DeadlineQueue *q, nt_Duration timeout);
+void nt_DeadlineQueueWake(nt_DeadlineQueue *q);
+
+
+// A TimerRing fires DeadlineItems from io_uring timeouts. It belongs to
+// one thread.
+typedef struct nt_TimerRing nt_TimerRing;
+struct nt_TimerRingNew {
+    nt_TimerRing *r;
+    char *err;
+};
+struct nt_TimerRingNew nt_TimerRingNew(unsigned entries);
+void nt_TimerRingFree(nt_TimerRing *r);
+char *nt_TimerRingAdd(nt_TimerRing *r, nt_DeadlineItem *it);
+char *nt_TimerRingEvery(nt_TimerRing *r, nt_DeadlineItem *it, nt_Duration period);
+size_t nt_TimerRingWait(nt_TimerRing *r, nt_DeadlineItem **out, size_t max, nt_Duration timeout);
+size_t nt_TimerRingLen(nt_TimerRing *r);
+
+
+// A ClockSample is one reading of CLOCK_REALTIME, CLOCK_MONOTONIC and
+// CLOCK_MONOTONIC_RAW, in nanoseconds.
+typedef struct {
+    int64_t real, mono, raw;
+} nt_ClockSample;
+
+typedef enum {
+    nt_CLOCK_STEP, // the wall clock jumped against the monotonic clock
+    nt_CLOCK_SLEW, // the clock began running at an unusual rate
+} nt_ClockEventKind;
+
+typedef struct {
+    nt_ClockEventKind kind;
+    nt_Time when;     // the wall clock time it was detected
+    nt_Duration step; // how far the wall clock jumped
+    double rate;      // the monotonic clock's rate against the raw clock, in ppm
+} nt_ClockEvent;
+
+typedef void (*nt_ClockFunc)(void *ctx, const nt_ClockEvent *ev);
+
+// A ClockMonitorConfig configures a ClockMonitor. Zero fields take the
+// defaults.
+typedef struct {
+    nt_Duration interval; // between samples; default 1s
+    nt_Duration step;     // the smallest step reported; default 1ms
+    double slew;          // the smallest rate change reported, in ppm; default 10
+
+    // clock, if set, replaces the system clocks, as when simulating
+    // them. The monitor then never waits and has no file descriptor.
+    nt_ClockSample (*clock)(void *ctx);
+    void *ctx;
+} nt_ClockMonitorConfig;
+
+typedef struct {
+    uint64_t samples;
+    uint64_t steps;
+    uint64_t slews;
+    nt_Duration offset;  // the wall clock's total jump since the monitor started
+    nt_Duration maxStep; // the largest step, by magnitude
+    double drift;        // the monotonic clock's usual rate against the raw clock, in ppm
+    double rate;         // the same over the last interval
+    bool slewing;
+} nt_ClockStats;
+
+typedef struct nt_ClockMonitor nt_ClockMonitor;
+struct nt_ClockMonitorNew {
+    nt_ClockMonitor *m;
+    char *err;
+};
+struct nt_ClockMonitorNew nt_ClockMonitorNew(const nt_ClockMonitorConfig *config);
+void nt_ClockMonitorFree(nt_ClockMonitor *m);
+bool nt_ClockMonitorRegister(nt_ClockMonitor *m, nt_ClockFunc fn, void *ctx);
+void nt_ClockMonitorUnregister(nt_ClockMonitor *m, nt_ClockFunc fn, void *ctx);
+int nt_ClockMonitorFd(nt_ClockMonitor *m);
+size_t nt_ClockMonitorCheck(nt_ClockMonitor *m);
+size_t nt_ClockMonitorWait(nt_ClockMonitor *m);
+nt_ClockStats nt_ClockMonitorStats(nt_ClockMonitor *m);
+size_t nt_ClockMonitorEvents(nt_ClockMonitor *m, nt_ClockEvent *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,384 @@
+// Copyright 2024 Tim Millard. All rights reserved.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// time_coro.hpp provides C++20 coroutine awaitables for sleeping and
+// deadlines, driven by a DeadlineQueue:
+//
+//	co_await nanotime::sleep_for(50*nt_MILLISECOND);
+//	co_await nanotime::sleep_until(t);
+//	std::optional<int> v = co_await nanotime::with_deadline(t, fetch());
+//
+// A timer_loop owns the queue; one thread calls run, and the loop resumes
+// each coroutine whose deadline has passed, on its own thread or through
+// an executor. Awaiters embed their DeadlineItem, and the queue links
+// items intrusively, so suspending allocates nothing beyond the coroutine
+// frame.
+
+#ifndef TIME_CORO_HPP
+#define TIME_CORO_HPP
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "time.h"
+
+namespace nanotime {
+
+class timer_loop;
+
+// An executor resumes a coroutine whose timer has fired, for example by
+// posting it to a thread pool.
+using executor = void (*)(void *ctx, std::coroutine_handle<> h);
+
+namespace detail {
+
+// A timer is what a DeadlineItem's data points at. The loop calls fire on
+// its thread once the deadline has passed.
+struct timer {
+	nt_DeadlineItem item{};
+	void (*fire)(timer *t, timer_loop &loop) = nullptr;
+};
+
+} // namespace detail
+
+// A timer_loop runs the timers of the awaitables. Any thread may start a
+// timer; run and run_once must be called from one thread at a time.
+class timer_loop {
+public:
+	timer_loop() : q_(nt_DeadlineQueueNew()) {}
+	~timer_loop() { nt_DeadlineQueueFree(q_); }
+	timer_loop(const timer_loop &) = delete;
+	timer_loop &operator=(const timer_loop &) = delete;
+
+	// global returns the loop the awaitables use when none is given.
+	static timer_loop &global()
+	{
+		static timer_loop loop;
+		return loop;
+	}
+
+	// set_executor makes the loop hand coroutines to exec instead of
+	// resuming them itself. Call it before run.
+	void set_executor(executor exec, void *ctx)
+	{
+		exec_ = exec;
+		ctx_ = ctx;
+	}
+
+	// resume resumes h through the executor.
+	void resume(std::coroutine_handle<> h)
+	{
+		if (exec_ != nullptr) {
+			exec_(ctx_, h);
+		} else {
+			h.resume();
+		}
+	}
+
+	// run_once waits up to timeout, or forever if it is negative, for a
+	// timer to fire. It reports whether one did.
+	bool run_once(nt_Duration timeout = -1)
+	{
+		nt_DeadlineItem *it = nt_DeadlineQueueWait(q_, timeout);
+		if (it == nullptr) {
+			return false;
+		}
+		detail::timer *t = static_cast<detail::timer *>(it->data);
+		t->fire(t, *this);
+		return true;
+	}
+
+	// run fires timers until stop is called.
+	void run()
+	{
+		while (!stopped_.load(std::memory_order_acquire)) {
+			run_once();
+		}
+	}
+
+	// stop makes run return. Timers still pending are not fired.
+	void stop()
+	{
+		stopped_.store(true, std::memory_order_release);
+		nt_DeadlineQueueWake(q_);
+	}
+
+	// start schedules t to fire at deadline.
+	void start(detail::timer *t, nt_Time deadline)
+	{
+		t->item.deadline = deadline;
+		t->item.data = t;
+		nt_DeadlineQueuePush(q_, &t->item);
+	}
+
+private:
+	nt_DeadlineQueue *q_;
+	executor exec_ = nullptr;
+	void *ctx_ = nullptr;
+	std::atomic<bool> stopped_{false};
+};
+
+// A sleep_awaiter suspends the awaiting coroutine until a deadline. Its
+// timer lives in the awaiter, which lives in the coroutine frame.
+class sleep_awaiter : detail::timer {
+public:
+	sleep_awaiter(timer_loop &loop, nt_Time deadline) : loop_(loop), deadline_(deadline) {}
+
+	bool await_ready() const noexcept { return nt_Until(deadline_) <= 0; }
+
+	void await_suspend(std::coroutine_handle<> h) noexcept
+	{
+		h_ = h;
+		fire = [](detail::timer *t, timer_loop &loop) {
+			loop.resume(static_cast<sleep_awaiter *>(t)->h_);
+		};
+		loop_.start(this, deadline_);
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	timer_loop &loop_;
+	nt_Time deadline_;
+	std::coroutine_handle<> h_;
+};
+
+// sleep_until suspends the awaiting coroutine until t.
+inline sleep_awaiter sleep_until(nt_Time t, timer_loop &loop = timer_loop::global())
+{
+	return sleep_awaiter(loop, t);
+}
+
+// sleep_for suspends the awaiting coroutine for at least d.
+inline sleep_awaiter sleep_for(nt_Duration d, timer_loop &loop = timer_loop::global())
+{
+	return sleep_awaiter(loop, nt_TimeAdd(nt_Now(), d));
+}
+
+template <class T = void>
+class task;
+
+template <class T>
+class deadline_awaiter;
+
+namespace detail {
+
+enum { task_pending, task_done, task_expired };
+
+// A task's frame is shared by whoever may still touch it: the task
+// object, the running body and, under with_deadline, the timer. The last
+// of them to let go destroys it. state records whether the body or the
+// timer finished first, and so which of them resumes the continuation.
+struct promise_base : timer {
+	std::coroutine_handle<> continuation;
+	std::atomic<int> state{task_pending};
+	std::atomic<int> refs{1};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template <class P>
+void release(std::coroutine_handle<P> h) noexcept
+{
+	if (h.promise().refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		h.destroy();
+	}
+}
+
+template <class P>
+struct final_awaiter {
+	bool await_ready() noexcept { return false; }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+	{
+		P &p = h.promise();
+		std::coroutine_handle<> next = std::noop_coroutine();
+		int pending = task_pending;
+		if (p.state.compare_exchange_strong(pending, task_done, std::memory_order_acq_rel)) {
+			next = p.continuation;
+		}
+		release(h);
+		return next;
+	}
+
+	void await_resume() noexcept {}
+};
+
+template <class T>
+struct promise : promise_base {
+	std::optional<T> value;
+
+	task<T> get_return_object() noexcept;
+	final_awaiter<promise> final_suspend() noexcept { return {}; }
+
+	template <class U>
+	void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+};
+
+template <>
+struct promise<void> : promise_base {
+	task<void> get_return_object() noexcept;
+	final_awaiter<promise> final_suspend() noexcept { return {}; }
+
+	void return_void() noexcept {}
+};
+
+} // namespace detail
+
+// A task is a lazily started coroutine returning T. It runs when awaited,
+// directly or under with_deadline, or when spawned.
+template <class T>
+class task {
+public:
+	using promise_type = detail::promise<T>;
+
+	task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+	task &operator=(task &&) = delete;
+	~task()
+	{
+		if (h_) {
+			detail::release(h_);
+		}
+	}
+
+	auto operator co_await() && noexcept
+	{
+		struct awaiter {
+			std::coroutine_handle<promise_type> h;
+
+			bool await_ready() noexcept { return false; }
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept
+			{
+				h.promise().continuation = parent;
+				h.promise().refs.fetch_add(1, std::memory_order_relaxed);
+				return h;
+			}
+
+			T await_resume()
+			{
+				if constexpr (!std::is_void_v<T>) {
+					return std::move(*h.promise().value);
+				}
+			}
+		};
+		return awaiter{h_};
+	}
+
+private:
+	friend promise_type;
+	friend class deadline_awaiter<T>;
+	friend void spawn(task<void> t);
+
+	explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+	std::coroutine_handle<promise_type> h_;
+};
+
+template <class T>
+task<T> detail::promise<T>::get_return_object() noexcept
+{
+	return task<T>(std::coroutine_handle<promise>::from_promise(*this));
+}
+
+inline task<void> detail::promise<void>::get_return_object() noexcept
+{
+	return task<void>(std::coroutine_handle<promise>::from_promise(*this));
+}
+
+// spawn starts t without waiting for it. Its frame is freed when it
+// finishes.
+inline void spawn(task<void> t)
+{
+	auto h = t.h_;
+	h.promise().continuation = std::noop_coroutine();
+	h.promise().refs.fetch_add(1, std::memory_order_relaxed);
+	h.resume();
+}
+
+// A deadline_awaiter runs a task and resumes the awaiting coroutine when
+// the task finishes or the deadline passes, whichever is first. Its timer
+// lives in the task's frame, which the timer keeps alive until it fires.
+//
+// An expired task is not cancelled: it runs on to completion and its
+// result is discarded.
+template <class T>
+class deadline_awaiter {
+public:
+	using result = std::conditional_t<std::is_void_v<T>, bool, std::optional<T>>;
+
+	deadline_awaiter(timer_loop &loop, nt_Time deadline, task<T> t)
+		: loop_(loop), deadline_(deadline), task_(std::move(t)) {}
+
+	bool await_ready() noexcept
+	{
+		if (nt_Until(deadline_) > 0) {
+			return false;
+		}
+		task_.h_.promise().state.store(detail::task_expired, std::memory_order_relaxed);
+		return true;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept
+	{
+		// The timer may fire, resuming parent and destroying this
+		// awaiter, as soon as it is started.
+		auto h = task_.h_;
+		auto &p = h.promise();
+		p.continuation = parent;
+		p.refs.fetch_add(2, std::memory_order_relaxed);
+		p.fire = &expire;
+		loop_.start(&p, deadline_);
+		return h;
+	}
+
+	result await_resume()
+	{
+		auto &p = task_.h_.promise();
+		bool done = p.state.load(std::memory_order_acquire) == detail::task_done;
+		if constexpr (std::is_void_v<T>) {
+			return done;
+		} else {
+			return done ? std::move(p.value) : std::nullopt;
+		}
+	}
+
+private:
+	using promise_type = typename task<T>::promise_type;
+
+	static void expire(detail::timer *t, timer_loop &loop)
+	{
+		auto &p = static_cast<promise_type &>(*t);
+		auto h = std::coroutine_handle<promise_type>::from_promise(p);
+		std::coroutine_handle<> parent = p.continuation;
+		int pending = detail::task_pending;
+		bool won = p.state.compare_exchange_strong(pending, detail::task_expired, std::memory_order_acq_rel);
+		detail::release(h);
+		if (won) {
+			loop.resume(parent);
+		}
+	}
+
+	timer_loop &loop_;
+	nt_Time deadline_;
+	task<T> task_;
+};
+
+// with_deadline runs t, giving up on it at deadline. Awaiting it yields
+// t's result, or nullopt (false for a task<void>) if the deadline passed
+// first.
+template <class T>
+deadline_awaiter<T> with_deadline(nt_Time deadline, task<T> t, timer_loop &loop = timer_loop::global())
+{
+	return deadline_awaiter<T>(loop, deadline, std::move(t));
+}
+
+} // namespace nanotime
+
+#endif
@@ -0,0 +1,99 @@
+#include <cstdarg>
+#include <cstdio>
+
+#include "time_coro.hpp"
+
+using namespace nanotime;
+
+static int failed;
+
+static void errorf(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+	failed = 1;
+}
+
+static task<int> after(nt_Duration d, int v)
+{
+	co_await sleep_for(d);
+	co_return v;
+}
+
+static task<void> TestSleepFor()
+{
+	nt_Time start = nt_Now();
+	co_await sleep_for(20*nt_MILLISECOND);
+	nt_Duration slept = nt_Since(start);
+	if (slept < 20*nt_MILLISECOND || slept > 5*nt_SECOND) {
+		errorf("FAIL: sleep_for(20ms) slept %lld ns", (long long)slept);
+	}
+	co_await sleep_until(nt_TimeAdd(nt_Now(), -nt_SECOND));
+	printf("sleep_for PASS\n");
+}
+
+static task<void> TestWithDeadline()
+{
+	std::optional<int> r = co_await with_deadline(nt_TimeAdd(nt_Now(), 200*nt_MILLISECOND), after(10*nt_MILLISECOND, 7));
+	if (r != 7) {
+		errorf("FAIL: with_deadline before the deadline = %d, want 7", r.value_or(-1));
+	}
+
+	nt_Time start = nt_Now();
+	r = co_await with_deadline(nt_TimeAdd(nt_Now(), 10*nt_MILLISECOND), after(500*nt_MILLISECOND, 8));
+	nt_Duration waited = nt_Since(start);
+	if (r.has_value() || waited >= 500*nt_MILLISECOND) {
+		errorf("FAIL: with_deadline after the deadline = %d after %lld ns, want nullopt",
+			r.value_or(-1), (long long)waited);
+	}
+
+	bool done = co_await with_deadline(nt_TimeAdd(nt_Now(), -1), [] () -> task<void> { co_return; }());
+	if (done) {
+		errorf("FAIL: with_deadline with a past deadline ran the task");
+	}
+
+	// The frames are freed once the expired task finishes and the first
+	// task's timer fires.
+	co_await sleep_for(500*nt_MILLISECOND);
+	printf("with_deadline PASS\n");
+}
+
+static int spawned;
+
+static task<void> count(nt_Duration d)
+{
+	co_await sleep_for(d);
+	spawned++;
+}
+
+static task<void> TestSpawn()
+{
+	for (int i = 0; i < 10; i++) {
+		spawn(count((10 - i) * nt_MILLISECOND));
+	}
+	co_await sleep_for(100*nt_MILLISECOND);
+	if (spawned != 10) {
+		errorf("FAIL: %d of 10 spawned tasks finished", spawned);
+	}
+	printf("spawn PASS\n");
+}
+
+static task<void> run(timer_loop &loop)
+{
+	co_await TestSleepFor();
+	co_await TestWithDeadline();
+	co_await TestSpawn();
+	loop.stop();
+}
+
+int main(void)
+{
+	nt_init();
+	timer_loop &loop = timer_loop::global();
+	spawn(run(loop));
+	loop.run();
+	return failed;
+}
@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "time.h"
 
@@ -67,7 +73,7 @@ bool same(nt_Time t, parsedTime *u)
 
 	if (date.year != u->Year || date.month != u->Month || date.day != u->Day ||
 		clock.hour != u->Hour || clock.min != u->Minute || clock.sec != u->Second ||
-		zone.name != u->Zone || zone.offset != u->ZoneOffset) {
+		strcmp(zone.name, u->Zone) != 0 || zone.offset != u->ZoneOffset) {
 		return false;
 	}
 	// Check individual entries.
@@ -117,6 +123,1174 @@ void TestSecondsToUTC(T *t)
 	}
 }
 
+void TestSecondsToLocalTime(T *t)
+{
+	struct nt_LoadLocation z = nt_LoadLocation("America/Los_Angeles");
+	if (z.err != NULL) {
+		printf("SecondsToLocalTime SKIP: %s\n", z.err);
+		return;
+	}
+	for (int i = 0; i < ARRAY_SIZE(localtests); i++) {
+		TimeTest test = localtests[i];
+		int64_t sec = test.seconds;
+		parsedTime *golden = &test.golden;
+		nt_Time tm = nt_TimeIn(nt_Unix(sec, 0), z.loc);
+		int64_t newsec = nt_TimeUnix(tm);
+		if (newsec != sec) {
+			errorf(t, "SecondsToLocalTime(%lld).Seconds() = %lld", (long long)sec, (long long)newsec);
+		}
+		if (!same(tm, golden)) {
+			errorf(t, "%d] FAIL: SecondsToLocalTime(%lld)", i, (long long)sec);
+		}
+	}
+	nt_LocationFree(z.loc);
+
+	nt_Location *ist = nt_FixedZone("IST", 5*60*60 + 30*60);
+	struct nt_TimeZone zone = nt_TimeZone(nt_TimeIn(nt_Unix(0, 0), ist));
+	if (strcmp(zone.name, "IST") != 0 || zone.offset != 19800) {
+		errorf(t, "FAIL: FixedZone(IST) = %s %d", zone.name, zone.offset);
+	}
+	nt_LocationFree(ist);
+
+	// Both the shared whole-hour zones and allocated ones may be freed.
+	nt_Location *hour = nt_FixedZone("", 3600);
+	nt_LocationFree(hour);
+	nt_LocationFree(nt_FixedZone("", 19800));
+	if (nt_FixedZone("", 3600) != hour || nt_TimeZone(nt_TimeIn(nt_Unix(0, 0), hour)).offset != 3600) {
+		errorf(t, "FAIL: LocationFree released a shared FixedZone");
+	}
+	printf("SecondsToLocalTime PASS\n");
+}
+
+void TestZoneSnapshot(T *t)
+{
+	const char *names[] = {"Europe/London", "America/Los_Angeles", "Australia/Sydney", "UTC"};
+	const char *path = "/tmp/nanotime_test.snap";
+	char *err = nt_ZoneSnapshotWrite(path, names, ARRAY_SIZE(names));
+	if (err != NULL) {
+		printf("ZoneSnapshot SKIP: %s\n", err);
+		return;
+	}
+	struct nt_ZoneSnapshotOpen s = nt_ZoneSnapshotOpen(path);
+	remove(path);
+	if (s.err != NULL) {
+		errorf(t, "FAIL: ZoneSnapshotOpen: %s", s.err);
+		return;
+	}
+	if (nt_ZoneSnapshotLen(s.snap) != ARRAY_SIZE(names) ||
+		strcmp(nt_LocationString(nt_ZoneSnapshotAt(s.snap, 0)), "America/Los_Angeles") != 0 ||
+		nt_ZoneSnapshotLocation(s.snap, "Europe/Paris") != NULL) {
+		errorf(t, "FAIL: ZoneSnapshot index");
+	}
+	for (size_t i = 0; i < nt_ZoneSnapshotLen(s.snap); i++) {
+		if (nt_ZoneSnapshotIndex(s.snap, nt_LocationString(nt_ZoneSnapshotAt(s.snap, i))) != (ptrdiff_t)i) {
+			errorf(t, "FAIL: ZoneSnapshotIndex(%zu)", i);
+		}
+	}
+	if (nt_ZoneSnapshotIndex(s.snap, "") != -1 || nt_ZoneSnapshotIndex(s.snap, "Europe/Londo") != -1) {
+		errorf(t, "FAIL: ZoneSnapshotIndex found a missing name");
+	}
+
+	// The snapshot must agree with the TZif files on both sides of the
+	// extend string horizon.
+	for (int i = 0; i < ARRAY_SIZE(names); i++) {
+		nt_Location *snap = nt_ZoneSnapshotLocation(s.snap, names[i]);
+		struct nt_LoadLocation z = nt_LoadLocation(names[i]);
+		if (snap == NULL || z.err != NULL) {
+			errorf(t, "FAIL: ZoneSnapshotLocation(%s)", names[i]);
+			continue;
+		}
+		for (int64_t sec = -2000000000; sec < 4200000000; sec += 86400*7 + 3600) {
+			struct nt_TimeZone a = nt_TimeZone(nt_TimeIn(nt_Unix(sec, 0), snap));
+			struct nt_TimeZone b = nt_TimeZone(nt_TimeIn(nt_Unix(sec, 0), z.loc));
+			if (a.offset != b.offset || strcmp(a.name, b.name) != 0) {
+				errorf(t, "FAIL: %s at %lld: snapshot %s %d, tzif %s %d", names[i],
+					(long long)sec, a.name, a.offset, b.name, b.offset);
+				break;
+			}
+		}
+		nt_LocationFree(z.loc);
+	}
+	nt_ZoneSnapshotClose(s.snap);
+
+	if (nt_ZoneSnapshotWrite(path, (const char *[]){"Nowhere/Special"}, 1) == NULL) {
+		errorf(t, "FAIL: ZoneSnapshotWrite accepted an unknown zone");
+	}
+	printf("ZoneSnapshot PASS\n");
+}
+
+void TestZoneIndex(T *t)
+{
+	const char *names[] = {"America/Los_Angeles", "America/Vancouver", "Europe/London", "Australia/Sydney"};
+	nt_Location *locs[ARRAY_SIZE(names)];
+	for (int i = 0; i < ARRAY_SIZE(names); i++) {
+		struct nt_LoadLocation z = nt_LoadLocation(names[i]);
+		if (z.err != NULL) {
+			for (int j = 0; j < i; j++) {
+				nt_LocationFree(locs[j]);
+			}
+			printf("ZoneIndex SKIP: %s\n", z.err);
+			return;
+		}
+		locs[i] = z.loc;
+	}
+	nt_ZoneIndex *x = nt_ZoneIndexNew(locs, ARRAY_SIZE(locs));
+
+	// Wall clock times, as if they were UTC.
+	int64_t july2008 = 1214913600;  // 2008-07-01 12:00
+	int64_t jan2008 = 1199188800;   // 2008-01-01 12:00
+	int64_t july2040 = 2224756800;  // 2040-07-01 12:00, past the tx tables
+	struct {
+		const char *name;
+		int64_t wall;
+		size_t n;
+		int offset;
+	} tests[] = {
+		{"PDT", july2008, 2, -7*60*60},
+		{"PST", jan2008, 2, -8*60*60},
+		{"PST", july2008, 2, -8*60*60}, // name match only
+		{"BST", july2008, 1, 1*60*60},
+		{"GMT", jan2008, 1, 0},
+		{"AEST", july2040, 1, 10*60*60},
+		{"PDT", july2040, 2, -7*60*60},
+		{"XYZ", july2008, 0, 0},
+	};
+	for (int i = 0; i < ARRAY_SIZE(tests); i++) {
+		nt_ZoneMatch m[4];
+		size_t n = nt_ZoneIndexLookup(x, tests[i].name, tests[i].wall, m, ARRAY_SIZE(m));
+		if (n != tests[i].n || (n > 0 && m[0].offset != tests[i].offset)) {
+			errorf(t, "%d] FAIL: ZoneIndexLookup(%s) = %zu matches, offset %d", i, tests[i].name,
+				n, n > 0 ? m[0].offset : 0);
+		}
+	}
+	nt_ZoneIndexFree(x);
+	for (int i = 0; i < ARRAY_SIZE(locs); i++) {
+		nt_LocationFree(locs[i]);
+	}
+	printf("ZoneIndex PASS\n");
+}
+
+void TestMarshalBinary(T *t)
+{
+	// Golden bytes produced by Go's time.Unix(1221681866, 123456789).UTC().MarshalBinary().
+	uint8_t golden[] = {1, 0, 0, 0, 14, 192, 99, 89, 202, 7, 91, 205, 21, 255, 255};
+	nt_Time tm = nt_TimeUTC(nt_Unix(1221681866, 123456789));
+	uint8_t buf[nt_TIME_BINARY_MAXLEN];
+	struct nt_TimeMarshalBinary m = nt_TimeMarshalBinary(tm, buf);
+	if (m.err != NULL || m.n != sizeof(golden) || memcmp(buf, golden, m.n) != 0) {
+		errorf(t, "FAIL: MarshalBinary(%lld) err=%s n=%zu", (long long)nt_TimeUnix(tm), m.err, m.n);
+	} else {
+		printf("MarshalBinary PASS\n");
+	}
+
+	nt_Time got;
+	char *err = nt_TimeUnmarshalBinary(&got, buf, m.n);
+	if (err != NULL || !nt_TimeEqual(got, tm) || nt_TimeLocation(got) != nt_TimeLocation(tm)) {
+		errorf(t, "FAIL: UnmarshalBinary err=%s", err);
+	} else {
+		printf("UnmarshalBinary PASS\n");
+	}
+
+	// A fractional-hour offset decodes to one shared Location, which the
+	// caller does not own.
+	nt_Location *ist = nt_FixedZone("IST", 19800);
+	m = nt_TimeMarshalBinary(nt_TimeIn(tm, ist), buf);
+	nt_Time got2;
+	nt_TimeUnmarshalBinary(&got, buf, m.n);
+	nt_TimeUnmarshalBinary(&got2, buf, m.n);
+	if (nt_TimeLocation(got) != nt_TimeLocation(got2) || nt_TimeZone(got).offset != 19800 || !nt_TimeEqual(got, tm)) {
+		errorf(t, "FAIL: UnmarshalBinary of a +05:30 time");
+	}
+	nt_LocationFree(nt_TimeLocation(got));
+	if (nt_TimeZone(got2).offset != 19800) {
+		errorf(t, "FAIL: LocationFree released a decoded Time's Location");
+	}
+	nt_LocationFree(ist);
+
+	uint8_t bad[] = {3, 0, 0, 0};
+	if (nt_TimeUnmarshalBinary(&got, bad, sizeof(bad)) == NULL) {
+		errorf(t, "FAIL: UnmarshalBinary accepted version 3");
+	}
+
+	nt_Time ts[ARRAY_SIZE(utctests)], back[ARRAY_SIZE(utctests)];
+	uint8_t enc[ARRAY_SIZE(utctests) * nt_TIME_COMPACT_LEN];
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		ts[i] = nt_Unix(utctests[i].seconds, i * 1000);
+	}
+	nt_TimeMarshalCompactBatch(ts, ARRAY_SIZE(ts), enc, NULL);
+	if (!nt_TimeUnmarshalCompactBatch(enc, ARRAY_SIZE(ts), back, NULL)) {
+		errorf(t, "FAIL: UnmarshalCompactBatch rejected valid input");
+	}
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		if (!nt_TimeEqual(ts[i], back[i])) {
+			errorf(t, "%d] FAIL: compact round trip %lld", i, (long long)utctests[i].seconds);
+		}
+	}
+}
+
+void TestRPCEncodings(T *t)
+{
+	// Timestamp{seconds: 1221681866, nanos: 2e8} as encoded by protoc.
+	uint8_t golden[] = {0x08, 0xca, 0xc5, 0xc5, 0xc6, 0x04, 0x10, 0x80, 0x84, 0xaf, 0x5f};
+	nt_Time tm = nt_Unix(1221681866, 2e8);
+	uint8_t buf[nt_PROTO_TIMESTAMP_FIELD_MAXLEN * 2];
+	size_t n = nt_TimeMarshalProto(tm, buf);
+	if (n != sizeof(golden) || memcmp(buf, golden, n) != 0) {
+		errorf(t, "FAIL: MarshalProto n=%zu", n);
+	} else {
+		printf("MarshalProto PASS\n");
+	}
+
+	nt_Duration durations[] = {0, 1, -1, 90 * nt_MINUTE + 5, -nt_SECOND - 7, INT64_MAX, INT64_MIN};
+	for (int i = 0; i < ARRAY_SIZE(durations); i++) {
+		nt_Duration d;
+		n = nt_DurationMarshalProto(durations[i], buf);
+		char *err = nt_DurationUnmarshalProto(&d, buf, n);
+		if (err != NULL || d != durations[i]) {
+			errorf(t, "%d] FAIL: Duration proto round trip %lld: %s", i, (long long)durations[i], err);
+		}
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		nt_Time want = nt_Unix(utctests[i].seconds, i * 125000000);
+		nt_Time got;
+		n = nt_TimeMarshalProto(want, buf);
+		char *err = nt_TimeUnmarshalProto(&got, buf, n);
+		if (err != NULL || !nt_TimeEqual(got, want)) {
+			errorf(t, "%d] FAIL: proto round trip: %s", i, err);
+		}
+		n = nt_TimeMarshalMsgpack(want, buf);
+		struct nt_TimeUnmarshalMsgpack m = nt_TimeUnmarshalMsgpack(&got, buf, n);
+		if (m.err != NULL || m.n != n || !nt_TimeEqual(got, want)) {
+			errorf(t, "%d] FAIL: msgpack round trip: %s", i, m.err);
+		}
+		// i * 1/8 s is exact in a float64, so CBOR round trips exactly too.
+		n = nt_TimeMarshalCBOR(want, buf);
+		struct nt_TimeUnmarshalCBOR c = nt_TimeUnmarshalCBOR(&got, buf, n);
+		if (c.err != NULL || c.n != n || !nt_TimeEqual(got, want)) {
+			errorf(t, "%d] FAIL: cbor round trip: %s", i, c.err);
+		}
+	}
+
+	nt_Time ts[2] = {nt_Unix(1, 0), nt_Unix(-5, 7)};
+	nt_Time back[2];
+	n = nt_TimeMarshalProtoBatch(ts, 2, 3, buf);
+	struct nt_TimeUnmarshalProtoBatch b = nt_TimeUnmarshalProtoBatch(buf, n, 3, back, 2);
+	if (b.err != NULL || b.n != 2 || !nt_TimeEqual(back[0], ts[0]) || !nt_TimeEqual(back[1], ts[1])) {
+		errorf(t, "FAIL: proto batch round trip: %s", b.err);
+	} else {
+		printf("ProtoBatch PASS\n");
+	}
+}
+
+int sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+void TestEncodeKeyOrder(T *t)
+{
+	// Mix signs, nanoseconds and monotonic readings: memcmp on the keys
+	// must agree with Compare for every pair.
+	nt_Time ts[ARRAY_SIZE(utctests) * 2];
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		ts[2*i] = nt_Unix(utctests[i].seconds, 0);
+		ts[2*i+1] = nt_Unix(utctests[i].seconds, 999999999 - i);
+	}
+	ts[0] = nt_Now();
+
+	uint8_t asc[ARRAY_SIZE(ts)][nt_TIME_KEY_LEN];
+	uint8_t desc[ARRAY_SIZE(ts)][nt_TIME_KEY_LEN];
+	uint8_t asc64[ARRAY_SIZE(ts)][nt_TIME_KEY64_LEN];
+	nt_TimeEncodeKeyBatch(ts, ARRAY_SIZE(ts), false, &asc[0][0], NULL);
+	nt_TimeEncodeKey64Batch(ts, ARRAY_SIZE(ts), false, &asc64[0][0], NULL);
+	for (int i = 0; i < ARRAY_SIZE(ts); i++) {
+		nt_TimeEncodeKeyDesc(ts[i], desc[i]);
+		nt_Time got;
+		if (!nt_TimeDecodeKey(&got, asc[i]) || !nt_TimeEqual(got, ts[i])) {
+			errorf(t, "%d] FAIL: DecodeKey round trip", i);
+		}
+		if (!nt_TimeDecodeKeyDesc(&got, desc[i]) || !nt_TimeEqual(got, ts[i])) {
+			errorf(t, "%d] FAIL: DecodeKeyDesc round trip", i);
+		}
+	}
+	for (int i = 0; i < ARRAY_SIZE(ts); i++) {
+		for (int j = 0; j < ARRAY_SIZE(ts); j++) {
+			int want = nt_TimeCompare(ts[i], ts[j]);
+			if (sign(memcmp(asc[i], asc[j], nt_TIME_KEY_LEN)) != want ||
+				sign(memcmp(desc[i], desc[j], nt_TIME_KEY_LEN)) != -want) {
+				errorf(t, "%d,%d] FAIL: key order disagrees with Compare", i, j);
+			}
+			if (nt_TimeUnix(ts[i]) > -9e9 && nt_TimeUnix(ts[j]) > -9e9 && // inside UnixNano range
+				sign(memcmp(asc64[i], asc64[j], nt_TIME_KEY64_LEN)) != want) {
+				errorf(t, "%d,%d] FAIL: key64 order disagrees with Compare", i, j);
+			}
+		}
+	}
+	printf("EncodeKey PASS\n");
+}
+
+void TestArrowTimestamps(T *t)
+{
+	// Millisecond column over the utctests with slot 1 null and the
+	// array sliced by one to exercise the offset.
+	int64_t values[ARRAY_SIZE(utctests) + 1] = {-1};
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		values[i+1] = utctests[i].seconds*1000 + 999;
+	}
+	uint8_t validity[1] = {0xff & ~(1 << 2)};
+	const void *buffers[2] = {validity, values};
+	struct ArrowSchema schema = {.format = "tsm:UTC"};
+	struct ArrowArray array = {
+		.length = ARRAY_SIZE(utctests),
+		.null_count = 1,
+		.offset = 1,
+		.n_buffers = 2,
+		.buffers = buffers,
+	};
+
+	int32_t year[ARRAY_SIZE(utctests)], hour[ARRAY_SIZE(utctests)];
+	int64_t trunc[ARRAY_SIZE(utctests)];
+	if (nt_ArrowField(&schema, &array, NULL, nt_FIELD_YEAR, year, NULL) != NULL ||
+		nt_ArrowField(&schema, &array, NULL, nt_FIELD_HOUR, hour, NULL) != NULL ||
+		nt_ArrowTruncate(&schema, &array, nt_HOUR, trunc, NULL) != NULL) {
+		errorf(t, "FAIL: Arrow kernels rejected tsm:UTC");
+		return;
+	}
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		parsedTime *golden = &utctests[i].golden;
+		if (i == 1) {
+			if (year[i] != 0) {
+				errorf(t, "%d] FAIL: null slot year = %d", i, year[i]);
+			}
+			continue;
+		}
+		nt_Time want = nt_TimeTruncate(nt_Unix(utctests[i].seconds, 999e6), nt_HOUR);
+		if (year[i] != golden->Year || hour[i] != golden->Hour || trunc[i] != nt_TimeUnixMilli(want)) {
+			errorf(t, "%d] FAIL: Arrow year=%d hour=%d trunc=%lld", i, year[i], hour[i], (long long)trunc[i]);
+		}
+	}
+
+	schema.format = "tsm:-08:00";
+	if (nt_ArrowField(&schema, &array, NULL, nt_FIELD_HOUR, hour, NULL) != NULL || hour[0] != 16) {
+		errorf(t, "FAIL: Arrow fixed offset hour=%d", hour[0]);
+	}
+	schema.format = "tsm:+05:30";
+	nt_Location *ist = nt_ArrowLocation(&schema);
+	for (int i = 0; i < 3; i++) {
+		if (nt_ArrowField(&schema, &array, NULL, nt_FIELD_MINUTE, hour, NULL) != NULL || hour[0] != 30) {
+			errorf(t, "FAIL: Arrow +05:30 minute=%d", hour[0]);
+		}
+	}
+	if (nt_ArrowLocation(&schema) != ist) {
+		errorf(t, "FAIL: ArrowLocation(+05:30) is not shared");
+	}
+	printf("Arrow PASS\n");
+}
+
+void TestParquetInt96(T *t)
+{
+	// 2000-01-01 12:00:00.5 UTC is Julian day 2451545 plus half a day and a half second.
+	uint8_t golden[nt_PARQUET_INT96_LEN] = {0x00, 0xe5, 0x74, 0x66, 0x4a, 0x27, 0x00, 0x00, 0x59, 0x68, 0x25, 0x00};
+	int64_t nanos;
+	nt_ParquetInt96ToUnixNano(golden, 1, &nanos, NULL);
+	if (nanos != 946728000500000000) {
+		errorf(t, "FAIL: Int96ToUnixNano = %lld", (long long)nanos);
+	}
+
+	nt_Time ts[ARRAY_SIZE(utctests)], back[ARRAY_SIZE(utctests)];
+	uint8_t enc[ARRAY_SIZE(utctests) * nt_PARQUET_INT96_LEN];
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		ts[i] = nt_Unix(utctests[i].seconds, i * 7);
+	}
+	nt_ParquetInt96FromTimes(ts, ARRAY_SIZE(ts), enc, NULL);
+	nt_ParquetInt96ToTimes(enc, ARRAY_SIZE(ts), back, NULL);
+	for (int i = 0; i < ARRAY_SIZE(utctests); i++) {
+		if (!nt_TimeEqual(ts[i], back[i])) {
+			errorf(t, "%d] FAIL: Int96 round trip %lld", i, (long long)utctests[i].seconds);
+		}
+	}
+
+	int32_t date;
+	int64_t micros;
+	nt_ParquetDateTimeFromUnixNano(&nanos, 1, nt_MICROSECOND, &date, &micros, NULL);
+	if (date != 10957 || micros != 43200500000) {
+		errorf(t, "FAIL: DateTimeFromUnixNano = %d, %lld", date, (long long)micros);
+	}
+	printf("Parquet PASS\n");
+}
+
+typedef struct {
+	char *in;
+	int64_t unixSec;
+	int nsec;
+} ASN1Test;
+
+ASN1Test asn1utctests[] = {
+	{"080917200426Z", 1221681866, 0},
+	{"500101000000Z", -631152000, 0},
+	{"491231235959Z", 2524607999, 0},
+	{"080917200426", 0, -1},
+	{"0809172004a6Z", 0, -1},
+	{"080230000000Z", 0, -1},
+};
+
+ASN1Test asn1gentests[] = {
+	{"20080917200426Z", 1221681866, 0},
+	{"16010101000000Z", -11644473600, 0},
+	{"20080917200426.25Z", 1221681866, 250000000},
+	{"20080917200426.250Z", 0, -1},
+	{"20000229240000Z", 0, -1},
+};
+
+void TestParseASN1(T *t)
+{
+	for (int i = 0; i < ARRAY_SIZE(asn1utctests); i++) {
+		ASN1Test *test = &asn1utctests[i];
+		nt_Time got;
+		char *err = nt_ParseASN1UTCTime(&got, (uint8_t *)test->in, strlen(test->in));
+		if ((err != NULL) != (test->nsec < 0) ||
+			(err == NULL && nt_TimeUnix(got) != test->unixSec)) {
+			errorf(t, "%d] FAIL: ParseASN1UTCTime(%s): %s", i, test->in, err);
+		}
+	}
+	for (int i = 0; i < ARRAY_SIZE(asn1gentests); i++) {
+		ASN1Test *test = &asn1gentests[i];
+		nt_Time got;
+		char *err = nt_ParseASN1GeneralizedTime(&got, (uint8_t *)test->in, strlen(test->in));
+		if ((err != NULL) != (test->nsec < 0) ||
+			(err == NULL && (nt_TimeUnix(got) != test->unixSec || nt_TimeNanosecond(got) != test->nsec))) {
+			errorf(t, "%d] FAIL: ParseASN1GeneralizedTime(%s): %s", i, test->in, err);
+		}
+	}
+
+	const uint8_t notBefore[] = "\x17\x0d" "080917200426Z";
+	const uint8_t notAfter[] = "\x18\x0f" "20080917200426Z";
+	const uint8_t *der[] = {notBefore, notAfter};
+	nt_Time out[2];
+	if (nt_ParseASN1TimeBatch(der, 2, out, NULL) != 0 || !nt_TimeEqual(out[0], out[1])) {
+		errorf(t, "FAIL: ParseASN1TimeBatch");
+	}
+	printf("ParseASN1 PASS\n");
+}
+
+void TestParallelFor(T *t)
+{
+	enum { N = 1 << 18 };
+	nt_Pool *pool = nt_PoolNew(3);
+	if (pool == NULL) {
+		errorf(t, "FAIL: PoolNew");
+		return;
+	}
+	nt_Time *ts = malloc(N * sizeof(nt_Time));
+	nt_Time *back = malloc(N * sizeof(nt_Time));
+	uint8_t *serial = malloc(N * nt_TIME_KEY_LEN);
+	uint8_t *parallel = malloc(N * nt_TIME_KEY_LEN);
+	for (int i = 0; i < N; i++) {
+		ts[i] = nt_Unix((int64_t)i * 7919 - N, i);
+	}
+
+	nt_TimeEncodeKeyBatch(ts, N, true, serial, NULL);
+	nt_TimeEncodeKeyBatch(ts, N, true, parallel, pool);
+	if (memcmp(serial, parallel, N * nt_TIME_KEY_LEN) != 0) {
+		errorf(t, "FAIL: parallel EncodeKeyBatch differs from serial");
+	}
+
+	nt_TimeMarshalCompactBatch(ts, N, parallel, pool);
+	if (!nt_TimeUnmarshalCompactBatch(parallel, N, back, pool)) {
+		errorf(t, "FAIL: parallel UnmarshalCompactBatch rejected valid input");
+	}
+	for (int i = 0; i < N; i++) {
+		if (!nt_TimeEqual(ts[i], back[i])) {
+			errorf(t, "%d] FAIL: parallel compact round trip", i);
+			break;
+		}
+	}
+	parallel[(N-1) * nt_TIME_COMPACT_LEN + 8] = 0xff; // nanoseconds out of range
+	if (nt_TimeUnmarshalCompactBatch(parallel, N, back, pool)) {
+		errorf(t, "FAIL: parallel UnmarshalCompactBatch accepted bad input");
+	}
+
+	free(ts);
+	free(back);
+	free(serial);
+	free(parallel);
+	nt_PoolFree(pool);
+	printf("ParallelFor PASS\n");
+}
+
+static bool fieldsEqual(nt_TimeFields a, nt_TimeFields b)
+{
+	return a.year == b.year && a.month == b.month && a.day == b.day && a.yday == b.yday &&
+		a.weekday == b.weekday && a.hour == b.hour && a.min == b.min && a.sec == b.sec &&
+		a.nsec == b.nsec && a.offset == b.offset && strcmp(a.zone, b.zone) == 0;
+}
+
+void TestFieldsAdvance(T *t)
+{
+	struct nt_LoadLocation z = nt_LoadLocation("America/Los_Angeles");
+	if (z.err != NULL) {
+		printf("FieldsAdvance SKIP: %s\n", z.err);
+		return;
+	}
+	static const nt_Duration steps[] = {
+		997 * nt_MILLISECOND, 59 * nt_SECOND + 1, nt_HOUR + nt_MINUTE,
+		23 * nt_HOUR + 59 * nt_MINUTE + 59 * nt_SECOND + 999999999, -5 * nt_SECOND, 25 * nt_HOUR,
+	};
+	struct {
+		nt_Time start;
+		nt_Time end;
+	} runs[] = {
+		// Through both 2008 DST transitions and into 2009.
+		{nt_Date(2007, nt_DECEMBER, 31, 23, 0, 0, 0, z.loc), nt_Date(2009, nt_JANUARY, 2, 0, 0, 0, 0, z.loc)},
+		// Past the end of the transition table, and 2100, which is not a leap year.
+		{nt_Date(2099, nt_DECEMBER, 20, 0, 0, 0, 0, z.loc), nt_Date(2100, nt_MARCH, 20, 0, 0, 0, 0, z.loc)},
+		{nt_Date(2100, nt_FEBRUARY, 27, 0, 0, 0, 0, nt_UTC), nt_Date(2100, nt_MARCH, 2, 0, 0, 0, 0, nt_UTC)},
+	};
+	for (int r = 0; r < ARRAY_SIZE(runs); r++) {
+		nt_Time tm = runs[r].start;
+		nt_TimeFields f = nt_TimeFieldsOf(tm);
+		for (int i = 0; nt_TimeBefore(tm, runs[r].end); i++) {
+			nt_Duration d = steps[i % ARRAY_SIZE(steps)];
+			tm = nt_TimeAdd(tm, d);
+			nt_FieldsAdvance(&f, d);
+			nt_TimeFields want = nt_TimeFieldsOf(tm);
+			if (!fieldsEqual(f, want)) {
+				errorf(t, "FAIL: FieldsAdvance(%lld) at %lld: %d-%d-%d %d:%d:%d %s, want %d-%d-%d %d:%d:%d %s",
+					(long long)d, (long long)nt_TimeUnix(tm), f.year, f.month, f.day, f.hour, f.min, f.sec, f.zone,
+					want.year, want.month, want.day, want.hour, want.min, want.sec, want.zone);
+				break;
+			}
+		}
+	}
+	nt_LocationFree(z.loc);
+	printf("FieldsAdvance PASS\n");
+}
+
+void TestCivil(T *t)
+{
+	// Every 997th day over +-2000 years, against the Time based methods.
+	for (int64_t d = -730000; d < 730000; d += 997) {
+		nt_Time tm = nt_Unix(d * 86400, 0);
+		struct nt_Date want = nt_TimeDate(tm);
+		nt_CivilDate cd = nt_CivilDateOf(want.year, want.month, want.day);
+		struct nt_Date got = nt_CivilDateDate(cd);
+		if (cd != d || got.year != want.year || got.month != want.month || got.day != want.day ||
+			nt_CivilDateWeekday(cd) != nt_TimeWeekday(tm) || nt_CivilDateYearDay(cd) != nt_TimeYearDay(tm) ||
+			nt_CivilDateFromTime(tm) != cd) {
+			errorf(t, "FAIL: CivilDate(%lld) = %d, %d-%d-%d", (long long)d, cd, got.year, got.month, got.day);
+			break;
+		}
+	}
+	if (nt_CivilDateAddDate(nt_CivilDateOf(2011, nt_OCTOBER, 31), 0, 1, 0) != nt_CivilDateOf(2011, nt_DECEMBER, 1) ||
+		nt_CivilDateAddDate(nt_CivilDateOf(2012, nt_FEBRUARY, 29), 1, 0, 0) != nt_CivilDateOf(2013, nt_MARCH, 1) ||
+		nt_CivilDateOf(2000, 14, 0) != nt_CivilDateOf(2001, nt_JANUARY, 31)) {
+		errorf(t, "FAIL: CivilDateAddDate");
+	}
+
+	nt_CivilTime c = nt_CivilTimeOf(25, -1, 0, 5);
+	struct nt_Clock clock = nt_CivilTimeClock(c);
+	if (clock.hour != 0 || clock.min != 59 || clock.sec != 0 || c % nt_SECOND != 5 ||
+		nt_CivilTimeAdd(c, -2*nt_HOUR) != nt_CivilTimeOf(22, 59, 0, 5)) {
+		errorf(t, "FAIL: CivilTimeOf = %d:%d:%d", clock.hour, clock.min, clock.sec);
+	}
+
+	char buf[2*nt_CIVIL_TIME_LEN];
+	nt_CivilDate dates[2] = {nt_CivilDateOf(1969, nt_DECEMBER, 31), nt_CivilDateOf(2024, nt_FEBRUARY, 29)};
+	nt_CivilDateFormatBatch(dates, 2, buf, NULL);
+	if (memcmp(buf, "1969-12-312024-02-29", 2*nt_CIVIL_DATE_LEN) != 0) {
+		errorf(t, "FAIL: CivilDateFormatBatch = %.20s", buf);
+	}
+	nt_CivilDate dback[2];
+	if (nt_CivilDateParseBatch(buf, 2, dback, NULL) != 0 || dback[0] != dates[0] || dback[1] != dates[1]) {
+		errorf(t, "FAIL: CivilDateParseBatch");
+	}
+	nt_CivilDate d;
+	if (nt_CivilDateParse(&d, "2023-02-29", 10) == NULL || nt_CivilDateParse(&d, "2023-1-01", 9) == NULL) {
+		errorf(t, "FAIL: CivilDateParse accepted a bad date");
+	}
+
+	nt_CivilTime times[2] = {nt_CivilTimeOf(0, 0, 0, 0), nt_CivilTimeOf(23, 59, 59, 999999999)};
+	nt_CivilTimeFormatBatch(times, 2, buf, NULL);
+	if (memcmp(buf, "00:00:00.00000000023:59:59.999999999", 2*nt_CIVIL_TIME_LEN) != 0) {
+		errorf(t, "FAIL: CivilTimeFormatBatch = %.36s", buf);
+	}
+	nt_CivilTime tback[2];
+	if (nt_CivilTimeParseBatch(buf, 2, tback, NULL) != 0 || tback[0] != times[0] || tback[1] != times[1]) {
+		errorf(t, "FAIL: CivilTimeParseBatch");
+	}
+	if (nt_CivilTimeParse(&c, "15:04:05.5", 10) != NULL || c != nt_CivilTimeOf(15, 4, 5, 500000000) ||
+		nt_CivilTimeParse(&c, "24:00:00", 8) == NULL || nt_CivilTimeParse(&c, "15:04:05.", 9) == NULL) {
+		errorf(t, "FAIL: CivilTimeParse");
+	}
+
+	struct nt_LoadLocation z = nt_LoadLocation("America/Los_Angeles");
+	if (z.err == NULL) {
+		// 02:30 on 2011-03-13 does not exist in Los Angeles; as in Go's
+		// TestDate it is 02:30 PDT, which is 01:30 PST.
+		nt_Time tm = nt_CivilDateIn(nt_CivilDateOf(2011, nt_MARCH, 13), nt_CivilTimeOf(2, 30, 0, 0), z.loc);
+		if (nt_TimeUnix(tm) != 1300008600 || nt_CivilTimeFromTime(tm) != nt_CivilTimeOf(1, 30, 0, 0)) {
+			errorf(t, "FAIL: CivilDateIn = %lld", (long long)nt_TimeUnix(tm));
+		}
+		nt_LocationFree(z.loc);
+	}
+	printf("Civil PASS\n");
+}
+
+void TestTimeMap(T *t)
+{
+	// The same instant with and without a monotonic reading, and in
+	// another Location, is one key.
+	nt_Time now = nt_Now();
+	nt_Time same[] = {now, nt_TimeUTC(now), nt_TimeIn(now, nt_FixedZone("X", 3600)), nt_TimeRound(now, 0)};
+	nt_Instant k0 = nt_TimeKey(same[0]);
+	for (int i = 0; i < ARRAY_SIZE(same); i++) {
+		nt_Instant k = nt_TimeKey(same[i]);
+		if (!nt_InstantEqual(k, k0) || nt_InstantHash(k) != nt_InstantHash(k0) || k.sec != nt_TimeUnix(same[i])) {
+			errorf(t, "FAIL: TimeKey(same[%d]) = %lld.%09d", i, (long long)k.sec, k.nsec);
+		}
+	}
+	nt_LocationFree(same[2].loc);
+
+	nt_TimeMap *m = nt_TimeMapNew(0);
+	const int n = 10000;
+	for (int i = 0; i < 3*n; i++) {
+		// Every key three times, the second time 1ns apart from the first.
+		nt_Time tm = nt_Unix(i % n - n/2, (i / n) == 1 ? 0 : 1);
+		(*nt_TimeMapInsert(m, tm))++;
+	}
+	if (nt_TimeMapLen(m) != 2*n) {
+		errorf(t, "FAIL: TimeMapLen = %zu, want %d", nt_TimeMapLen(m), 2*n);
+	}
+	for (int i = 0; i < n; i += 2) {
+		if (!nt_TimeMapDelete(m, nt_Unix(i - n/2, 1))) {
+			errorf(t, "FAIL: TimeMapDelete(%d)", i);
+		}
+	}
+	if (nt_TimeMapDelete(m, nt_Unix(-n/2, 1)) || nt_TimeMapFind(m, nt_Unix(-n/2, 1)) != NULL) {
+		errorf(t, "FAIL: TimeMapDelete of a deleted key");
+	}
+	uint64_t sum = 0;
+	size_t it = 0, len = 0;
+	nt_Instant k;
+	uint64_t *v;
+	while (nt_TimeMapNext(m, &it, &k, &v)) {
+		uint64_t *f = nt_TimeMapFind(m, nt_Unix(k.sec, k.nsec));
+		if (f != v) {
+			errorf(t, "FAIL: TimeMapFind(%lld.%09d)", (long long)k.sec, k.nsec);
+		}
+		sum += *v;
+		len++;
+	}
+	if (len != nt_TimeMapLen(m) || len != (size_t)(n + n/2) || sum != (uint64_t)(n + 2*(n/2))) {
+		errorf(t, "FAIL: TimeMapNext visited %zu entries summing %llu", len, (unsigned long long)sum);
+	}
+	nt_TimeMapFree(m);
+	printf("TimeMap PASS\n");
+}
+
+struct joinSum {
+	uint64_t n, sum;
+};
+
+static void joinCount(void *ctx, const nt_JoinEvent *l, const nt_JoinEvent *r)
+{
+	struct joinSum *s = ctx;
+	s->n++;
+	s->sum += l->id*1000003 ^ r->id;
+}
+
+void TestIntervalJoin(T *t)
+{
+	enum { n = 2000 };
+	static nt_JoinEvent ev[2][n];
+	uint64_t rng = 1;
+	int64_t when[2] = {0, 0};
+	for (int i = 0; i < n; i++) {
+		for (int s = 0; s < 2; s++) {
+			rng = rng*6364136223846793005 + 1442695040888963407;
+			when[s] += (rng >> 33) % (3*nt_SECOND);
+			ev[s][i] = (nt_JoinEvent){(rng >> 20) % 5, when[s], i};
+		}
+	}
+	nt_Duration within = 2*nt_SECOND;
+	struct joinSum want = {0};
+	for (int i = 0; i < n; i++) {
+		for (int k = 0; k < n; k++) {
+			int64_t d = ev[0][i].when - ev[1][k].when;
+			if (ev[0][i].key == ev[1][k].key && d <= within && d >= -within) {
+				joinCount(&want, &ev[0][i], &ev[1][k]);
+			}
+		}
+	}
+	size_t partitions[] = {1, 4, 64};
+	for (int p = 0; p < ARRAY_SIZE(partitions); p++) {
+		struct joinSum got = {0};
+		nt_IntervalJoin *j = nt_IntervalJoinNew(within, partitions[p], joinCount, &got);
+		// Interleave the sides in uneven batches.
+		int next[2] = {0, 0};
+		for (int b = 0; next[0] < n || next[1] < n; b++) {
+			int s = b & 1, m = 1 + b % 7;
+			if (m > n - next[s]) {
+				m = n - next[s];
+			}
+			char *err = nt_IntervalJoinPush(j, s, &ev[s][next[s]], m);
+			if (err != NULL) {
+				errorf(t, "FAIL: IntervalJoinPush: %s", err);
+			}
+			next[s] += m;
+		}
+		nt_IntervalJoinEvict(j);
+		if (got.n != want.n || got.sum != want.sum || nt_IntervalJoinBuffered(j) > 50) {
+			errorf(t, "FAIL: IntervalJoin(%zu partitions) = %llu pairs, want %llu; %zu buffered", partitions[p],
+				(unsigned long long)got.n, (unsigned long long)want.n, nt_IntervalJoinBuffered(j));
+		}
+		if (nt_IntervalJoinPush(j, nt_JOIN_LEFT, &ev[0][0], 1) == NULL) {
+			errorf(t, "FAIL: IntervalJoinPush accepted an event out of order");
+		}
+		nt_IntervalJoinFree(j);
+	}
+	printf("IntervalJoin PASS\n");
+}
+
+void TestAsofJoin(T *t)
+{
+	enum { nl = 3000, nr = 5000 };
+	static uint64_t lkey[nl], rkey[nr];
+	static int64_t left[nl], right[nr];
+	static ptrdiff_t got[nl];
+	// Keys 0 to 9 with times increasing within each key; the right side
+	// has no key 7.
+	uint64_t rng = 1;
+	for (int s = 0; s < 2; s++) {
+		uint64_t *key = s ? rkey : lkey;
+		int64_t *when = s ? right : left;
+		int n = s ? nr : nl;
+		for (int i = 0; i < n; i++) {
+			rng = rng*6364136223846793005 + 1442695040888963407;
+			key[i] = i * 10 / n;
+			if (s && key[i] == 7) {
+				key[i] = 6;
+			}
+			when[i] = i > 0 && key[i] == key[i-1] ? when[i-1] + (int64_t)((rng >> 33) % 100) : (int64_t)((rng >> 33) % 50);
+		}
+	}
+	nt_Pool *pool = nt_PoolNew(3);
+	nt_Duration tolerances[] = {-1, 0, 20};
+	for (int k = 0; k < ARRAY_SIZE(tolerances); k++) {
+		for (int keyed = 0; keyed < 2; keyed++) {
+			for (int par = 0; par < 2; par++) {
+				if (keyed) {
+					nt_AsofJoin(lkey, left, nl, rkey, right, nr, tolerances[k], got, par ? pool : NULL);
+				} else {
+					// Key 0 alone is sorted by time.
+					nt_AsofJoin(NULL, left, nl/10, NULL, right, nr/10, tolerances[k], got, par ? pool : NULL);
+				}
+				for (int i = 0; i < (keyed ? nl : nl/10); i++) {
+					ptrdiff_t want = -1;
+					for (int j = 0; j < (keyed ? nr : nr/10); j++) {
+						if (rkey[j] == lkey[i] && right[j] <= left[i]) {
+							want = j;
+						}
+					}
+					if (want >= 0 && tolerances[k] >= 0 && left[i] - right[want] > tolerances[k]) {
+						want = -1;
+					}
+					if (got[i] != want) {
+						errorf(t, "FAIL: AsofJoin(tolerance %lld, keyed %d, pool %d)[%d] = %td, want %td",
+							(long long)tolerances[k], keyed, par, i, got[i], want);
+						break;
+					}
+				}
+			}
+		}
+	}
+	nt_PoolFree(pool);
+	printf("AsofJoin PASS\n");
+}
+
+static bool sameFloat(double a, double b)
+{
+	double d = a > b ? a - b : b - a;
+	return (isnan(a) && isnan(b)) || d <= 1e-9 * (1 + (b < 0 ? -b : b));
+}
+
+void TestResample(T *t)
+{
+	enum { n = 500, count = 400 };
+	static int64_t when[n];
+	static double val[n], got[count];
+	uint64_t rng = 1;
+	int64_t w = 1000;
+	for (int i = 0; i < n; i++) {
+		rng = rng*6364136223846793005 + 1442695040888963407;
+		// Gaps of 0 to 29, with runs of equal times and long gaps.
+		w += (rng >> 33) % 30 + (i % 100 == 99 ? 500 : 0);
+		when[i] = w;
+		val[i] = (double)((rng >> 20) % 1000) - 500;
+	}
+	int64_t start = 990, step = 25;
+	for (int mode = nt_RESAMPLE_FFILL; mode <= nt_RESAMPLE_COUNT; mode++) {
+		nt_Resample(when, val, n, start, step, count, mode, got);
+		for (int k = 0; k < count; k++) {
+			int64_t g = start + k*step;
+			double want = NAN, sum = 0, min = INFINITY, max = -INFINITY;
+			int c = 0, p = -1;
+			for (int i = 0; i < n; i++) {
+				if (when[i] <= g) {
+					p = i;
+				}
+				if (when[i] >= g && when[i] < g + step) {
+					sum += val[i];
+					min = val[i] < min ? val[i] : min;
+					max = val[i] > max ? val[i] : max;
+					c++;
+				}
+			}
+			switch (mode) {
+			case nt_RESAMPLE_FFILL:
+				want = p >= 0 ? val[p] : NAN;
+				break;
+			case nt_RESAMPLE_LINEAR:
+				if (p >= 0 && when[p] == g) {
+					want = val[p];
+				} else if (p >= 0 && p+1 < n) {
+					want = val[p] + (val[p+1] - val[p]) * (g - when[p]) / (when[p+1] - when[p]);
+				}
+				break;
+			case nt_RESAMPLE_MEAN:
+				want = c ? sum / c : NAN;
+				break;
+			case nt_RESAMPLE_SUM:
+				want = sum;
+				break;
+			case nt_RESAMPLE_MIN:
+				want = c ? min : NAN;
+				break;
+			case nt_RESAMPLE_MAX:
+				want = c ? max : NAN;
+				break;
+			case nt_RESAMPLE_COUNT:
+				want = c;
+				break;
+			}
+			if (!sameFloat(got[k], want)) {
+				errorf(t, "FAIL: Resample(mode %d)[%d] = %g, want %g", mode, k, got[k], want);
+				break;
+			}
+		}
+	}
+	printf("Resample PASS\n");
+}
+
+void TestDelayQueue(T *t)
+{
+	const char *path = "/tmp/nanotime_test.dq";
+	unlink(path);
+	struct nt_DelayQueueOpen o = nt_DelayQueueOpen(path, nt_SECOND, 4096);
+	if (o.err != NULL) {
+		printf("DelayQueue SKIP: %s\n", o.err);
+		return;
+	}
+	// Enough jobs for several segments per bucket and a file that grows.
+	enum { n = 20000 };
+	uint64_t rng = 1, sum = 0;
+	for (int i = 0; i < n; i++) {
+		rng = rng*6364136223846793005 + 1442695040888963407;
+		int64_t deadline = (int64_t)((rng >> 33) % (60*nt_SECOND));
+		nt_DelayQueuePush(o.q, (nt_DelayJob){deadline, i, deadline ^ i});
+		sum += i;
+	}
+	nt_DelayJob job;
+	int popped = 0;
+	int64_t last = INT64_MIN;
+	for (int64_t now = 0; now < 20*nt_SECOND; now += nt_SECOND/2) {
+		while (nt_DelayQueuePop(o.q, now, &job)) {
+			// Deadlines come out ordered to within a bucket.
+			if (job.deadline > now || job.deadline/nt_SECOND < last/nt_SECOND || job.data != (job.deadline ^ job.id)) {
+				errorf(t, "FAIL: DelayQueuePop(%lld) = %lld", (long long)now, (long long)job.deadline);
+			}
+			last = job.deadline;
+			sum -= job.id;
+			popped++;
+		}
+	}
+	if (nt_DelayQueueLen(o.q) != (size_t)(n - popped)) {
+		errorf(t, "FAIL: DelayQueueLen = %zu, want %d", nt_DelayQueueLen(o.q), n - popped);
+	}
+	if (nt_DelayQueueSync(o.q) != NULL) {
+		errorf(t, "FAIL: DelayQueueSync");
+	}
+	nt_DelayQueueClose(o.q);
+
+	// Zero the count of the first segment, as if its header had not been
+	// written back; reopening must find the records from the checksums.
+	int fd = open(path, O_RDWR);
+	uint32_t zero = 0;
+	pwrite(fd, &zero, sizeof(zero), 4096 + 4);
+	close(fd);
+	o = nt_DelayQueueOpen(path, 0, 0);
+	if (o.err != NULL) {
+		errorf(t, "FAIL: DelayQueueOpen: %s", o.err);
+		return;
+	}
+	while (nt_DelayQueuePop(o.q, INT64_MAX, &job)) {
+		sum -= job.id;
+		popped++;
+	}
+	if (popped != n || sum != 0 || nt_DelayQueueLen(o.q) != 0) {
+		errorf(t, "FAIL: DelayQueue reopened popped %d of %d", popped, n);
+	}
+	nt_DelayQueueClose(o.q);
+	unlink(path);
+	printf("DelayQueue PASS\n");
+}
+
+struct deadlineProducer {
+	nt_DeadlineQueue *q;
+	nt_DeadlineItem *items;
+	int n;
+};
+
+static void *deadlineProducer(void *arg)
+{
+	struct deadlineProducer *p = arg;
+	for (int i = 0; i < p->n; i++) {
+		p->items[i].deadline = nt_TimeAdd(nt_Now(), (i * 7919 % 20) * nt_MILLISECOND);
+		nt_DeadlineQueuePush(p->q, &p->items[i]);
+	}
+	return NULL;
+}
+
+void TestDeadlineQueue(T *t)
+{
+	nt_DeadlineQueue *q = nt_DeadlineQueueNew();
+	if (nt_DeadlineQueueWait(q, nt_MILLISECOND) != NULL) {
+		errorf(t, "FAIL: DeadlineQueueWait on an empty queue");
+	}
+
+	// An earlier item must cut a long sleep short.
+	nt_DeadlineItem late = {.deadline = nt_TimeAdd(nt_Now(), 10*nt_SECOND)};
+	nt_DeadlineItem soon = {.deadline = nt_TimeAdd(nt_Now(), 50*nt_MILLISECOND)};
+	nt_DeadlineQueuePush(q, &late);
+	struct deadlineProducer one = {q, &soon, 1};
+	pthread_t th;
+	pthread_create(&th, NULL, deadlineProducer, &one);
+	nt_Time start = nt_Now();
+	nt_DeadlineItem *it = nt_DeadlineQueueWait(q, -1);
+	nt_Duration waited = nt_Since(start);
+	pthread_join(th, NULL);
+	if (it != &soon || waited > 5*nt_SECOND) {
+		errorf(t, "FAIL: DeadlineQueueWait woke after %lld ns", (long long)waited);
+	}
+
+	enum { producers = 4, n = 500 };
+	static nt_DeadlineItem items[producers][n];
+	struct deadlineProducer p[producers];
+	pthread_t ths[producers];
+	for (int i = 0; i < producers; i++) {
+		p[i] = (struct deadlineProducer){q, items[i], n};
+		pthread_create(&ths[i], NULL, deadlineProducer, &p[i]);
+	}
+	int got = 0;
+	while (got < producers*n) {
+		it = nt_DeadlineQueueWait(q, 5*nt_SECOND);
+		if (it == NULL) {
+			errorf(t, "FAIL: DeadlineQueueWait timed out after %d items", got);
+			break;
+		}
+		if (nt_TimeAfter(it->deadline, nt_Now())) {
+			errorf(t, "FAIL: DeadlineQueueWait returned an item early");
+		}
+		got++;
+	}
+	for (int i = 0; i < producers; i++) {
+		pthread_join(ths[i], NULL);
+	}
+
+	nt_DeadlineQueueWake(q);
+	if (nt_DeadlineQueueWait(q, -1) != NULL) {
+		errorf(t, "FAIL: DeadlineQueueWake");
+	}
+	nt_DeadlineQueueFree(q);
+	printf("DeadlineQueue PASS\n");
+}
+
+void TestTimerRing(T *t)
+{
+	nt_TimerRingFree(NULL);
+	struct nt_TimerRingNew rn = nt_TimerRingNew(4);
+	if (rn.err != NULL) {
+		printf("TimerRing skipped: %s\n", rn.err);
+		return;
+	}
+	nt_TimerRing *r = rn.r;
+	nt_DeadlineItem *out[8];
+	if (nt_TimerRingWait(r, out, 8, nt_MILLISECOND) != 0) {
+		errorf(t, "FAIL: TimerRingWait on an empty ring");
+	}
+
+	// More timers than entries, added out of order, must fire in order.
+	enum { n = 10 };
+	nt_DeadlineItem items[n];
+	nt_Time now = nt_Now();
+	for (int i = 0; i < n; i++) {
+		items[i] = (nt_DeadlineItem){.deadline = nt_TimeAdd(now, (nt_Duration)((i*7)%n + 1)*5*nt_MILLISECOND)};
+		char *err = nt_TimerRingAdd(r, &items[i]);
+		if (err != NULL) {
+			errorf(t, "FAIL: TimerRingAdd: %s", err);
+		}
+	}
+	if (nt_TimerRingLen(r) != n) {
+		errorf(t, "FAIL: TimerRingLen = %zu, want %d", nt_TimerRingLen(r), n);
+	}
+	nt_Time prev = now;
+	for (int got = 0; got < n; ) {
+		size_t k = nt_TimerRingWait(r, out, 8, 5*nt_SECOND);
+		if (k == 0) {
+			errorf(t, "FAIL: TimerRingWait timed out after %d items", got);
+			break;
+		}
+		for (size_t i = 0; i < k; i++) {
+			if (nt_TimeAfter(out[i]->deadline, nt_Now()) || nt_TimeBefore(out[i]->deadline, prev)) {
+				errorf(t, "FAIL: TimerRingWait returned an item early or out of order");
+			}
+			prev = out[i]->deadline;
+		}
+		got += k;
+	}
+
+	// A repeating timer fires once per period.
+	nt_DeadlineItem tick = {0};
+	nt_TimerRingEvery(r, &tick, 5*nt_MILLISECOND);
+	nt_Time start = nt_Now();
+	for (int i = 0; i < 3; i++) {
+		if (nt_TimerRingWait(r, out, 1, 5*nt_SECOND) != 1 || out[0] != &tick) {
+			errorf(t, "FAIL: TimerRingEvery tick %d", i);
+		}
+	}
+	if (nt_Since(start) < 15*nt_MILLISECOND - nt_MILLISECOND) {
+		errorf(t, "FAIL: TimerRingEvery ticked early");
+	}
+	if (nt_TimerRingLen(r) != 1) {
+		errorf(t, "FAIL: TimerRingLen = %zu, want 1", nt_TimerRingLen(r));
+	}
+	nt_TimerRingFree(r);
+	printf("TimerRing PASS\n");
+}
+
+static nt_ClockSample clockVirtual(void *ctx)
+{
+	return *(nt_ClockSample *)ctx;
+}
+
+static void clockCount(void *ctx, const nt_ClockEvent *ev)
+{
+	((int *)ctx)[ev->kind]++;
+}
+
+void TestClockMonitor(T *t)
+{
+	nt_ClockSample now = {1700000000*nt_SECOND, 50*nt_SECOND, 40*nt_SECOND};
+	nt_ClockMonitorConfig c = {.clock = clockVirtual, .ctx = &now};
+	struct nt_ClockMonitorNew mn = nt_ClockMonitorNew(&c);
+	if (mn.err != NULL) {
+		errorf(t, "FAIL: ClockMonitorNew: %s", mn.err);
+		return;
+	}
+	nt_ClockMonitor *m = mn.m;
+	int seen[2] = {0};
+	nt_ClockMonitorRegister(m, clockCount, seen);
+
+	struct {
+		nt_Duration real, mono, raw;
+		int steps, slews;
+	} tests[] = {
+		{nt_SECOND, nt_SECOND, nt_SECOND, 0, 0},
+		{nt_SECOND + 100*nt_MICROSECOND, nt_SECOND, nt_SECOND, 0, 0}, // below the step threshold
+		{6*nt_SECOND, nt_SECOND, nt_SECOND, 1, 0},
+		{nt_SECOND - 2*nt_SECOND, nt_SECOND, nt_SECOND, 2, 0},
+		{nt_SECOND + 500*nt_MICROSECOND, nt_SECOND + 500*nt_MICROSECOND, nt_SECOND, 2, 1}, // a 500ppm slew
+		{nt_SECOND + 500*nt_MICROSECOND, nt_SECOND + 500*nt_MICROSECOND, nt_SECOND, 2, 1},
+		{nt_SECOND, nt_SECOND, nt_SECOND, 2, 1},
+	};
+	for (size_t i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+		now.real += tests[i].real;
+		now.mono += tests[i].mono;
+		now.raw += tests[i].raw;
+		nt_ClockMonitorWait(m);
+		if (seen[nt_CLOCK_STEP] != tests[i].steps || seen[nt_CLOCK_SLEW] != tests[i].slews) {
+			errorf(t, "FAIL: ClockMonitor sample %zu: %d steps, %d slews, want %d, %d",
+				i, seen[nt_CLOCK_STEP], seen[nt_CLOCK_SLEW], tests[i].steps, tests[i].slews);
+		}
+	}
+
+	nt_ClockStats st = nt_ClockMonitorStats(m);
+	if (st.samples != 7 || st.steps != 2 || st.slews != 1 || st.slewing ||
+			st.offset != 3*nt_SECOND + 100*nt_MICROSECOND || st.maxStep != 5*nt_SECOND) {
+		errorf(t, "FAIL: ClockMonitorStats = %llu samples, %llu steps, %llu slews, offset %lld, max step %lld",
+			(unsigned long long)st.samples, (unsigned long long)st.steps, (unsigned long long)st.slews,
+			(long long)st.offset, (long long)st.maxStep);
+	}
+	nt_ClockEvent ev[4];
+	size_t n = nt_ClockMonitorEvents(m, ev, 4);
+	if (n != 3 || ev[0].kind != nt_CLOCK_STEP || ev[0].step != 5*nt_SECOND ||
+			nt_TimeUnix(ev[0].when) != 1700000008 || ev[1].step != -2*nt_SECOND ||
+			ev[2].kind != nt_CLOCK_SLEW || ev[2].rate < 499 || ev[2].rate > 501) {
+		errorf(t, "FAIL: ClockMonitorEvents returned %zu events", n);
+	}
+
+	nt_ClockMonitorUnregister(m, clockCount, seen);
+	now.real += 10*nt_SECOND;
+	if (nt_ClockMonitorCheck(m) != 1 || seen[nt_CLOCK_STEP] != 2) {
+		errorf(t, "FAIL: ClockMonitorUnregister");
+	}
+	nt_ClockMonitorFree(m);
+
+	mn = nt_ClockMonitorNew(NULL);
+	if (mn.err != NULL) {
+		errorf(t, "FAIL: ClockMonitorNew(NULL): %s", mn.err);
+		return;
+	}
+	nt_ClockMonitorCheck(mn.m);
+	if (nt_ClockMonitorStats(mn.m).samples != 1) {
+		errorf(t, "FAIL: ClockMonitorCheck on the system clocks");
+	}
+	nt_ClockMonitorFree(mn.m);
+	nt_ClockMonitorFree(NULL);
+	printf("ClockMonitor PASS\n");
+}
+
+static void *statsThread(void *arg)
+{
+	nt_TimeHour(nt_TimeIn(nt_Unix(0, 0), arg));
+	return NULL;
+}
+
+void TestStats(T *t)
+{
+	nt_Stats before, after;
+	if (!nt_StatsRead(&before)) {
+		printf("Stats SKIP: built without NANOTIME_STATS\n");
+		return;
+	}
+	nt_Location *loc = nt_FixedZone("XST", 3600);
+	nt_TimeHour(nt_TimeIn(nt_Unix(0, 0), loc));
+	nt_Now();
+	// Counts made by a thread that has exited must not be lost.
+	pthread_t th;
+	pthread_create(&th, NULL, statsThread, loc);
+	pthread_join(th, NULL);
+	nt_StatsRead(&after);
+	if (after.cacheHits - before.cacheHits != 2 || after.locationAllocs - before.locationAllocs != 1 ||
+		after.realtimeReads - before.realtimeReads != 1 || after.monotonicReads - before.monotonicReads != 1) {
+		errorf(t, "FAIL: Stats hits %llu allocs %llu", (unsigned long long)(after.cacheHits - before.cacheHits),
+			(unsigned long long)(after.locationAllocs - before.locationAllocs));
+	}
+	nt_LocationFree(loc);
+	printf("Stats PASS\n");
+}
+
 int main(void)
 {
 
@@ -125,6 +1299,27 @@ int main(void)
     T *t = &(T){0};
 
     TestSecondsToUTC(t);
+    TestSecondsToLocalTime(t);
+    TestZoneSnapshot(t);
+    TestZoneIndex(t);
+    TestMarshalBinary(t);
+    TestRPCEncodings(t);
+    TestEncodeKeyOrder(t);
+    TestArrowTimestamps(t);
+    TestParquetInt96(t);
+    TestParseASN1(t);
+    TestParallelFor(t);
+    TestFieldsAdvance(t);
+    TestCivil(t);
+    TestTimeMap(t);
+    TestIntervalJoin(t);
+    TestAsofJoin(t);
+    TestResample(t);
+    TestDelayQueue(t);
+    TestDeadlineQueue(t);
+    TestTimerRing(t);
+    TestClockMonitor(t);
+    TestStats(t);
 
     printf("All Test PASSED\n");
     printf("*** Fishing Testing ... ***\n");